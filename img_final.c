@@ -1,13 +1,30 @@
 // RETO 2 - Procesamiento de Imágenes con 4 Funciones Concurrentes
 // Funciones implementadas: Convolución, Rotación, Detección de Bordes, Escalado
-// Cada función usa mínimo 2 hilos (pthreads) para procesamiento paralelo
-// Compilar: gcc -o img_final img_final.c -pthread -lm
+// Todas las funciones reparten filas entre los hilos de un pool persistente (pthreads)
+// Compilar: gcc -O2 -o img_final img_final.c -pthread -lm
 
 #include <stdio.h>
 #include <stdlib.h>
 #include <pthread.h>
 #include <string.h>
 #include <math.h>
+#include <stddef.h>
+#include <strings.h>
+#include <time.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <stdint.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#define IMG_X86 1
+#include <immintrin.h>
+#include <cpuid.h>
+#endif
+
+#define ALINEACION_PIXELES 64 // Filas alineadas a línea de caché
 
 #define STB_IMAGE_IMPLEMENTATION
 #include "stb_image.h"
@@ -17,67 +34,613 @@
 typedef struct {
     int ancho;
     int alto;
-    int canales;         // 1 (grises) o 3 (RGB)
-    unsigned char*** pixeles; // Matriz 3D: [alto][ancho][canales]
+    int canales;            // 1 (grises) o 3 (RGB)
+    size_t stride;          // Bytes entre filas (>= ancho * canales; múltiplo de ALINEACION_PIXELES
+                            // salvo en imágenes decodificadas por stb o .imgn mapeadas, que usan
+                            // el del decodificador o el del archivo)
+    unsigned char* pixeles; // Buffer contiguo: el píxel (x, y) está en pixeles + y * stride + x * canales
 } ImagenInfo;
 
-void liberarImagen(ImagenInfo* info) {
-    if (info->pixeles) {
-        for (int y = 0; y < info->alto; y++) {
-            for (int x = 0; x < info->ancho; x++) {
-                free(info->pixeles[y][x]);
-            }
-            free(info->pixeles[y]);
+// Puntero al inicio de la fila y de un buffer de píxeles
+#define FILA(buffer, stride, y) ((buffer) + (size_t)(y) * (stride))
+
+// Mensajes informativos de cada operación; el modo lote los desactiva
+static int modoSilencioso = 0;
+#define INFORMAR(...) do { if (!modoSilencioso) printf(__VA_ARGS__); } while (0)
+
+size_t calcularStride(int ancho, int canales) {
+    size_t bytesFila = (size_t)ancho * canales;
+    return (bytesFila + ALINEACION_PIXELES - 1) / ALINEACION_PIXELES * ALINEACION_PIXELES;
+}
+
+// ---- Medición de operaciones ----
+
+// Con --estadisticas o --estadisticas-json cada operación anota cuánto tarda en
+// reservar y liberar buffers, en repartir el trabajo entre los hilos del pool
+// (despacho: del envío a que un trabajador toma el primer bloque; espera: de
+// que el llamador acaba sus bloques a que acaban todos) y el tiempo de núcleo
+// de cada hilo. La medición activa es propia de cada hilo que ejecuta
+// operaciones y viaja en el trabajo hasta los trabajadores del pool. Solo se
+// mide la operación más externa: las que se inician dentro de otra (el
+// guardado de cada miniatura, las pendientes del menú) y los trabajos que se
+// envían desde un bloque medido cuentan en la que los contiene.
+
+#define MAX_HILOS 256
+
+typedef struct {
+    const char* nombre;
+    double inicio;
+    double reserva;          // Segundos en obtenerBuffer
+    double liberacion;       // Segundos en devolverBuffer
+    double despacho;
+    double espera;
+    int trabajos;            // Trabajos enviados al pool
+    int hilosDisponibles;    // Hilos que podían recibir bloques (1 si todo fue en serie)
+    double nucleo[MAX_HILOS]; // Por hilo: segundos ejecutando bloques
+    int bloques[MAX_HILOS];
+} MedicionOperacion;
+
+static __thread MedicionOperacion* medicionActual = NULL;
+static __thread int enBloqueMedido = 0; // Ejecutando un bloque cuyo núcleo ya se mide
+static __thread int indiceHilo = 0; // 0 = hilo principal, 1.. = trabajadores del pool
+
+static struct {
+    int verboso;             // Informe legible tras cada operación
+    FILE* json;              // Una línea JSON por operación
+    pthread_mutex_t mutex;
+} estadisticas = {0, NULL, PTHREAD_MUTEX_INITIALIZER};
+
+static double segundosMonotonicos() {
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return t.tv_sec + t.tv_nsec / 1e9;
+}
+
+void iniciarMedicion(MedicionOperacion* m, const char* nombre) {
+    if (!estadisticas.verboso && !estadisticas.json) return;
+    if (medicionActual || enBloqueMedido) return; // Anidada: cuenta en la externa
+    memset(m, 0, sizeof(*m));
+    m->nombre = nombre;
+    m->hilosDisponibles = 1;
+    m->inicio = segundosMonotonicos();
+    medicionActual = m;
+}
+
+void terminarMedicion(MedicionOperacion* m, const ImagenInfo* info, int ok) {
+    if (medicionActual != m) return;
+    medicionActual = NULL;
+    double total = segundosMonotonicos() - m->inicio;
+    // Se listan los hilos que ejecutaron bloques. El desequilibrio es el núcleo del
+    // hilo más cargado entre la media de los que podían participar (los que no
+    // recibieron bloques cuentan con 0).
+    int hilos[MAX_HILOS];
+    int numHilos = 0;
+    double suma = 0, maximo = 0;
+    for (int i = 0; i < MAX_HILOS; i++) {
+        if (m->bloques[i] == 0) continue;
+        hilos[numHilos++] = i;
+        suma += m->nucleo[i];
+        if (m->nucleo[i] > maximo) maximo = m->nucleo[i];
+    }
+    int participantes = (m->hilosDisponibles > numHilos) ? m->hilosDisponibles : numHilos;
+    double media = suma / participantes;
+    double desequilibrio = (media > 0) ? maximo / media : 1.0;
+    
+    pthread_mutex_lock(&estadisticas.mutex);
+    if (estadisticas.verboso) {
+        printf("[estadísticas] %s %dx%d: %.3f ms%s | reserva %.3f ms, liberación %.3f ms | "
+               "%d trabajos, despacho %.3f ms, espera %.3f ms | núcleo por hilo (hilo:ms):",
+               m->nombre, info->ancho, info->alto, total * 1e3, ok ? "" : " (falló)",
+               m->reserva * 1e3, m->liberacion * 1e3, m->trabajos, m->despacho * 1e3, m->espera * 1e3);
+        for (int i = 0; i < numHilos; i++) printf(" %d:%.3f", hilos[i], m->nucleo[hilos[i]] * 1e3);
+        printf("%s (de %d) | desequilibrio %.2f\n", numHilos ? "" : " -", participantes, desequilibrio);
+    }
+    if (estadisticas.json) {
+        fprintf(estadisticas.json, "{\"operacion\": \"%s\", \"ancho\": %d, \"alto\": %d, \"canales\": %d, "
+                "\"ok\": %s, \"total_ms\": %.4f, \"reserva_ms\": %.4f, \"liberacion_ms\": %.4f, "
+                "\"trabajos\": %d, \"despacho_ms\": %.4f, \"espera_ms\": %.4f, \"participantes\": %d, \"hilos\": [",
+                m->nombre, info->ancho, info->alto, info->canales, ok ? "true" : "false", total * 1e3,
+                m->reserva * 1e3, m->liberacion * 1e3, m->trabajos, m->despacho * 1e3, m->espera * 1e3, participantes);
+        for (int i = 0; i < numHilos; i++) fprintf(estadisticas.json, "%s%d", i ? ", " : "", hilos[i]);
+        fprintf(estadisticas.json, "], \"nucleo_ms\": [");
+        for (int i = 0; i < numHilos; i++) fprintf(estadisticas.json, "%s%.4f", i ? ", " : "", m->nucleo[hilos[i]] * 1e3);
+        fprintf(estadisticas.json, "], \"bloques\": [");
+        for (int i = 0; i < numHilos; i++) fprintf(estadisticas.json, "%s%d", i ? ", " : "", m->bloques[hilos[i]]);
+        fprintf(estadisticas.json, "], \"desequilibrio\": %.4f}\n", desequilibrio);
+        fflush(estadisticas.json);
+    }
+    pthread_mutex_unlock(&estadisticas.mutex);
+}
+
+// ---- Pool de buffers de píxeles ----
+
+// Los buffers que se liberan se guardan por clase de tamaño (cuatro clases por
+// potencia de 2) para que la siguiente operación de un tamaño parecido reutilice
+// memoria ya tocada en lugar de pedir páginas nuevas al sistema. Si los bytes
+// guardados superan el límite se liberan primero los más antiguos.
+
+#define MAX_BUFFERS_LIBRES 32
+#define TAM_MINIMO_BUFFER_POOL 4096
+#define LIMITE_POOL_BUFFERS_MB 512 // Por defecto; IMG_POOL_MB o --pool-mb lo cambian
+
+typedef struct {
+    unsigned char* buffer;
+    size_t clase;        // Bytes utilizables (clase de tamaño)
+} BufferLibre;
+
+static struct {
+    BufferLibre libres[MAX_BUFFERS_LIBRES]; // Del más antiguo al más reciente
+    int numLibres;
+    size_t bytesLibres;
+    size_t limiteBytes;
+    long aciertos;
+    long fallos;
+    long descartados;
+    pthread_mutex_t mutex;
+} poolBuffers = {
+    .limiteBytes = (size_t)LIMITE_POOL_BUFFERS_MB << 20,
+    .mutex = PTHREAD_MUTEX_INITIALIZER,
+};
+
+// Clase de tamaño de una petición de tam bytes: la menor clase >= tam
+static size_t claseBuffer(size_t tam) {
+    if (tam < TAM_MINIMO_BUFFER_POOL) return TAM_MINIMO_BUFFER_POOL;
+    size_t base = TAM_MINIMO_BUFFER_POOL;
+    while (base <= tam / 2) base *= 2;
+    size_t paso = base / 4;
+    return base + (tam - base + paso - 1) / paso * paso;
+}
+
+static void* mallocAlineado(size_t tam) {
+    void* p = NULL;
+    return (posix_memalign(&p, ALINEACION_PIXELES, tam) == 0) ? p : NULL;
+}
+
+// Libera los buffers más antiguos hasta quedar dentro del límite (con el mutex tomado)
+static void recortarPoolBuffers(size_t limite) {
+    int quitar = 0;
+    while (quitar < poolBuffers.numLibres && poolBuffers.bytesLibres > limite) {
+        poolBuffers.bytesLibres -= poolBuffers.libres[quitar].clase;
+        free(poolBuffers.libres[quitar].buffer);
+        poolBuffers.descartados++;
+        quitar++;
+    }
+    poolBuffers.numLibres -= quitar;
+    memmove(poolBuffers.libres, poolBuffers.libres + quitar, poolBuffers.numLibres * sizeof(BufferLibre));
+}
+
+void fijarLimitePoolBuffers(size_t megabytes) {
+    pthread_mutex_lock(&poolBuffers.mutex);
+    poolBuffers.limiteBytes = megabytes << 20;
+    recortarPoolBuffers(poolBuffers.limiteBytes);
+    pthread_mutex_unlock(&poolBuffers.mutex);
+}
+
+void vaciarPoolBuffers() {
+    pthread_mutex_lock(&poolBuffers.mutex);
+    recortarPoolBuffers(0);
+    pthread_mutex_unlock(&poolBuffers.mutex);
+}
+
+// ---- Buffers ajenos al pool ----
+
+// Las imágenes en formato nativo se cargan con mmap y las decodificadas por
+// stb_image usan el buffer que devuelve el decodificador: sus píxeles no vienen
+// del pool, así que se anotan aquí y devolverBuffer los desmapea o se los
+// devuelve a stb en lugar de guardarlos.
+
+typedef struct {
+    unsigned char* pixeles;  // Lo que ve ImagenInfo (dentro del mapeo o la base del de stb)
+    void* base;
+    size_t largo;            // Bytes mapeados; 0 si es un buffer de stb_image
+} BufferAjeno;
+
+static struct {
+    BufferAjeno* buffers;    // Crece según las imágenes vivas
+    int num;
+    int capacidad;
+} buffersAjenos;
+
+// Anota un mapeo (o con largo 0 un buffer de stb_image); devuelve 0 si no hay memoria
+static int registrarBufferAjeno(unsigned char* pixeles, void* base, size_t largo) {
+    int ok = 1;
+    pthread_mutex_lock(&poolBuffers.mutex);
+    if (buffersAjenos.num == buffersAjenos.capacidad) {
+        int nueva = buffersAjenos.capacidad ? buffersAjenos.capacidad * 2 : 16;
+        BufferAjeno* ampliada = (BufferAjeno*)realloc(buffersAjenos.buffers, nueva * sizeof(BufferAjeno));
+        if (ampliada) {
+            buffersAjenos.buffers = ampliada;
+            buffersAjenos.capacidad = nueva;
+        } else {
+            ok = 0;
+        }
+    }
+    if (ok) {
+        BufferAjeno* b = &buffersAjenos.buffers[buffersAjenos.num++];
+        b->pixeles = pixeles;
+        b->base = base;
+        b->largo = largo;
+    }
+    pthread_mutex_unlock(&poolBuffers.mutex);
+    return ok;
+}
+
+// Si buffer no es del pool lo desmapea o lo libera con stb y devuelve 1
+static int liberarBufferAjeno(unsigned char* buffer) {
+    BufferAjeno encontrado = {NULL, NULL, 0};
+    pthread_mutex_lock(&poolBuffers.mutex);
+    for (int i = 0; i < buffersAjenos.num; i++) {
+        if (buffersAjenos.buffers[i].pixeles == buffer) {
+            encontrado = buffersAjenos.buffers[i];
+            buffersAjenos.buffers[i] = buffersAjenos.buffers[--buffersAjenos.num];
+            break;
+        }
+    }
+    pthread_mutex_unlock(&poolBuffers.mutex);
+    if (!encontrado.base) return 0;
+    if (encontrado.largo) munmap(encontrado.base, encontrado.largo);
+    else stbi_image_free(encontrado.base);
+    return 1;
+}
+
+// Guarda en el pool un buffer pedido con tam bytes (todos se reservan con el tamaño de su clase)
+static void guardarBufferLibre(unsigned char* buffer, size_t tam) {
+    if (!buffer) return;
+    if (liberarBufferAjeno(buffer)) return; // Consulta la tabla con el mutex tomado
+    size_t clase = claseBuffer(tam);
+    pthread_mutex_lock(&poolBuffers.mutex);
+    if (clase > poolBuffers.limiteBytes) {
+        pthread_mutex_unlock(&poolBuffers.mutex);
+        free(buffer);
+        return;
+    }
+    if (poolBuffers.numLibres == MAX_BUFFERS_LIBRES) {
+        recortarPoolBuffers(poolBuffers.bytesLibres - poolBuffers.libres[0].clase);
+    }
+    poolBuffers.libres[poolBuffers.numLibres].buffer = buffer;
+    poolBuffers.libres[poolBuffers.numLibres].clase = clase;
+    poolBuffers.numLibres++;
+    poolBuffers.bytesLibres += clase;
+    recortarPoolBuffers(poolBuffers.limiteBytes);
+    pthread_mutex_unlock(&poolBuffers.mutex);
+}
+
+// Toma del pool un buffer de al menos tam bytes, o reserva uno de la clase correspondiente
+static unsigned char* tomarBufferLibre(size_t tam) {
+    size_t clase = claseBuffer(tam);
+    pthread_mutex_lock(&poolBuffers.mutex);
+    for (int i = poolBuffers.numLibres - 1; i >= 0; i--) {
+        if (poolBuffers.libres[i].clase == clase) {
+            unsigned char* buffer = poolBuffers.libres[i].buffer;
+            poolBuffers.bytesLibres -= clase;
+            poolBuffers.numLibres--;
+            memmove(poolBuffers.libres + i, poolBuffers.libres + i + 1,
+                    (poolBuffers.numLibres - i) * sizeof(BufferLibre));
+            poolBuffers.aciertos++;
+            pthread_mutex_unlock(&poolBuffers.mutex);
+            return buffer;
         }
-        free(info->pixeles);
-        info->pixeles = NULL;
     }
+    poolBuffers.fallos++;
+    pthread_mutex_unlock(&poolBuffers.mutex);
+    return (unsigned char*)mallocAlineado(clase);
+}
+
+// Versiones públicas: con una medición activa se anota su tiempo en la operación
+void devolverBuffer(unsigned char* buffer, size_t tam) {
+    MedicionOperacion* m = medicionActual;
+    double inicio = m ? segundosMonotonicos() : 0;
+    guardarBufferLibre(buffer, tam);
+    if (m) m->liberacion += segundosMonotonicos() - inicio;
+}
+
+static unsigned char* obtenerBuffer(size_t tam) {
+    MedicionOperacion* m = medicionActual;
+    double inicio = m ? segundosMonotonicos() : 0;
+    unsigned char* buffer = tomarBufferLibre(tam);
+    if (m) m->reserva += segundosMonotonicos() - inicio;
+    return buffer;
+}
+
+void mostrarEstadisticasBuffers() {
+    pthread_mutex_lock(&poolBuffers.mutex);
+    long total = poolBuffers.aciertos + poolBuffers.fallos;
+    printf("Pool de buffers: %ld aciertos, %ld fallos (%.0f%% reutilizados), %ld descartados, %d libres (%.1f MB de %zu MB)\n",
+           poolBuffers.aciertos, poolBuffers.fallos, total ? 100.0 * poolBuffers.aciertos / total : 0.0,
+           poolBuffers.descartados, poolBuffers.numLibres, poolBuffers.bytesLibres / 1048576.0,
+           poolBuffers.limiteBytes >> 20);
+    pthread_mutex_unlock(&poolBuffers.mutex);
+}
+
+// Reserva (o reutiliza) un buffer de alto filas alineado; devuelve NULL si no hay memoria
+unsigned char* crearBufferPixeles(int ancho, int alto, int canales, size_t* stride) {
+    *stride = calcularStride(ancho, canales);
+    unsigned char* buffer = obtenerBuffer(*stride * (size_t)alto);
+    if (!buffer) {
+        fprintf(stderr, "Error de memoria al asignar buffer de %dx%d píxeles\n", ancho, alto);
+        return NULL;
+    }
+    return buffer;
+}
+
+void liberarImagen(ImagenInfo* info) {
+    devolverBuffer(info->pixeles, info->stride * (size_t)info->alto);
+    info->pixeles = NULL;
     info->ancho = 0;
     info->alto = 0;
     info->canales = 0;
+    info->stride = 0;
 }
 
-int cargarImagen(const char* ruta, ImagenInfo* info) {
-    int canales;
-    unsigned char* datos = stbi_load(ruta, &info->ancho, &info->alto, &canales, 0);
-    if (!datos) {
-        fprintf(stderr, "Error al cargar imagen: %s\n", ruta);
-        return 0;
+// Sustituye el buffer de la imagen por uno nuevo con las dimensiones dadas;
+// el anterior vuelve al pool de buffers
+void reemplazarPixeles(ImagenInfo* info, unsigned char* pixeles, size_t stride,
+                       int ancho, int alto, int canales) {
+    devolverBuffer(info->pixeles, info->stride * (size_t)info->alto);
+    info->pixeles = pixeles;
+    info->stride = stride;
+    info->ancho = ancho;
+    info->alto = alto;
+    info->canales = canales;
+}
+
+// Copia origen en destino (que puede tener otras dimensiones); devuelve 0 si no hay memoria
+int copiarImagen(const ImagenInfo* origen, ImagenInfo* destino) {
+    size_t stride;
+    unsigned char* pixeles = crearBufferPixeles(origen->ancho, origen->alto, origen->canales, &stride);
+    if (!pixeles) return 0;
+    // El origen puede tener otro stride (imágenes cargadas o mapeadas)
+    for (int y = 0; y < origen->alto; y++) {
+        memcpy(FILA(pixeles, stride, y), FILA(origen->pixeles, origen->stride, y),
+               (size_t)origen->ancho * origen->canales);
     }
-    info->canales = (canales == 1 || canales == 3) ? canales : 1;
+    reemplazarPixeles(destino, pixeles, stride, origen->ancho, origen->alto, origen->canales);
+    return 1;
+}
 
-    // Asignar memoria para matriz 3D
-    info->pixeles = (unsigned char***)malloc(info->alto * sizeof(unsigned char**));
-    if (!info->pixeles) {
-        fprintf(stderr, "Error de memoria al asignar filas\n");
-        stbi_image_free(datos);
+// ---- Formatos sin compresión: nativo (.imgn) y PNM ----
+
+// El formato nativo sirve para pasar imágenes entre etapas sin codificar: una
+// cabecera con las dimensiones y el stride y, a partir de DESPLAZAMIENTO_NATIVO
+// (alineado a página), las filas tal como están en memoria. Se carga con mmap
+// privado, así que leerlo no cuesta nada y escribir en él solo copia las
+// páginas tocadas. PGM/PPM binarios (P5/P6) se leen y escriben sin pasar por stb.
+
+#define MAGIA_NATIVO "IMGN"
+#define VERSION_NATIVO 1
+#define DESPLAZAMIENTO_NATIVO 4096
+
+typedef struct {
+    char magia[4];
+    uint32_t version;
+    uint32_t ancho;
+    uint32_t alto;
+    uint32_t canales;
+    uint32_t reservado;
+    uint64_t stride;
+    uint64_t desplazamiento;  // Inicio de los píxeles desde el principio del archivo
+} CabeceraNativa;
+
+typedef enum {
+    FORMATO_PNG,
+    FORMATO_NATIVO,
+    FORMATO_PNM
+} FormatoImagen;
+
+// Formato de salida según la extensión (PNG si no se reconoce)
+FormatoImagen formatoPorExtension(const char* ruta) {
+    const char* punto = strrchr(ruta, '.');
+    if (!punto || strchr(punto, '/')) return FORMATO_PNG;
+    if (strcasecmp(punto, ".imgn") == 0) return FORMATO_NATIVO;
+    if (strcasecmp(punto, ".pgm") == 0 || strcasecmp(punto, ".ppm") == 0 ||
+        strcasecmp(punto, ".pnm") == 0) return FORMATO_PNM;
+    return FORMATO_PNG;
+}
+
+// Cabecera nativa rellena hasta DESPLAZAMIENTO_NATIVO
+static int escribirCabeceraNativa(FILE* f, int ancho, int alto, int canales, size_t stride) {
+    unsigned char cabecera[DESPLAZAMIENTO_NATIVO] = {0};
+    CabeceraNativa c;
+    memcpy(c.magia, MAGIA_NATIVO, 4);
+    c.version = VERSION_NATIVO;
+    c.ancho = (uint32_t)ancho;
+    c.alto = (uint32_t)alto;
+    c.canales = (uint32_t)canales;
+    c.reservado = 0;
+    c.stride = stride;
+    c.desplazamiento = DESPLAZAMIENTO_NATIVO;
+    memcpy(cabecera, &c, sizeof(c));
+    return fwrite(cabecera, 1, sizeof(cabecera), f) == sizeof(cabecera);
+}
+
+// Cabecera válida para un archivo de tamArchivo bytes (sin calcular stride * alto,
+// que con una cabecera manipulada puede desbordar)
+static int cabeceraNativaValida(const CabeceraNativa* c, uint64_t tamArchivo) {
+    return c->version == VERSION_NATIVO && (c->canales == 1 || c->canales == 3) &&
+           c->ancho > 0 && c->alto > 0 && c->ancho <= 0x7fffffff / c->canales && c->alto <= 0x7fffffff &&
+           c->stride >= (uint64_t)c->ancho * c->canales && c->desplazamiento % ALINEACION_PIXELES == 0 &&
+           c->desplazamiento <= tamArchivo && c->stride <= (tamArchivo - c->desplazamiento) / c->alto;
+}
+
+static int escribirCabeceraPNM(FILE* f, int ancho, int alto, int canales) {
+    return fprintf(f, "P%c\n%d %d\n255\n", canales == 1 ? '5' : '6', ancho, alto) > 0;
+}
+
+// Abre un temporal junto a ruta (en el mismo directorio, para poder renombrarlo)
+static FILE* abrirTemporal(const char* ruta, char* temporal, size_t tam) {
+    static unsigned int contador = 0;
+    unsigned int n = __atomic_fetch_add(&contador, 1, __ATOMIC_RELAXED);
+    int largo = snprintf(temporal, tam, "%s.%d.%u.tmp", ruta, (int)getpid(), n);
+    if (largo < 0 || (size_t)largo >= tam) return NULL;
+    return fopen(temporal, "wb");
+}
+
+// La entrada nativa puede estar mapeada del mismo archivo (-i x.imgn -o x.imgn):
+// truncarlo invalidaría el mapeo, así que se escribe a un temporal que luego
+// sustituye a ruta; el mapeo sigue viendo el archivo anterior.
+int guardarNativo(const ImagenInfo* info, const char* ruta) {
+    char temporal[4096];
+    FILE* f = abrirTemporal(ruta, temporal, sizeof(temporal));
+    if (!f) return 0;
+    size_t bytes = info->stride * (size_t)info->alto;
+    int ok = escribirCabeceraNativa(f, info->ancho, info->alto, info->canales, info->stride) &&
+             fwrite(info->pixeles, 1, bytes, f) == bytes;
+    ok = (fclose(f) == 0) && ok;
+    ok = ok && rename(temporal, ruta) == 0;
+    if (!ok) unlink(temporal);
+    return ok;
+}
+
+int guardarPNM(const ImagenInfo* info, const char* ruta) {
+    FILE* f = fopen(ruta, "wb");
+    if (!f) return 0;
+    size_t bytesFila = (size_t)info->ancho * info->canales;
+    int ok = escribirCabeceraPNM(f, info->ancho, info->alto, info->canales);
+    if (info->stride == bytesFila) {
+        ok = ok && fwrite(info->pixeles, 1, bytesFila * info->alto, f) == bytesFila * info->alto;
+    } else {
+        for (int y = 0; y < info->alto && ok; y++) {
+            ok = fwrite(FILA(info->pixeles, info->stride, y), 1, bytesFila, f) == bytesFila;
+        }
+    }
+    return (fclose(f) == 0) && ok;
+}
+
+// Carga un archivo nativo; 1 = cargado, 0 = error, -1 = no es formato nativo
+static int cargarNativo(const char* ruta, ImagenInfo* info) {
+    int fd = open(ruta, O_RDONLY);
+    if (fd < 0) return -1;
+    CabeceraNativa c;
+    struct stat st;
+    if (pread(fd, &c, sizeof(c), 0) != (ssize_t)sizeof(c) || memcmp(c.magia, MAGIA_NATIVO, 4) != 0) {
+        close(fd);
+        return -1;
+    }
+    size_t bytesDatos = (size_t)c.stride * c.alto;
+    if (fstat(fd, &st) != 0 || !cabeceraNativaValida(&c, (uint64_t)st.st_size)) {
+        fprintf(stderr, "Archivo nativo inválido: %s\n", ruta);
+        close(fd);
         return 0;
     }
-    for (int y = 0; y < info->alto; y++) {
-        info->pixeles[y] = (unsigned char**)malloc(info->ancho * sizeof(unsigned char*));
-        if (!info->pixeles[y]) {
-            fprintf(stderr, "Error de memoria al asignar columnas\n");
-            liberarImagen(info);
-            stbi_image_free(datos);
+    
+    size_t largo = (size_t)(c.desplazamiento + bytesDatos);
+    void* base = mmap(NULL, largo, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+    unsigned char* pixeles = NULL;
+    if (base != MAP_FAILED) {
+        pixeles = (unsigned char*)base + c.desplazamiento;
+        if (!registrarBufferAjeno(pixeles, base, largo)) {
+            munmap(base, largo);
+            pixeles = NULL;
+        }
+    }
+    if (!pixeles) {
+        // Sin mmap (o sin memoria para anotarlo): lectura a un buffer del pool
+        pixeles = obtenerBuffer(bytesDatos);
+        if (!pixeles || pread(fd, pixeles, bytesDatos, (off_t)c.desplazamiento) != (ssize_t)bytesDatos) {
+            fprintf(stderr, "Error al leer: %s\n", ruta);
+            devolverBuffer(pixeles, bytesDatos);
+            close(fd);
             return 0;
         }
-        for (int x = 0; x < info->ancho; x++) {
-            info->pixeles[y][x] = (unsigned char*)malloc(info->canales * sizeof(unsigned char));
-            if (!info->pixeles[y][x]) {
-                fprintf(stderr, "Error de memoria al asignar canales\n");
-                liberarImagen(info);
-                stbi_image_free(datos);
-                return 0;
-            }
-            // Copiar píxeles a matriz 3D
-            for (int c = 0; c < info->canales; c++) {
-                info->pixeles[y][x][c] = datos[(y * info->ancho + x) * info->canales + c];
-            }
+    }
+    close(fd);
+    reemplazarPixeles(info, pixeles, (size_t)c.stride, (int)c.ancho, (int)c.alto, (int)c.canales);
+    return 1;
+}
+
+// Lee un entero de la cabecera PNM saltando espacios y comentarios
+static int leerEnteroPNM(FILE* f, int* valor) {
+    int ch = fgetc(f);
+    while (ch == '#' || ch == ' ' || ch == '\t' || ch == '\n' || ch == '\r') {
+        if (ch == '#') {
+            while (ch != '\n' && ch != EOF) ch = fgetc(f);
+        }
+        ch = fgetc(f);
+    }
+    if (ch < '0' || ch > '9') return 0;
+    long v = 0;
+    while (ch >= '0' && ch <= '9') {
+        v = v * 10 + (ch - '0');
+        if (v > 0x7fffffff) return 0;
+        ch = fgetc(f);
+    }
+    *valor = (int)v; // El espacio tras el último número (antes de los píxeles) ya se consumió
+    return 1;
+}
+
+// Lee la cabecera P5/P6 de 8 bits y deja f en el primer píxel; 0 si es otro formato
+static int leerCabeceraPNM(FILE* f, int* ancho, int* alto, int* canales) {
+    char magia[2];
+    int maximo;
+    if (fread(magia, 1, 2, f) != 2 || magia[0] != 'P' || (magia[1] != '5' && magia[1] != '6') ||
+        !leerEnteroPNM(f, ancho) || !leerEnteroPNM(f, alto) || !leerEnteroPNM(f, &maximo) ||
+        maximo != 255 || *ancho <= 0 || *alto <= 0 || *ancho > 0x7fffffff / 3) {
+        return 0;
+    }
+    *canales = (magia[1] == '5') ? 1 : 3;
+    return 1;
+}
+
+// Carga P5/P6 de 8 bits; 1 = cargado, 0 = error, -1 = otro formato (lo lee stb)
+static int cargarPNM(const char* ruta, ImagenInfo* info) {
+    FILE* f = fopen(ruta, "rb");
+    if (!f) return -1;
+    int ancho, alto, canales;
+    if (!leerCabeceraPNM(f, &ancho, &alto, &canales)) {
+        fclose(f);
+        return -1;
+    }
+    size_t bytesFila = (size_t)ancho * canales;
+    size_t stride;
+    unsigned char* pixeles = crearBufferPixeles(ancho, alto, canales, &stride);
+    int ok = pixeles != NULL;
+    for (int y = 0; y < alto && ok; y++) {
+        ok = fread(FILA(pixeles, stride, y), 1, bytesFila, f) == bytesFila;
+    }
+    fclose(f);
+    if (!ok) {
+        fprintf(stderr, "Archivo PNM incompleto: %s\n", ruta);
+        devolverBuffer(pixeles, stride * (size_t)alto);
+        return 0;
+    }
+    reemplazarPixeles(info, pixeles, stride, ancho, alto, canales);
+    return 1;
+}
+
+int cargarImagen(const char* ruta, ImagenInfo* info) {
+    // Formatos sin compresión primero (se reconocen por el contenido, no por la extensión)
+    int cargado = cargarNativo(ruta, info);
+    if (cargado < 0) cargado = cargarPNM(ruta, info);
+    if (cargado >= 0) {
+        if (cargado) {
+            INFORMAR("Imagen cargada: %dx%d, %d canales (%s)\n", info->ancho, info->alto,
+                   info->canales, info->canales == 1 ? "grises" : "RGB");
         }
+        return cargado;
+    }
+    
+    int ancho, alto, canalesArchivo;
+    if (!stbi_info(ruta, &ancho, &alto, &canalesArchivo)) {
+        fprintf(stderr, "Error al cargar imagen: %s\n", ruta);
+        return 0;
+    }
+    // Grises+alfa se reduce a grises y RGBA a RGB; stb hace la conversión
+    int canales = (canalesArchivo <= 2) ? 1 : 3;
+    unsigned char* datos = stbi_load(ruta, &ancho, &alto, &canalesArchivo, canales);
+    if (!datos) {
+        fprintf(stderr, "Error al cargar imagen: %s\n", ruta);
+        return 0;
     }
 
-    stbi_image_free(datos);
-    printf("Imagen cargada: %dx%d, %d canales (%s)\n", info->ancho, info->alto,
+    // El buffer del decodificador (filas contiguas) pasa a ser el de la imagen sin
+    // copiarlo; devolverBuffer se lo devuelve a stb en lugar de guardarlo en el pool
+    if (!registrarBufferAjeno(datos, datos, 0)) {
+        fprintf(stderr, "Error de memoria al cargar imagen: %s\n", ruta);
+        stbi_image_free(datos);
+        return 0;
+    }
+    reemplazarPixeles(info, datos, (size_t)ancho * canales, ancho, alto, canales);
+    INFORMAR("Imagen cargada: %dx%d, %d canales (%s)\n", info->ancho, info->alto,
            info->canales, info->canales == 1 ? "grises" : "RGB");
     return 1;
 }
@@ -89,717 +652,5264 @@ void mostrarMatriz(const ImagenInfo* info) {
     }
     printf("Matriz de la imagen (primeras 10 filas):\n");
     for (int y = 0; y < info->alto && y < 10; y++) {
+        const unsigned char* fila = FILA(info->pixeles, info->stride, y);
         for (int x = 0; x < info->ancho; x++) {
+            const unsigned char* p = fila + x * info->canales;
             if (info->canales == 1) {
-                printf("%3u ", info->pixeles[y][x][0]);
+                printf("%3u ", p[0]);
             } else {
-                printf("(%u,%u,%u) ", info->pixeles[y][x][0], 
-                       info->pixeles[y][x][1], info->pixeles[y][x][2]);
+                printf("(%u,%u,%u) ", p[0], p[1], p[2]);
             }
         }
         printf("\n");
     }
 }
 
-int guardarPNG(const ImagenInfo* info, const char* rutaSalida) {
-    if (!info->pixeles) {
-        fprintf(stderr, "No hay imagen para guardar.\n");
-        return 0;
+// ==================== POOL DE HILOS ====================
+
+// Un único pool de hilos persistente para todo el proceso. Las operaciones
+// envían un rango de filas [0, total) que se reparte en bloques; el hilo que
+// envía el trabajo también procesa bloques, de modo que un trabajo enviado
+// desde dentro del pool (anidado) nunca se queda esperando sin avanzar.
+
+typedef void (*FuncionRango)(void* args, int inicio, int fin);
+
+typedef struct Trabajo {
+    FuncionRango funcion;
+    void* args;
+    int total;
+    int bloque;          // Filas por bloque
+    int siguiente;       // Primera fila aún sin repartir
+    int pendientes;      // Bloques repartidos o por repartir que no han terminado
+    struct Trabajo* sig;
+    MedicionOperacion* medicion; // La del hilo que envía el trabajo, o NULL
+    double envio;        // Con medición: instante del envío
+    int despachado;      // Con medición: algún trabajador ya tomó un bloque
+} Trabajo;
+
+typedef struct {
+    pthread_t hilos[MAX_HILOS];
+    int numHilos;        // Hilos que participan, incluido el que envía el trabajo
+    int iniciado;
+    int cerrando;
+    Trabajo* cola;       // Trabajos con bloques sin repartir
+    pthread_mutex_t mutex;
+    pthread_cond_t hayTrabajo;
+    pthread_cond_t trabajoTerminado;
+} PoolHilos;
+
+// Si está activo en un hilo, sus trabajos se ejecutan enteros en ese hilo
+// (el modo lote reparte imágenes completas y no filas de imágenes pequeñas)
+static __thread int ejecucionEnSerie = 0;
+
+static PoolHilos pool = {
+    .mutex = PTHREAD_MUTEX_INITIALIZER,
+    .hayTrabajo = PTHREAD_COND_INITIALIZER,
+    .trabajoTerminado = PTHREAD_COND_INITIALIZER,
+};
+
+// Ejecuta un bloque anotando el tiempo de núcleo del hilo si el trabajo se mide
+static void ejecutarBloque(FuncionRango funcion, void* args, int inicio, int fin, MedicionOperacion* m) {
+    if (!m) {
+        funcion(args, inicio, fin);
+        return;
     }
+    double t0 = segundosMonotonicos();
+    enBloqueMedido = 1;
+    funcion(args, inicio, fin);
+    enBloqueMedido = 0;
+    m->nucleo[indiceHilo] += segundosMonotonicos() - t0;
+    m->bloques[indiceHilo]++;
+}
 
-    // Aplanar matriz 3D a 1D para stb
-    unsigned char* datos1D = (unsigned char*)malloc(info->ancho * info->alto * info->canales);
-    if (!datos1D) {
-        fprintf(stderr, "Error de memoria al aplanar imagen\n");
-        return 0;
+// Toma el siguiente bloque de t (con el mutex tomado); lo saca de la cola al agotarse
+static void tomarBloque(Trabajo* t, int* inicio, int* fin) {
+    *inicio = t->siguiente;
+    *fin = (t->total - t->siguiente > t->bloque) ? t->siguiente + t->bloque : t->total;
+    t->siguiente = *fin;
+    if (t->siguiente >= t->total) {
+        Trabajo** p = &pool.cola;
+        while (*p && *p != t) p = &(*p)->sig;
+        if (*p) *p = t->sig;
     }
-    for (int y = 0; y < info->alto; y++) {
-        for (int x = 0; x < info->ancho; x++) {
-            for (int c = 0; c < info->canales; c++) {
-                datos1D[(y * info->ancho + x) * info->canales + c] = info->pixeles[y][x][c];
-            }
+}
+
+static void* trabajadorPool(void* arg) {
+    indiceHilo = (int)(intptr_t)arg;
+    pthread_mutex_lock(&pool.mutex);
+    while (1) {
+        while (!pool.cerrando && !pool.cola) {
+            pthread_cond_wait(&pool.hayTrabajo, &pool.mutex);
         }
-    }
+        if (!pool.cola) break; // Cerrando y sin trabajo pendiente
 
-    int resultado = stbi_write_png(rutaSalida, info->ancho, info->alto, info->canales,
-                                   datos1D, info->ancho * info->canales);
-    free(datos1D);
-    if (resultado) {
-        printf("Imagen guardada en: %s (%s)\n", rutaSalida,
-               info->canales == 1 ? "grises" : "RGB");
-        return 1;
-    } else {
-        fprintf(stderr, "Error al guardar PNG: %s\n", rutaSalida);
-        return 0;
+        Trabajo* t = pool.cola;
+        int inicio, fin;
+        tomarBloque(t, &inicio, &fin);
+        if (t->medicion && !t->despachado) {
+            t->despachado = 1;
+            t->medicion->despacho += segundosMonotonicos() - t->envio;
+        }
+        pthread_mutex_unlock(&pool.mutex);
+
+        ejecutarBloque(t->funcion, t->args, inicio, fin, t->medicion);
+
+        pthread_mutex_lock(&pool.mutex);
+        if (--t->pendientes == 0) {
+            pthread_cond_broadcast(&pool.trabajoTerminado);
+        }
     }
+    pthread_mutex_unlock(&pool.mutex);
+    return NULL;
 }
 
-// Estructura para datos de hilos de brillo
-typedef struct {
-    unsigned char*** pixeles;
-    int inicio;
-    int fin;
-    int ancho;
-    int canales;
-    int delta;
-} BrilloArgs;
+// Número de hilos por defecto: CPUs en línea, o la variable de entorno IMG_HILOS
+int hilosPorDefecto() {
+    const char* env = getenv("IMG_HILOS");
+    if (env && atoi(env) > 0) return atoi(env);
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    return (cpus > 0) ? (int)cpus : 1;
+}
 
-void* ajustarBrilloHilo(void* args) {
-    BrilloArgs* bArgs = (BrilloArgs*)args;
-    for (int y = bArgs->inicio; y < bArgs->fin; y++) {
-        for (int x = 0; x < bArgs->ancho; x++) {
-            for (int c = 0; c < bArgs->canales; c++) {
-                int nuevo = bArgs->pixeles[y][x][c] + bArgs->delta;
-                bArgs->pixeles[y][x][c] = (nuevo < 0) ? 0 : (nuevo > 255) ? 255 : nuevo;
-            }
+void destruirPool() {
+    if (!pool.iniciado) return;
+    pthread_mutex_lock(&pool.mutex);
+    pool.cerrando = 1;
+    pthread_cond_broadcast(&pool.hayTrabajo);
+    pthread_mutex_unlock(&pool.mutex);
+    for (int i = 0; i < pool.numHilos - 1; i++) {
+        pthread_join(pool.hilos[i], NULL);
+    }
+    pool.iniciado = 0;
+    pool.cerrando = 0;
+}
+
+// Crea el pool con numHilos participantes (numHilos - 1 trabajadores más el llamador)
+void inicializarPool(int numHilos) {
+    destruirPool();
+    if (numHilos < 1) numHilos = 1;
+    if (numHilos > MAX_HILOS) numHilos = MAX_HILOS;
+    pool.numHilos = 1;
+    for (int i = 0; i < numHilos - 1; i++) {
+        if (pthread_create(&pool.hilos[i], NULL, trabajadorPool, (void*)(intptr_t)(i + 1)) != 0) {
+            fprintf(stderr, "No se pudo crear el hilo %d del pool; se usarán %d\n", i + 1, pool.numHilos);
+            break;
         }
+        pool.numHilos++;
     }
-    return NULL;
+    pool.iniciado = 1;
 }
 
-void ajustarBrilloConcurrente(ImagenInfo* info, int delta) {
-    if (!info->pixeles) {
-        printf("No hay imagen cargada.\n");
+int hilosPool() {
+    if (!pool.iniciado) inicializarPool(hilosPorDefecto());
+    return pool.numHilos;
+}
+
+// Como ejecutarEnPool, pero los hilos toman bloques de `bloque` unidades cada
+// vez (0 = automático). Con bloques pequeños el reparto es dinámico: cada hilo
+// que termina toma la siguiente unidad libre, aunque su coste sea desigual.
+void ejecutarEnPoolPorBloques(FuncionRango funcion, void* args, int total, int bloque) {
+    if (total <= 0) return;
+    int numHilos = hilosPool();
+    // Enviado desde un bloque medido: su tiempo ya cuenta en el del bloque
+    MedicionOperacion* m = enBloqueMedido ? NULL : medicionActual;
+    if (m) m->trabajos++;
+    if (numHilos == 1 || ejecucionEnSerie) {
+        ejecutarBloque(funcion, args, 0, total, m);
         return;
     }
 
-    const int numHilos = 2;
-    pthread_t hilos[numHilos];
-    BrilloArgs args[numHilos];
-
-    int filasPorHilo = info->alto / numHilos;
-    for (int i = 0; i < numHilos; i++) {
-        args[i].pixeles = info->pixeles;
-        args[i].inicio = i * filasPorHilo;
-        args[i].fin = (i == numHilos - 1) ? info->alto : (i + 1) * filasPorHilo;
-        args[i].ancho = info->ancho;
-        args[i].canales = info->canales;
-        args[i].delta = delta;
-        pthread_create(&hilos[i], NULL, ajustarBrilloHilo, &args[i]);
+    // Por defecto varios bloques por hilo para repartir mejor filas de coste desigual
+    Trabajo t = {funcion, args, total, 0, 0, 0, NULL, m, 0, 0};
+    t.bloque = (bloque > 0) ? bloque : (total + numHilos * 4 - 1) / (numHilos * 4);
+    t.pendientes = (total + t.bloque - 1) / t.bloque;
+    if (m) {
+        int disponibles = (t.pendientes < numHilos) ? t.pendientes : numHilos;
+        if (disponibles > m->hilosDisponibles) m->hilosDisponibles = disponibles;
+        t.envio = segundosMonotonicos();
     }
 
-    for (int i = 0; i < numHilos; i++) {
-        pthread_join(hilos[i], NULL);
+    pthread_mutex_lock(&pool.mutex);
+    Trabajo** p = &pool.cola;
+    while (*p) p = &(*p)->sig;
+    *p = &t;
+    pthread_cond_broadcast(&pool.hayTrabajo);
+
+    // El llamador procesa bloques de su propio trabajo mientras queden
+    while (t.siguiente < t.total) {
+        int inicio, fin;
+        tomarBloque(&t, &inicio, &fin);
+        pthread_mutex_unlock(&pool.mutex);
+        ejecutarBloque(funcion, args, inicio, fin, m);
+        pthread_mutex_lock(&pool.mutex);
+        t.pendientes--;
+    }
+    double finPropio = m ? segundosMonotonicos() : 0;
+    while (t.pendientes > 0) {
+        pthread_cond_wait(&pool.trabajoTerminado, &pool.mutex);
     }
+    pthread_mutex_unlock(&pool.mutex);
+    if (m) m->espera += segundosMonotonicos() - finPropio;
+}
 
-    printf("Brillo ajustado concurrentemente con %d hilos (delta: %+d) en imagen %s.\n", 
-           numHilos, delta, info->canales == 1 ? "grises" : "RGB");
+// Ejecuta funcion(args, inicio, fin) sobre [0, total) usando todos los hilos del pool
+void ejecutarEnPool(FuncionRango funcion, void* args, int total) {
+    ejecutarEnPoolPorBloques(funcion, args, total, 0);
 }
 
-// ==================== FUNCIÓN 1: CONVOLUCIÓN ====================
+// ==================== ESCRITURA PNG PARALELA ====================
+
+// La imagen se divide en franjas horizontales que se filtran y comprimen en
+// paralelo, como pigz. Cada franja es un trozo de deflate independiente que
+// termina con un bloque almacenado vacío (sync flush) para quedar alineado a
+// byte, salvo la última, que lleva BFINAL. Las franjas van en chunks IDAT
+// consecutivos (cada hilo calcula el CRC del suyo) y el adler32 del flujo se
+// obtiene combinando el de cada franja. El compresor es el de stb_image_write
+// con el bit final y el cierre adaptados.
+
+#define BYTES_MINIMOS_FRANJA_PNG (256 * 1024) // Datos filtrados por franja como mínimo
+#define FILAS_MUESTREO_PNG 16                  // Estrategia de muestreo: una fila probada de cada N
+
+#define NIVEL_PNG_RAPIDO 1
+#define NIVEL_PNG_NORMAL 8  // El de stb_image_write
+#define NIVEL_PNG_MAXIMO 32
+#define NIVEL_PNG_LIMITE 64
+
+// Cómo se elige el filtro de cada fila
+typedef enum {
+    FILTRO_PNG_HEURISTICO,  // Prueba los 5 filtros en cada fila (stb)
+    FILTRO_PNG_MUESTREO,    // Prueba los 5 en una fila de cada FILAS_MUESTREO_PNG y repite el elegido
+    FILTRO_PNG_FIJO         // Siempre el mismo filtro
+} EstrategiaFiltroPNG;
 
-// Estructura para datos de hilos de convolución
 typedef struct {
-    unsigned char*** pixelesOrigen;
-    unsigned char*** pixelesDestino;
-    float** kernel;
-    int tamKernel;
-    int ancho;
-    int alto;
-    int canales;
-    int inicio;
-    int fin;
-} ConvolucionArgs;
+    int nivel;                       // Longitud de las cadenas de búsqueda; 0 = sin comprimir
+    EstrategiaFiltroPNG estrategia;
+    int filtroFijo;                  // 0 ninguno, 1 sub, 2 up, 3 media, 4 paeth
+} OpcionesPNG;
 
-float** generarKernelGaussiano(int tam, float sigma) {
-    float** kernel = (float**)malloc(tam * sizeof(float*));
-    if (!kernel) return NULL;
+static OpcionesPNG opcionesPNG = {NIVEL_PNG_NORMAL, FILTRO_PNG_HEURISTICO, 0};
 
-    for (int i = 0; i < tam; i++) {
-        kernel[i] = (float*)malloc(tam * sizeof(float));
-        if (!kernel[i]) {
-            for (int j = 0; j < i; j++) free(kernel[j]);
-            free(kernel);
-            return NULL;
-        }
+static const char* nombresFiltroPNG[5] = {"ninguno", "sub", "up", "media", "paeth"};
+static const char* aliasFiltroPNG[5] = {"none", "sub", "up", "average", "paeth"};
+
+// rapido|normal|max (fast|default|max): nivel y estrategia de filtro juntos
+int fijarPresetPNG(const char* nombre) {
+    if (strcmp(nombre, "rapido") == 0 || strcmp(nombre, "fast") == 0) {
+        opcionesPNG.nivel = NIVEL_PNG_RAPIDO;
+        opcionesPNG.estrategia = FILTRO_PNG_FIJO;
+        opcionesPNG.filtroFijo = 1;
+    } else if (strcmp(nombre, "normal") == 0 || strcmp(nombre, "default") == 0) {
+        opcionesPNG.nivel = NIVEL_PNG_NORMAL;
+        opcionesPNG.estrategia = FILTRO_PNG_HEURISTICO;
+    } else if (strcmp(nombre, "max") == 0) {
+        opcionesPNG.nivel = NIVEL_PNG_MAXIMO;
+        opcionesPNG.estrategia = FILTRO_PNG_HEURISTICO;
+    } else {
+        return 0;
     }
+    return 1;
+}
 
-    float suma = 0.0;
-    int centro = tam / 2;
-    
-    for (int y = 0; y < tam; y++) {
-        for (int x = 0; x < tam; x++) {
-            float dx = x - centro;
-            float dy = y - centro;
-            kernel[y][x] = exp(-(dx*dx + dy*dy) / (2.0 * sigma * sigma));
-            suma += kernel[y][x];
+// heuristico|muestreo o el nombre de un filtro concreto
+int fijarFiltroPNG(const char* nombre) {
+    if (strcmp(nombre, "heuristico") == 0 || strcmp(nombre, "heuristic") == 0) {
+        opcionesPNG.estrategia = FILTRO_PNG_HEURISTICO;
+        return 1;
+    }
+    if (strcmp(nombre, "muestreo") == 0 || strcmp(nombre, "sampled") == 0) {
+        opcionesPNG.estrategia = FILTRO_PNG_MUESTREO;
+        return 1;
+    }
+    for (int f = 0; f < 5; f++) {
+        if (strcmp(nombre, nombresFiltroPNG[f]) == 0 || strcmp(nombre, aliasFiltroPNG[f]) == 0) {
+            opcionesPNG.estrategia = FILTRO_PNG_FIJO;
+            opcionesPNG.filtroFijo = f;
+            return 1;
         }
     }
+    return 0;
+}
 
-    // Normalizar
-    for (int y = 0; y < tam; y++) {
-        for (int x = 0; x < tam; x++) {
-            kernel[y][x] /= suma;
-        }
+int fijarNivelPNG(int nivel) {
+    if (nivel < 0 || nivel > NIVEL_PNG_LIMITE) return 0;
+    opcionesPNG.nivel = nivel;
+    return 1;
+}
+
+#define BASE_ADLER 65521u
+
+typedef struct {
+    unsigned char* datos;    // Chunk IDAT completo: longitud, "IDAT", contenido y CRC
+    int tam;
+    unsigned int adler;      // adler32 de los datos filtrados de la franja
+    int bytesFiltrados;
+} FranjaPNG;
+
+typedef struct {
+    const ImagenInfo* info;
+    FranjaPNG* franjas;
+    int filasPorFranja;
+    int numFranjas;
+} EscrituraPNGArgs;
+
+static unsigned int adler32Bytes(const unsigned char* datos, int n) {
+    unsigned int s1 = 1, s2 = 0;
+    while (n > 0) {
+        int bloque = (n < 5552) ? n : 5552;
+        for (int i = 0; i < bloque; i++) { s1 += datos[i]; s2 += s1; }
+        s1 %= BASE_ADLER; s2 %= BASE_ADLER;
+        datos += bloque;
+        n -= bloque;
     }
+    return (s2 << 16) | s1;
+}
 
-    return kernel;
+// adler32 de A seguido de B a partir de los de A y B (y la longitud de B)
+static unsigned int combinarAdler32(unsigned int adlerA, unsigned int adlerB, unsigned int longitudB) {
+    unsigned int resto = longitudB % BASE_ADLER;
+    unsigned int suma1 = adlerA & 0xffff;
+    unsigned int suma2 = (unsigned int)(((unsigned long long)resto * suma1) % BASE_ADLER);
+    suma1 += (adlerB & 0xffff) + BASE_ADLER - 1;
+    suma2 += (adlerA >> 16) + (adlerB >> 16) + BASE_ADLER - resto;
+    if (suma1 >= BASE_ADLER) suma1 -= BASE_ADLER;
+    if (suma1 >= BASE_ADLER) suma1 -= BASE_ADLER;
+    if (suma2 >= 2 * BASE_ADLER) suma2 -= 2 * BASE_ADLER;
+    if (suma2 >= BASE_ADLER) suma2 -= BASE_ADLER;
+    return (suma2 << 16) | suma1;
 }
 
-void* convolucionHilo(void* args) {
-    ConvolucionArgs* cArgs = (ConvolucionArgs*)args;
-    int offset = cArgs->tamKernel / 2;
+// Sustituye el contenido de out por bloques almacenados (sin comprimir) con data
+static unsigned char* bloquesAlmacenados(unsigned char* out, unsigned char* data, int data_len, int ultima) {
+    int j = 0;
+    if (out) stbiw__sbn(out) = 0;
+    do {
+        int blocklen = data_len - j;
+        if (blocklen > 32767) blocklen = 32767;
+        stbiw__sbpush(out, ultima && data_len - j == blocklen);
+        stbiw__sbpush(out, STBIW_UCHAR(blocklen));
+        stbiw__sbpush(out, STBIW_UCHAR(blocklen >> 8));
+        stbiw__sbpush(out, STBIW_UCHAR(~blocklen));
+        stbiw__sbpush(out, STBIW_UCHAR(~blocklen >> 8));
+        stbiw__sbmaybegrow(out, blocklen);
+        memcpy(out + stbiw__sbn(out), data + j, blocklen);
+        stbiw__sbn(out) += blocklen;
+        j += blocklen;
+    } while (j < data_len);
+    return out;
+}
+
+// Comprime data como uno o varios bloques deflate sin cabecera zlib. Si no es
+// la última franja, el resultado termina en un sync flush en lugar de BFINAL.
+// quality es el nivel de OpcionesPNG: con 0 solo se copian los datos.
+// Devuelve un buffer de stb (stretchy) o NULL si no hay memoria.
+static unsigned char* deflateFranja(unsigned char* data, int data_len, int ultima, int quality) {
+    static unsigned short lengthc[] = { 3,4,5,6,7,8,9,10,11,13,15,17,19,23,27,31,35,43,51,59,67,83,99,115,131,163,195,227,258, 259 };
+    static unsigned char  lengtheb[]= { 0,0,0,0,0,0,0, 0, 1, 1, 1, 1, 2, 2, 2, 2, 3, 3, 3, 3, 4, 4, 4,  4,  5,  5,  5,  5,  0 };
+    static unsigned short distc[]   = { 1,2,3,4,5,7,9,13,17,25,33,49,65,97,129,193,257,385,513,769,1025,1537,2049,3073,4097,6145,8193,12289,16385,24577, 32768 };
+    static unsigned char  disteb[]  = { 0,0,0,0,1,1,2,2,3,3,4,4,5,5,6,6,7,7,8,8,9,9,10,10,11,11,12,12,13,13 };
+    unsigned int bitbuf = 0;
+    int i, j, bitcount = 0;
+    unsigned char* out = NULL;
+    if (quality <= 0) return bloquesAlmacenados(NULL, data, data_len, ultima);
+    unsigned char*** hash_table = (unsigned char***)STBIW_MALLOC(stbiw__ZHASH * sizeof(unsigned char**));
+    if (hash_table == NULL) return NULL;
     
-    for (int y = cArgs->inicio; y < cArgs->fin; y++) {
-        for (int x = 0; x < cArgs->ancho; x++) {
-            for (int c = 0; c < cArgs->canales; c++) {
-                float suma = 0.0;
-                
-                for (int ky = 0; ky < cArgs->tamKernel; ky++) {
-                    for (int kx = 0; kx < cArgs->tamKernel; kx++) {
-                        int py = y + ky - offset;
-                        int px = x + kx - offset;
-                        
-                        // Manejar bordes (clamp)
-                        py = (py < 0) ? 0 : (py >= cArgs->alto) ? cArgs->alto - 1 : py;
-                        px = (px < 0) ? 0 : (px >= cArgs->ancho) ? cArgs->ancho - 1 : px;
-                        
-                        suma += cArgs->pixelesOrigen[py][px][c] * cArgs->kernel[ky][kx];
-                    }
+    stbiw__zlib_add(ultima ? 1 : 0, 1); // BFINAL
+    stbiw__zlib_add(1, 2);              // BTYPE = 1 -- huffman fijo
+    
+    for (i = 0; i < stbiw__ZHASH; ++i) hash_table[i] = NULL;
+    
+    i = 0;
+    while (i < data_len - 3) {
+        int h = stbiw__zhash(data + i) & (stbiw__ZHASH - 1), best = 3;
+        unsigned char* bestloc = 0;
+        unsigned char** hlist = hash_table[h];
+        int n = stbiw__sbcount(hlist);
+        for (j = 0; j < n; ++j) {
+            if (hlist[j] - data > i - 32768) {
+                int d = stbiw__zlib_countm(hlist[j], data + i, data_len - i);
+                if (d >= best) { best = d; bestloc = hlist[j]; }
+            }
+        }
+        if (hash_table[h] && stbiw__sbn(hash_table[h]) == 2 * quality) {
+            STBIW_MEMMOVE(hash_table[h], hash_table[h] + quality, sizeof(hash_table[h][0]) * quality);
+            stbiw__sbn(hash_table[h]) = quality;
+        }
+        stbiw__sbpush(hash_table[h], data + i);
+        
+        // Emparejamiento perezoso (mirar si en i+1 hay algo mejor) solo desde el nivel 4, como zlib
+        if (bestloc && quality >= 4) {
+            h = stbiw__zhash(data + i + 1) & (stbiw__ZHASH - 1);
+            hlist = hash_table[h];
+            n = stbiw__sbcount(hlist);
+            for (j = 0; j < n; ++j) {
+                if (hlist[j] - data > i - 32767) {
+                    int e = stbiw__zlib_countm(hlist[j], data + i + 1, data_len - i - 1);
+                    if (e > best) { bestloc = NULL; break; }
                 }
-                
-                int resultado = (int)(suma + 0.5);
-                cArgs->pixelesDestino[y][x][c] = (resultado < 0) ? 0 : (resultado > 255) ? 255 : resultado;
             }
         }
+        
+        if (bestloc) {
+            int d = (int)(data + i - bestloc);
+            for (j = 0; best > lengthc[j + 1] - 1; ++j);
+            stbiw__zlib_huff(j + 257);
+            if (lengtheb[j]) stbiw__zlib_add(best - lengthc[j], lengtheb[j]);
+            for (j = 0; d > distc[j + 1] - 1; ++j);
+            stbiw__zlib_add(stbiw__zlib_bitrev(j, 5), 5);
+            if (disteb[j]) stbiw__zlib_add(d - distc[j], disteb[j]);
+            i += best;
+        } else {
+            stbiw__zlib_huffb(data[i]);
+            ++i;
+        }
     }
-    return NULL;
-}
-
-void aplicarConvolucionConcurrente(ImagenInfo* info, int tamKernel, float sigma) {
-    if (!info->pixeles) {
-        printf("No hay imagen cargada.\n");
+    for (; i < data_len; ++i) stbiw__zlib_huffb(data[i]);
+    stbiw__zlib_huff(256); // Fin de bloque
+    if (!ultima) {
+        stbiw__zlib_add(0, 3); // Bloque almacenado vacío: BFINAL = 0, BTYPE = 0
+    }
+    while (bitcount) stbiw__zlib_add(0, 1);
+    if (!ultima) {
+        stbiw__sbpush(out, 0x00); stbiw__sbpush(out, 0x00); // LEN = 0
+        stbiw__sbpush(out, 0xff); stbiw__sbpush(out, 0xff); // NLEN
+    }
+    
+    for (i = 0; i < stbiw__ZHASH; ++i) (void)stbiw__sbfree(hash_table[i]);
+    STBIW_FREE(hash_table);
+    
+    // Si comprimido ocupa más, bloques almacenados (ya quedan alineados a byte)
+    if (stbiw__sbn(out) > data_len + ((data_len + 32766) / 32767) * 5) {
+        out = bloquesAlmacenados(out, data, data_len, ultima);
+    }
+    return out;
+}
+
+// Filtra las filas [y0, y1) de pixeles (la fila y0 - 1, si y0 > 0, sirve de fila
+// anterior para los filtros), las comprime y deja en franja su chunk IDAT.
+// La primera franja lleva la cabecera zlib y la última el bloque final.
+static void codificarFranjaPNG(unsigned char* pixeles, size_t stride, int ancho, int canales,
+                               int y0, int y1, int primera, int ultima, FranjaPNG* franja) {
+    int bytesFila = ancho * canales;
+    int n = (y1 - y0) * (bytesFila + 1);
+    unsigned char* filtrado = (unsigned char*)malloc(n);
+    signed char* linea = (signed char*)malloc(bytesFila);
+    franja->datos = NULL;
+    if (!filtrado || !linea) {
+        free(filtrado);
+        free(linea);
+        return;
+    }
+    
+    // Heurística de stb: el filtro con menor suma de valores absolutos. Con
+    // muestreo solo se evalúa en algunas filas y las demás repiten el elegido.
+    int mejorFiltro = opcionesPNG.filtroFijo;
+    for (int y = y0; y < y1; y++) {
+        unsigned char* destino = filtrado + (size_t)(y - y0) * (bytesFila + 1);
+        int probar = opcionesPNG.estrategia == FILTRO_PNG_HEURISTICO ||
+                     (opcionesPNG.estrategia == FILTRO_PNG_MUESTREO && (y - y0) % FILAS_MUESTREO_PNG == 0);
+        if (!probar) {
+            stbiw__encode_png_line(pixeles, (int)stride, ancho, y1, y, canales, mejorFiltro,
+                                   (signed char*)destino + 1);
+            destino[0] = (unsigned char)mejorFiltro;
+            continue;
+        }
+        int mejorEstimacion = 0x7fffffff;
+        for (int filtro = 0; filtro < 5; filtro++) {
+            stbiw__encode_png_line(pixeles, (int)stride, ancho, y1, y, canales, filtro, linea);
+            int estimacion = 0;
+            for (int i = 0; i < bytesFila; i++) estimacion += abs(linea[i]);
+            if (estimacion < mejorEstimacion) {
+                mejorEstimacion = estimacion;
+                mejorFiltro = filtro;
+            }
+        }
+        stbiw__encode_png_line(pixeles, (int)stride, ancho, y1, y, canales, mejorFiltro, linea);
+        destino[0] = (unsigned char)mejorFiltro;
+        memcpy(destino + 1, linea, bytesFila);
+    }
+    free(linea);
+    
+    franja->adler = adler32Bytes(filtrado, n);
+    franja->bytesFiltrados = n;
+    unsigned char* comprimido = deflateFranja(filtrado, n, ultima, opcionesPNG.nivel);
+    free(filtrado);
+    if (!comprimido) return;
+    
+    // Chunk IDAT; la primera franja lleva además la cabecera zlib
+    int cabecera = primera ? 2 : 0;
+    int tamContenido = cabecera + stbiw__sbn(comprimido);
+    franja->tam = 12 + tamContenido;
+    franja->datos = (unsigned char*)malloc(franja->tam);
+    if (franja->datos) {
+        unsigned char* o = franja->datos;
+        stbiw__wp32(o, tamContenido);
+        stbiw__wptag(o, "IDAT");
+        if (cabecera) {
+            *o++ = 0x78; // Ventana de 32K
+            *o++ = 0x5e; // FLEVEL = 1
+        }
+        memcpy(o, comprimido, stbiw__sbn(comprimido));
+        o += stbiw__sbn(comprimido);
+        stbiw__wpcrc(&o, tamContenido);
+    }
+    stbiw__sbfree(comprimido);
+}
+
+// Filtra y comprime franjas completas
+void escrituraPNGHilo(void* args, int inicio, int fin) {
+    EscrituraPNGArgs* eArgs = (EscrituraPNGArgs*)args;
+    const ImagenInfo* info = eArgs->info;
+    for (int f = inicio; f < fin; f++) {
+        int y0 = f * eArgs->filasPorFranja;
+        int y1 = (y0 + eArgs->filasPorFranja < info->alto) ? y0 + eArgs->filasPorFranja : info->alto;
+        codificarFranjaPNG(info->pixeles, info->stride, info->ancho, info->canales, y0, y1,
+                           f == 0, f == eArgs->numFranjas - 1, &eArgs->franjas[f]);
+    }
+}
+
+// Escribe un chunk pequeño (cabecera, adler32 o fin) calculando su CRC
+static int escribirChunkPNG(FILE* f, const char* tipo, const unsigned char* contenido, int tam) {
+    unsigned char chunk[64];
+    unsigned char* o = chunk;
+    stbiw__wp32(o, tam);
+    stbiw__wptag(o, tipo);
+    if (tam > 0) memcpy(o, contenido, tam);
+    o += tam;
+    stbiw__wpcrc(&o, tam);
+    return fwrite(chunk, 1, o - chunk, f) == (size_t)(o - chunk);
+}
+
+// Firma y cabecera IHDR
+static int escribirCabeceraPNG(FILE* f, int ancho, int alto, int canales) {
+    static const unsigned char firma[8] = {137, 80, 78, 71, 13, 10, 26, 10};
+    static const unsigned char tipoColor[5] = {0, 0, 4, 2, 6};
+    unsigned char cabecera[13];
+    unsigned char* o = cabecera;
+    stbiw__wp32(o, ancho);
+    stbiw__wp32(o, alto);
+    *o++ = 8;                              // Bits por muestra
+    *o++ = tipoColor[canales];             // Grises, grises+alfa, RGB o RGBA
+    *o++ = 0; *o++ = 0; *o++ = 0;          // Compresión, filtro, entrelazado
+    return fwrite(firma, 1, 8, f) == 8 && escribirChunkPNG(f, "IHDR", cabecera, 13);
+}
+
+// adler32 del flujo zlib en su propio IDAT y el chunk final
+static int escribirFinPNG(FILE* f, unsigned int adler) {
+    unsigned char finZlib[4];
+    unsigned char* o = finZlib;
+    stbiw__wp32(o, adler);
+    return escribirChunkPNG(f, "IDAT", finZlib, 4) && escribirChunkPNG(f, "IEND", NULL, 0);
+}
+
+int escribirPNGParalelo(const ImagenInfo* info, const char* ruta) {
+    int bytesFila = info->ancho * info->canales;
+    size_t bytesTotales = (size_t)(bytesFila + 1) * info->alto;
+    
+    // Franjas de al menos BYTES_MINIMOS_FRANJA_PNG, y no menos de una fila
+    EscrituraPNGArgs args;
+    args.info = info;
+    args.filasPorFranja = (int)(BYTES_MINIMOS_FRANJA_PNG / (bytesFila + 1)) + 1;
+    args.numFranjas = (int)((info->alto + args.filasPorFranja - 1) / args.filasPorFranja);
+    if (bytesTotales > (size_t)0x7fffffff) return 0; // Límite de enteros de stb
+    args.franjas = (FranjaPNG*)calloc(args.numFranjas, sizeof(FranjaPNG));
+    if (!args.franjas) return 0;
+    ejecutarEnPoolPorBloques(escrituraPNGHilo, &args, args.numFranjas, 1);
+    
+    int ok = 1;
+    unsigned int adler = 1;
+    for (int f = 0; f < args.numFranjas; f++) {
+        ok = ok && args.franjas[f].datos != NULL;
+        adler = combinarAdler32(adler, args.franjas[f].adler, args.franjas[f].bytesFiltrados);
+    }
+    
+    FILE* salida = ok ? fopen(ruta, "wb") : NULL;
+    if (salida) {
+        ok = escribirCabeceraPNG(salida, info->ancho, info->alto, info->canales);
+        for (int f = 0; f < args.numFranjas && ok; f++) {
+            ok = fwrite(args.franjas[f].datos, 1, args.franjas[f].tam, salida) == (size_t)args.franjas[f].tam;
+        }
+        ok = ok && escribirFinPNG(salida, adler);
+        ok = (fclose(salida) == 0) && ok;
+    } else {
+        ok = 0;
+    }
+    
+    for (int f = 0; f < args.numFranjas; f++) free(args.franjas[f].datos);
+    free(args.franjas);
+    return ok;
+}
+
+int guardarPNG(const ImagenInfo* info, const char* rutaSalida) {
+    if (!info->pixeles) {
+        fprintf(stderr, "No hay imagen para guardar.\n");
+        return 0;
+    }
+
+    if (escribirPNGParalelo(info, rutaSalida)) {
+        INFORMAR("Imagen guardada en: %s (%s)\n", rutaSalida,
+               info->canales == 1 ? "grises" : "RGB");
+        return 1;
+    } else {
+        fprintf(stderr, "Error al guardar PNG: %s\n", rutaSalida);
+        return 0;
+    }
+}
+
+// Guarda en el formato que indique la extensión: .imgn (nativo), .pgm/.ppm/.pnm o PNG
+int guardarImagen(const ImagenInfo* info, const char* rutaSalida) {
+    FormatoImagen formato = formatoPorExtension(rutaSalida);
+    if (formato == FORMATO_PNG) return guardarPNG(info, rutaSalida);
+    if (!info->pixeles) {
+        fprintf(stderr, "No hay imagen para guardar.\n");
+        return 0;
+    }
+    int ok = (formato == FORMATO_NATIVO) ? guardarNativo(info, rutaSalida) : guardarPNM(info, rutaSalida);
+    if (ok) {
+        INFORMAR("Imagen guardada en: %s (%s)\n", rutaSalida, info->canales == 1 ? "grises" : "RGB");
+    } else {
+        fprintf(stderr, "Error al guardar: %s\n", rutaSalida);
+    }
+    return ok;
+}
+
+// ==================== FUNCIONES DE FILA (ESCALAR Y SIMD) ====================
+
+// Los núcleos internos trabajan sobre una fila a la vez. Cada uno tiene una
+// versión escalar de referencia y, en x86, versiones SSE2 (16 bytes) y AVX2
+// (32 bytes). La tabla simd se elige al arrancar según cpuid y se puede forzar
+// con IMG_SIMD=escalar|sse2|avx2. Las versiones SIMD dan exactamente el mismo
+// resultado que las escalares (ver autopruebaSIMD).
+
+typedef struct {
+    const char* nombre;
+    void (*brilloFila)(unsigned char* fila, int n, int delta);
+    void (*convolucionFilaH)(const unsigned char* fila, float* salida, int ancho, int canales,
+                             const float* kernel, int tamKernel);
+    void (*convolucionFilaV)(const float* const* filas, unsigned char* salida, int n,
+                             const float* kernel, int tamKernel);
+    void (*convolucionFijaH)(const unsigned char* fila, short* salida, int ancho, int canales,
+                             const short* pesos, int tamKernel);
+    void (*convolucionFijaV)(const short* const* filas, unsigned char* salida, int n,
+                             const short* pesos, int tamKernel);
+    void (*sobelFila)(const unsigned char* g0, const unsigned char* g1, const unsigned char* g2,
+                      unsigned char* salida, unsigned char* direccion, int ancho);
+    void (*lutFila)(unsigned char* fila, int n, const unsigned char* lut);
+} FuncionesFila;
+
+void brilloFilaEscalar(unsigned char* fila, int n, int delta) {
+    for (int i = 0; i < n; i++) {
+        int nuevo = fila[i] + delta;
+        fila[i] = (nuevo < 0) ? 0 : (nuevo > 255) ? 255 : nuevo;
+    }
+}
+
+// ---- Bordes ----
+
+// Las operaciones de vecindad separan cada fila en un interior, donde ningún
+// tap sale de la imagen y el índice es directo, y dos bandas de radio píxeles
+// (y, en vertical, las primeras y últimas filas) que resuelven cada tap con
+// indiceBorde según el modo elegido con --modo-borde.
+
+typedef enum {
+    BORDE_REPLICAR,          // aaa|abcd|ddd
+    BORDE_REFLEJAR,          // cb|abcd|cb (espejo sin repetir el borde)
+    BORDE_ENVOLVER,          // cd|abcd|ab
+    BORDE_CONSTANTE          // kk|abcd|kk
+} ModoBorde;
+
+typedef struct {
+    ModoBorde modo;
+    unsigned char constante;
+} OpcionesBorde;
+
+static OpcionesBorde opcionesBorde = {BORDE_REPLICAR, 0};
+
+// replicar, reflejar, envolver o constante[:V] (y sus nombres en inglés); 0 si no es válido
+int fijarModoBorde(const char* texto) {
+    static const struct { const char* nombre; const char* alias; ModoBorde modo; } modos[] = {
+        {"replicar", "replicate", BORDE_REPLICAR},
+        {"reflejar", "reflect", BORDE_REFLEJAR},
+        {"envolver", "wrap", BORDE_ENVOLVER},
+        {"constante", "constant", BORDE_CONSTANTE},
+    };
+    for (int i = 0; i < 4; i++) {
+        size_t largo = strlen(modos[i].nombre), largoAlias = strlen(modos[i].alias);
+        const char* resto = NULL;
+        if (strncmp(texto, modos[i].nombre, largo) == 0) resto = texto + largo;
+        else if (strncmp(texto, modos[i].alias, largoAlias) == 0) resto = texto + largoAlias;
+        if (!resto) continue;
+        int valor = 0, usados = 0;
+        if (*resto == ':' && modos[i].modo == BORDE_CONSTANTE) {
+            if (sscanf(resto + 1, "%d%n", &valor, &usados) != 1 || resto[1 + usados] != '\0' ||
+                valor < 0 || valor > 255) {
+                return 0;
+            }
+        } else if (*resto != '\0') {
+            continue;
+        }
+        opcionesBorde.modo = modos[i].modo;
+        opcionesBorde.constante = (unsigned char)valor;
+        return 1;
+    }
+    return 0;
+}
+
+// Índice en [0, n) que corresponde a la posición i, o -1 si cae en el borde constante
+static inline int indiceBorde(int i, int n) {
+    if (i >= 0 && i < n) return i;
+    switch (opcionesBorde.modo) {
+        case BORDE_REPLICAR:
+            return (i < 0) ? 0 : n - 1;
+        case BORDE_REFLEJAR: {
+            if (n == 1) return 0;
+            int periodo = 2 * (n - 1);
+            i %= periodo;
+            if (i < 0) i += periodo;
+            return (i < n) ? i : periodo - i;
+        }
+        case BORDE_ENVOLVER:
+            i %= n;
+            return (i < 0) ? i + n : i;
+        case BORDE_CONSTANTE:
+            return -1;
+    }
+    return 0;
+}
+
+// Muestra c del píxel x de una fila, resolviendo el borde
+static inline int muestraBorde(const unsigned char* fila, int x, int ancho, int canales, int c) {
+    int px = indiceBorde(x, ancho);
+    return (px < 0) ? opcionesBorde.constante : fila[px * canales + c];
+}
+
+// Fila y de una ventana vertical sobre alto filas separadas paso bytes, o la fila constante
+static inline const unsigned char* filaBorde(const unsigned char* base, size_t paso, int y, int alto,
+                                             const unsigned char* constante) {
+    int py = indiceBorde(y, alto);
+    return (py < 0) ? constante : base + py * paso;
+}
+
+// Fila de ancho bytes con el valor del borde constante (NULL con los demás modos);
+// *ok = 0 si no hay memoria
+static unsigned char* crearFilaConstante(size_t ancho, int* ok) {
+    if (opcionesBorde.modo != BORDE_CONSTANTE) return NULL;
+    unsigned char* fila = (unsigned char*)malloc(ancho);
+    if (fila) memset(fila, opcionesBorde.constante, ancho);
+    else *ok = 0;
+    return fila;
+}
+
+// Filtra horizontalmente los píxeles [x0, x1) de una fila de píxeles intercalados
+static void convolucionFilaHRango(const unsigned char* fila, float* salida, int ancho, int canales,
+                                  const float* kernel, int tamKernel, int x0, int x1) {
+    int offset = tamKernel / 2;
+    for (int x = x0; x < x1; x++) {
+        for (int c = 0; c < canales; c++) {
+            float suma = 0.0;
+            for (int k = 0; k < tamKernel; k++) {
+                suma += muestraBorde(fila, x + k - offset, ancho, canales, c) * kernel[k];
+            }
+            salida[x * canales + c] = suma;
+        }
+    }
+}
+
+// Muestras [i0, i1) del interior, donde ningún tap sale de la fila
+static void convolucionFilaHInterior(const unsigned char* fila, float* salida, int canales,
+                                     const float* kernel, int tamKernel, int i0, int i1) {
+    const unsigned char* base = fila - (tamKernel / 2) * canales;
+    for (int i = i0; i < i1; i++) {
+        float suma = 0.0;
+        for (int k = 0; k < tamKernel; k++) {
+            suma += base[i + k * canales] * kernel[k];
+        }
+        salida[i] = suma;
+    }
+}
+
+void convolucionFilaHEscalar(const unsigned char* fila, float* salida, int ancho, int canales,
+                             const float* kernel, int tamKernel) {
+    int offset = tamKernel / 2;
+    if (ancho <= 2 * offset) {
+        convolucionFilaHRango(fila, salida, ancho, canales, kernel, tamKernel, 0, ancho);
+        return;
+    }
+    convolucionFilaHRango(fila, salida, ancho, canales, kernel, tamKernel, 0, offset);
+    convolucionFilaHInterior(fila, salida, canales, kernel, tamKernel, offset * canales, (ancho - offset) * canales);
+    convolucionFilaHRango(fila, salida, ancho, canales, kernel, tamKernel, ancho - offset, ancho);
+}
+
+// Combina tamKernel filas intermedias consecutivas (ya con bordes resueltos)
+void convolucionFilaVEscalar(const float* const* filas, unsigned char* salida, int n,
+                             const float* kernel, int tamKernel) {
+    for (int i = 0; i < n; i++) {
+        float suma = 0.0;
+        for (int k = 0; k < tamKernel; k++) {
+            suma += filas[k][i] * kernel[k];
+        }
+        int resultado = (int)(suma + 0.5);
+        salida[i] = (resultado < 0) ? 0 : (resultado > 255) ? 255 : resultado;
+    }
+}
+
+// ---- Convolución en punto fijo ----
+
+// Pesos enteros de 16 bits que suman 2^14 en las dos pasadas. La horizontal
+// acumula en int32 (pmaddwd en SIMD) y redondea a BITS_INTERMEDIO_FIJO bits
+// fraccionarios, así la fila intermedia (255 * 2^7 como máximo) cabe en int16;
+// la vertical vuelve a acumular en int32. Los tamaños 3, 5 y 7
+// se especializan: en la versión escalar DEFINIR_CONVOLUCION_FIJA genera los
+// bucles desenrollados y en las SIMD ESPECIALIZAR_TAM instancia la función
+// en línea con el tamaño constante.
+
+#define BITS_FIJO_H 14
+#define BITS_FIJO_V 14
+#define BITS_INTERMEDIO_FIJO 7
+#define DESPLAZAMIENTO_H_FIJO (BITS_FIJO_H - BITS_INTERMEDIO_FIJO)
+#define REDONDEO_H_FIJO (1 << (DESPLAZAMIENTO_H_FIJO - 1))
+#define DESPLAZAMIENTO_FIJO (BITS_INTERMEDIO_FIJO + BITS_FIJO_V)
+#define REDONDEO_FIJO (1 << (DESPLAZAMIENTO_FIJO - 1))
+
+#define ESPECIALIZAR_TAM(tam, LLAMADA)       \
+    switch (tam) {                           \
+        case 3:  LLAMADA(3); break;          \
+        case 5:  LLAMADA(5); break;          \
+        case 7:  LLAMADA(7); break;          \
+        default: LLAMADA(tam); break;        \
+    }
+
+// Píxeles [x0, x1), resolviendo los bordes
+static void convolucionFijaHRango(const unsigned char* fila, short* salida, int ancho, int canales,
+                                  const short* pesos, int tam, int x0, int x1) {
+    int offset = tam / 2;
+    for (int x = x0; x < x1; x++) {
+        for (int c = 0; c < canales; c++) {
+            int suma = REDONDEO_H_FIJO;
+            for (int k = 0; k < tam; k++) suma += muestraBorde(fila, x + k - offset, ancho, canales, c) * pesos[k];
+            salida[x * canales + c] = (short)(suma >> DESPLAZAMIENTO_H_FIJO);
+        }
+    }
+}
+
+// Muestras [i0, i1) del interior
+static void convolucionFijaHInterior(const unsigned char* fila, short* salida, int canales,
+                                     const short* pesos, int tam, int i0, int i1) {
+    const unsigned char* base = fila - (tam / 2) * canales;
+    for (int i = i0; i < i1; i++) {
+        int suma = REDONDEO_H_FIJO;
+        for (int k = 0; k < tam; k++) suma += base[i + k * canales] * pesos[k];
+        salida[i] = (short)(suma >> DESPLAZAMIENTO_H_FIJO);
+    }
+}
+
+void convolucionFijaHGenerica(const unsigned char* fila, short* salida, int ancho, int canales,
+                              const short* pesos, int tam) {
+    int offset = tam / 2;
+    if (ancho <= 2 * offset) {
+        convolucionFijaHRango(fila, salida, ancho, canales, pesos, tam, 0, ancho);
+        return;
+    }
+    convolucionFijaHRango(fila, salida, ancho, canales, pesos, tam, 0, offset);
+    convolucionFijaHInterior(fila, salida, canales, pesos, tam, offset * canales, (ancho - offset) * canales);
+    convolucionFijaHRango(fila, salida, ancho, canales, pesos, tam, ancho - offset, ancho);
+}
+
+// Satura a 0..255 como packus en las versiones SIMD
+static inline unsigned char saturarFijo(int suma) {
+    int valor = suma >> DESPLAZAMIENTO_FIJO;
+    return (valor < 0) ? 0 : (valor > 255) ? 255 : valor;
+}
+
+void convolucionFijaVGenerica(const short* const* filas, unsigned char* salida, int n,
+                              const short* pesos, int tam) {
+    for (int i = 0; i < n; i++) {
+        int suma = REDONDEO_FIJO;
+        for (int k = 0; k < tam; k++) suma += filas[k][i] * pesos[k];
+        salida[i] = saturarFijo(suma);
+    }
+}
+
+// Versiones escalares desenrolladas: pesos y punteros a filas en variables
+// locales para no recargarlos en cada muestra
+#define TAPS_3(T) (T(0) + T(1) + T(2))
+#define TAPS_5(T) (TAPS_3(T) + T(3) + T(4))
+#define TAPS_7(T) (TAPS_5(T) + T(5) + T(6))
+#define TAP_FIJO_H(k) base[i + (k) * canales] * w[k]
+#define TAP_FIJO_V(k) f[k][i] * w[k]
+
+#define DEFINIR_CONVOLUCION_FIJA(TAM)                                                           \
+static void convolucionFijaH##TAM(const unsigned char* fila, short* salida, int ancho, int canales, \
+                                  const short* pesos) {                                         \
+    if (ancho <= TAM - 1) {                                                                     \
+        convolucionFijaHRango(fila, salida, ancho, canales, pesos, TAM, 0, ancho);              \
+        return;                                                                                 \
+    }                                                                                           \
+    int w[TAM];                                                                                 \
+    for (int k = 0; k < TAM; k++) w[k] = pesos[k];                                              \
+    convolucionFijaHRango(fila, salida, ancho, canales, pesos, TAM, 0, TAM / 2);                \
+    const unsigned char* base = fila - (TAM / 2) * canales;                                     \
+    int fin = (ancho - TAM / 2) * canales;                                                      \
+    for (int i = (TAM / 2) * canales; i < fin; i++) {                                           \
+        salida[i] = (short)((TAPS_##TAM(TAP_FIJO_H) + REDONDEO_H_FIJO) >> DESPLAZAMIENTO_H_FIJO); \
+    }                                                                                           \
+    convolucionFijaHRango(fila, salida, ancho, canales, pesos, TAM, ancho - TAM / 2, ancho);    \
+}                                                                                               \
+static void convolucionFijaV##TAM(const short* const* filas, unsigned char* salida, int n,     \
+                                  const short* pesos) {                                         \
+    int w[TAM];                                                                                 \
+    const short* f[TAM];                                                                        \
+    for (int k = 0; k < TAM; k++) {                                                             \
+        w[k] = pesos[k];                                                                        \
+        f[k] = filas[k];                                                                        \
+    }                                                                                           \
+    for (int i = 0; i < n; i++) {                                                               \
+        salida[i] = saturarFijo(TAPS_##TAM(TAP_FIJO_V) + REDONDEO_FIJO);                          \
+    }                                                                                           \
+}
+
+DEFINIR_CONVOLUCION_FIJA(3)
+DEFINIR_CONVOLUCION_FIJA(5)
+DEFINIR_CONVOLUCION_FIJA(7)
+
+void convolucionFijaHEscalar(const unsigned char* fila, short* salida, int ancho, int canales,
+                             const short* pesos, int tam) {
+    switch (tam) {
+        case 3:  convolucionFijaH3(fila, salida, ancho, canales, pesos); break;
+        case 5:  convolucionFijaH5(fila, salida, ancho, canales, pesos); break;
+        case 7:  convolucionFijaH7(fila, salida, ancho, canales, pesos); break;
+        default: convolucionFijaHGenerica(fila, salida, ancho, canales, pesos, tam); break;
+    }
+}
+
+void convolucionFijaVEscalar(const short* const* filas, unsigned char* salida, int n,
+                             const short* pesos, int tam) {
+    switch (tam) {
+        case 3:  convolucionFijaV3(filas, salida, n, pesos); break;
+        case 5:  convolucionFijaV5(filas, salida, n, pesos); break;
+        case 7:  convolucionFijaV7(filas, salida, n, pesos); break;
+        default: convolucionFijaVGenerica(filas, salida, n, pesos, tam); break;
+    }
+}
+
+// ---- Sobel ----
+
+// gx y gy se calculan en enteros (|g| <= 1020, caben en int16). La magnitud es
+// la exacta, sqrt(gx² + gy²) truncada, o con --sobel-magnitud aprox la
+// aproximación entera max + 3/8 min de |gx| y |gy| (error < 7%, sin raíz).
+// Con --sobel-direccion se calcula además la dirección del gradiente
+// cuantificada a cuatro sectores, la que necesita la supresión de no máximos:
+// cada valor indica con qué dos vecinos comparar el píxel.
+
+#define DIRECCION_0   0   // Gradiente horizontal: vecinos (x-1, y) y (x+1, y)
+#define DIRECCION_45  85  // gx y gy del mismo signo: (x-1, y-1) y (x+1, y+1)
+#define DIRECCION_90  170 // Gradiente vertical: (x, y-1) y (x, y+1)
+#define DIRECCION_135 255 // Signos opuestos: (x+1, y-1) y (x-1, y+1)
+
+// tan(22.5°) ~ 12/29 y tan(67.5°) ~ 29/12; los productos caben en int16
+#define SECTOR_NUM 12
+#define SECTOR_DEN 29
+
+typedef enum {
+    MAGNITUD_EXACTA,
+    MAGNITUD_APROX
+} MagnitudSobel;
+
+typedef struct {
+    MagnitudSobel magnitud;
+    const char* rutaDireccion; // NULL: no se guarda la dirección
+} OpcionesSobel;
+
+static OpcionesSobel opcionesSobel = {MAGNITUD_EXACTA, NULL};
+
+static inline unsigned char magnitudSobel(int gx, int gy) {
+    int magnitud;
+    if (opcionesSobel.magnitud == MAGNITUD_APROX) {
+        int ax = abs(gx), ay = abs(gy);
+        int mayor = (ax > ay) ? ax : ay, menor = (ax > ay) ? ay : ax;
+        magnitud = mayor + ((3 * menor) >> 3);
+    } else {
+        magnitud = (int)sqrt(gx*gx + gy*gy);
+    }
+    return (magnitud > 255) ? 255 : magnitud;
+}
+
+static inline unsigned char direccionSobel(int gx, int gy) {
+    int ax = abs(gx), ay = abs(gy);
+    if (ay * SECTOR_DEN <= ax * SECTOR_NUM) return DIRECCION_0;
+    if (ay * SECTOR_NUM >= ax * SECTOR_DEN) return DIRECCION_90;
+    return ((gx ^ gy) >= 0) ? DIRECCION_45 : DIRECCION_135;
+}
+
+// Magnitud (y dirección, si no es NULL) de los píxeles [x0, x1) a partir de tres filas en grises
+static void sobelFilaRango(const unsigned char* g0, const unsigned char* g1, const unsigned char* g2,
+                           unsigned char* salida, unsigned char* direccion, int ancho, int x0, int x1) {
+    for (int x = x0; x < x1; x++) {
+        int a0 = muestraBorde(g0, x - 1, ancho, 1, 0), c0 = muestraBorde(g0, x + 1, ancho, 1, 0);
+        int a1 = muestraBorde(g1, x - 1, ancho, 1, 0), c1 = muestraBorde(g1, x + 1, ancho, 1, 0);
+        int a2 = muestraBorde(g2, x - 1, ancho, 1, 0), c2 = muestraBorde(g2, x + 1, ancho, 1, 0);
+        int gx = (c0 + 2 * c1 + c2) - (a0 + 2 * a1 + a2);
+        int gy = (a2 + 2 * g2[x] + c2) - (a0 + 2 * g0[x] + c0);
+        salida[x] = magnitudSobel(gx, gy);
+        if (direccion) direccion[x] = direccionSobel(gx, gy);
+    }
+}
+
+void sobelFilaEscalar(const unsigned char* g0, const unsigned char* g1, const unsigned char* g2,
+                      unsigned char* salida, unsigned char* direccion, int ancho) {
+    if (ancho < 3) {
+        sobelFilaRango(g0, g1, g2, salida, direccion, ancho, 0, ancho);
+        return;
+    }
+    sobelFilaRango(g0, g1, g2, salida, direccion, ancho, 0, 1);
+    for (int x = 1; x < ancho - 1; x++) {
+        int gx = (g0[x + 1] + 2 * g1[x + 1] + g2[x + 1]) - (g0[x - 1] + 2 * g1[x - 1] + g2[x - 1]);
+        int gy = (g2[x - 1] + 2 * g2[x] + g2[x + 1]) - (g0[x - 1] + 2 * g0[x] + g0[x + 1]);
+        salida[x] = magnitudSobel(gx, gy);
+        if (direccion) direccion[x] = direccionSobel(gx, gy);
+    }
+    sobelFilaRango(g0, g1, g2, salida, direccion, ancho, ancho - 1, ancho);
+}
+
+// Aplica una tabla de 256 entradas en sitio. También es la versión SSE2: con
+// pshufb de SSSE3 harían falta 16 pasos de 16 bytes y sale ~1,7x más lento que
+// esta; solo AVX2 tiene una versión vectorial.
+void lutFilaEscalar(unsigned char* fila, int n, const unsigned char* lut) {
+    int i = 0;
+    for (; i + 4 <= n; i += 4) {
+        unsigned char a = lut[fila[i]], b = lut[fila[i + 1]];
+        unsigned char c = lut[fila[i + 2]], d = lut[fila[i + 3]];
+        fila[i] = a; fila[i + 1] = b; fila[i + 2] = c; fila[i + 3] = d;
+    }
+    for (; i < n; i++) fila[i] = lut[fila[i]];
+}
+
+#ifdef IMG_X86
+
+// ---- SSE2 ----
+
+void brilloFilaSSE2(unsigned char* fila, int n, int delta) {
+    int magnitud = (delta < 0) ? -delta : delta;
+    __m128i d = _mm_set1_epi8((char)(magnitud > 255 ? 255 : magnitud));
+    int i = 0;
+    for (; i + 16 <= n; i += 16) {
+        __m128i v = _mm_loadu_si128((const __m128i*)(fila + i));
+        v = (delta >= 0) ? _mm_adds_epu8(v, d) : _mm_subs_epu8(v, d);
+        _mm_storeu_si128((__m128i*)(fila + i), v);
+    }
+    brilloFilaEscalar(fila + i, n - i, delta);
+}
+
+void convolucionFilaHSSE2(const unsigned char* fila, float* salida, int ancho, int canales,
+                          const float* kernel, int tamKernel) {
+    int offset = tamKernel / 2;
+    if (ancho <= 2 * offset) {
+        convolucionFilaHEscalar(fila, salida, ancho, canales, kernel, tamKernel);
+        return;
+    }
+    convolucionFilaHRango(fila, salida, ancho, canales, kernel, tamKernel, 0, offset);
+    
+    const unsigned char* base = fila - offset * canales;
+    int i = offset * canales, fin = (ancho - offset) * canales;
+    __m128i cero = _mm_setzero_si128();
+    for (; i + 16 <= fin; i += 16) {
+        __m128 a0 = _mm_setzero_ps(), a1 = a0, a2 = a0, a3 = a0;
+        for (int k = 0; k < tamKernel; k++) {
+            __m128 w = _mm_set1_ps(kernel[k]);
+            __m128i v = _mm_loadu_si128((const __m128i*)(base + i + k * canales));
+            __m128i lo = _mm_unpacklo_epi8(v, cero), hi = _mm_unpackhi_epi8(v, cero);
+            a0 = _mm_add_ps(a0, _mm_mul_ps(_mm_cvtepi32_ps(_mm_unpacklo_epi16(lo, cero)), w));
+            a1 = _mm_add_ps(a1, _mm_mul_ps(_mm_cvtepi32_ps(_mm_unpackhi_epi16(lo, cero)), w));
+            a2 = _mm_add_ps(a2, _mm_mul_ps(_mm_cvtepi32_ps(_mm_unpacklo_epi16(hi, cero)), w));
+            a3 = _mm_add_ps(a3, _mm_mul_ps(_mm_cvtepi32_ps(_mm_unpackhi_epi16(hi, cero)), w));
+        }
+        _mm_storeu_ps(salida + i, a0);
+        _mm_storeu_ps(salida + i + 4, a1);
+        _mm_storeu_ps(salida + i + 8, a2);
+        _mm_storeu_ps(salida + i + 12, a3);
+    }
+    convolucionFilaHInterior(fila, salida, canales, kernel, tamKernel, i, fin);
+    convolucionFilaHRango(fila, salida, ancho, canales, kernel, tamKernel, ancho - offset, ancho);
+}
+
+void convolucionFilaVSSE2(const float* const* filas, unsigned char* salida, int n,
+                          const float* kernel, int tamKernel) {
+    __m128 medio = _mm_set1_ps(0.5f);
+    int i = 0;
+    for (; i + 16 <= n; i += 16) {
+        __m128 a0 = _mm_setzero_ps(), a1 = a0, a2 = a0, a3 = a0;
+        for (int k = 0; k < tamKernel; k++) {
+            __m128 w = _mm_set1_ps(kernel[k]);
+            const float* f = filas[k] + i;
+            a0 = _mm_add_ps(a0, _mm_mul_ps(_mm_loadu_ps(f), w));
+            a1 = _mm_add_ps(a1, _mm_mul_ps(_mm_loadu_ps(f + 4), w));
+            a2 = _mm_add_ps(a2, _mm_mul_ps(_mm_loadu_ps(f + 8), w));
+            a3 = _mm_add_ps(a3, _mm_mul_ps(_mm_loadu_ps(f + 12), w));
+        }
+        __m128i r0 = _mm_cvttps_epi32(_mm_add_ps(a0, medio));
+        __m128i r1 = _mm_cvttps_epi32(_mm_add_ps(a1, medio));
+        __m128i r2 = _mm_cvttps_epi32(_mm_add_ps(a2, medio));
+        __m128i r3 = _mm_cvttps_epi32(_mm_add_ps(a3, medio));
+        __m128i r = _mm_packus_epi16(_mm_packs_epi32(r0, r1), _mm_packs_epi32(r2, r3));
+        _mm_storeu_si128((__m128i*)(salida + i), r);
+    }
+    const float* resto[tamKernel];
+    for (int k = 0; k < tamKernel; k++) resto[k] = filas[k] + i;
+    convolucionFilaVEscalar(resto, salida + i, n - i, kernel, tamKernel);
+}
+
+// Dos pesos consecutivos en cada palabra de 32 bits, para pmaddwd
+static inline int parPesos(const short* pesos, int k, int tam) {
+    unsigned int bajo = (unsigned short)pesos[k];
+    unsigned int alto = (k + 1 < tam) ? (unsigned short)pesos[k + 1] : 0;
+    return (int)(bajo | (alto << 16));
+}
+
+static inline __attribute__((always_inline))
+void convolucionFijaHSSE2Tam(const unsigned char* fila, short* salida, int ancho, int canales,
+                             const short* pesos, int tam) {
+    int offset = tam / 2;
+    if (ancho <= 2 * offset) {
+        convolucionFijaHRango(fila, salida, ancho, canales, pesos, tam, 0, ancho);
+        return;
+    }
+    convolucionFijaHRango(fila, salida, ancho, canales, pesos, tam, 0, offset);
+    
+    // Como en la vertical, los taps k y k + 1 se intercalan y pmaddwd los suma en int32
+    const unsigned char* base = fila - offset * canales;
+    int i = offset * canales, fin = (ancho - offset) * canales;
+    __m128i cero = _mm_setzero_si128(), redondeo = _mm_set1_epi32(REDONDEO_H_FIJO);
+    for (; i + 16 <= fin; i += 16) {
+        __m128i a0 = redondeo, a1 = redondeo, a2 = redondeo, a3 = redondeo;
+        for (int k = 0; k < tam; k += 2) {
+            __m128i w = _mm_set1_epi32(parPesos(pesos, k, tam));
+            __m128i p = _mm_loadu_si128((const __m128i*)(base + i + k * canales));
+            __m128i q = (k + 1 < tam) ? _mm_loadu_si128((const __m128i*)(base + i + (k + 1) * canales)) : cero;
+            __m128i p0 = _mm_unpacklo_epi8(p, cero), p1 = _mm_unpackhi_epi8(p, cero);
+            __m128i q0 = _mm_unpacklo_epi8(q, cero), q1 = _mm_unpackhi_epi8(q, cero);
+            a0 = _mm_add_epi32(a0, _mm_madd_epi16(_mm_unpacklo_epi16(p0, q0), w));
+            a1 = _mm_add_epi32(a1, _mm_madd_epi16(_mm_unpackhi_epi16(p0, q0), w));
+            a2 = _mm_add_epi32(a2, _mm_madd_epi16(_mm_unpacklo_epi16(p1, q1), w));
+            a3 = _mm_add_epi32(a3, _mm_madd_epi16(_mm_unpackhi_epi16(p1, q1), w));
+        }
+        _mm_storeu_si128((__m128i*)(salida + i), _mm_packs_epi32(_mm_srai_epi32(a0, DESPLAZAMIENTO_H_FIJO),
+                                                                 _mm_srai_epi32(a1, DESPLAZAMIENTO_H_FIJO)));
+        _mm_storeu_si128((__m128i*)(salida + i + 8), _mm_packs_epi32(_mm_srai_epi32(a2, DESPLAZAMIENTO_H_FIJO),
+                                                                     _mm_srai_epi32(a3, DESPLAZAMIENTO_H_FIJO)));
+    }
+    convolucionFijaHInterior(fila, salida, canales, pesos, tam, i, fin);
+    convolucionFijaHRango(fila, salida, ancho, canales, pesos, tam, ancho - offset, ancho);
+}
+
+void convolucionFijaHSSE2(const unsigned char* fila, short* salida, int ancho, int canales,
+                          const short* pesos, int tam) {
+    #define LLAMADA(T) convolucionFijaHSSE2Tam(fila, salida, ancho, canales, pesos, T)
+    ESPECIALIZAR_TAM(tam, LLAMADA)
+    #undef LLAMADA
+}
+
+static inline __attribute__((always_inline))
+void convolucionFijaVSSE2Tam(const short* const* filas, unsigned char* salida, int n,
+                             const short* pesos, int tam) {
+    __m128i redondeo = _mm_set1_epi32(REDONDEO_FIJO), cero = _mm_setzero_si128();
+    int i = 0;
+    for (; i + 16 <= n; i += 16) {
+        __m128i a0 = redondeo, a1 = redondeo, a2 = redondeo, a3 = redondeo;
+        // Las filas k y k + 1 se intercalan y pmaddwd suma f[k] * w[k] + f[k + 1] * w[k + 1]
+        for (int k = 0; k < tam; k += 2) {
+            __m128i w = _mm_set1_epi32(parPesos(pesos, k, tam));
+            __m128i p0 = _mm_loadu_si128((const __m128i*)(filas[k] + i));
+            __m128i p1 = _mm_loadu_si128((const __m128i*)(filas[k] + i + 8));
+            __m128i q0 = (k + 1 < tam) ? _mm_loadu_si128((const __m128i*)(filas[k + 1] + i)) : cero;
+            __m128i q1 = (k + 1 < tam) ? _mm_loadu_si128((const __m128i*)(filas[k + 1] + i + 8)) : cero;
+            a0 = _mm_add_epi32(a0, _mm_madd_epi16(_mm_unpacklo_epi16(p0, q0), w));
+            a1 = _mm_add_epi32(a1, _mm_madd_epi16(_mm_unpackhi_epi16(p0, q0), w));
+            a2 = _mm_add_epi32(a2, _mm_madd_epi16(_mm_unpacklo_epi16(p1, q1), w));
+            a3 = _mm_add_epi32(a3, _mm_madd_epi16(_mm_unpackhi_epi16(p1, q1), w));
+        }
+        a0 = _mm_srai_epi32(a0, DESPLAZAMIENTO_FIJO);
+        a1 = _mm_srai_epi32(a1, DESPLAZAMIENTO_FIJO);
+        a2 = _mm_srai_epi32(a2, DESPLAZAMIENTO_FIJO);
+        a3 = _mm_srai_epi32(a3, DESPLAZAMIENTO_FIJO);
+        __m128i r = _mm_packus_epi16(_mm_packs_epi32(a0, a1), _mm_packs_epi32(a2, a3));
+        _mm_storeu_si128((__m128i*)(salida + i), r);
+    }
+    const short* resto[tam];
+    for (int k = 0; k < tam; k++) resto[k] = filas[k] + i;
+    convolucionFijaVGenerica(resto, salida + i, n - i, pesos, tam);
+}
+
+void convolucionFijaVSSE2(const short* const* filas, unsigned char* salida, int n,
+                          const short* pesos, int tam) {
+    #define LLAMADA(T) convolucionFijaVSSE2Tam(filas, salida, n, pesos, T)
+    ESPECIALIZAR_TAM(tam, LLAMADA)
+    #undef LLAMADA
+}
+
+// Magnitud de 8 pares (gx, gy) en int16 según opcionesSobel (sin saturar a 255)
+static inline __m128i magnitudSobelSSE2(__m128i gx, __m128i gy) {
+    if (opcionesSobel.magnitud == MAGNITUD_APROX) {
+        __m128i cero = _mm_setzero_si128();
+        __m128i ax = _mm_max_epi16(gx, _mm_sub_epi16(cero, gx)), ay = _mm_max_epi16(gy, _mm_sub_epi16(cero, gy));
+        __m128i menor = _mm_min_epi16(ax, ay);
+        return _mm_add_epi16(_mm_max_epi16(ax, ay), _mm_srli_epi16(_mm_add_epi16(menor, _mm_slli_epi16(menor, 1)), 3));
+    }
+    __m128i lo = _mm_unpacklo_epi16(gx, gy), hi = _mm_unpackhi_epi16(gx, gy);
+    __m128i m0 = _mm_cvttps_epi32(_mm_sqrt_ps(_mm_cvtepi32_ps(_mm_madd_epi16(lo, lo))));
+    __m128i m1 = _mm_cvttps_epi32(_mm_sqrt_ps(_mm_cvtepi32_ps(_mm_madd_epi16(hi, hi))));
+    return _mm_packs_epi32(m0, m1);
+}
+
+// Sector de 8 pares (gx, gy) como direccionSobel, en int16
+static inline __m128i direccionSobelSSE2(__m128i gx, __m128i gy) {
+    __m128i cero = _mm_setzero_si128();
+    __m128i ax = _mm_max_epi16(gx, _mm_sub_epi16(cero, gx)), ay = _mm_max_epi16(gy, _mm_sub_epi16(cero, gy));
+    __m128i num = _mm_set1_epi16(SECTOR_NUM), den = _mm_set1_epi16(SECTOR_DEN);
+    __m128i noHorizontal = _mm_cmpgt_epi16(_mm_mullo_epi16(ay, den), _mm_mullo_epi16(ax, num));
+    __m128i noVertical = _mm_cmpgt_epi16(_mm_mullo_epi16(ax, den), _mm_mullo_epi16(ay, num));
+    __m128i opuestos = _mm_srai_epi16(_mm_xor_si128(gx, gy), 15);
+    __m128i diagonal = _mm_or_si128(_mm_and_si128(opuestos, _mm_set1_epi16(DIRECCION_135)),
+                                    _mm_andnot_si128(opuestos, _mm_set1_epi16(DIRECCION_45)));
+    __m128i d = _mm_or_si128(_mm_and_si128(noVertical, diagonal),
+                             _mm_andnot_si128(noVertical, _mm_set1_epi16(DIRECCION_90)));
+    return _mm_and_si128(noHorizontal, d);
+}
+
+void sobelFilaSSE2(const unsigned char* g0, const unsigned char* g1, const unsigned char* g2,
+                   unsigned char* salida, unsigned char* direccion, int ancho) {
+    if (ancho < 3) {
+        sobelFilaEscalar(g0, g1, g2, salida, direccion, ancho);
+        return;
+    }
+    sobelFilaRango(g0, g1, g2, salida, direccion, ancho, 0, 1);
+    __m128i cero = _mm_setzero_si128();
+    int x = 1;
+    for (; x + 8 < ancho; x += 8) {
+        #define CARGAR8(p) _mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i*)(p)), cero)
+        __m128i a0 = CARGAR8(g0 + x - 1), b0 = CARGAR8(g0 + x), c0 = CARGAR8(g0 + x + 1);
+        __m128i a1 = CARGAR8(g1 + x - 1), c1 = CARGAR8(g1 + x + 1);
+        __m128i a2 = CARGAR8(g2 + x - 1), b2 = CARGAR8(g2 + x), c2 = CARGAR8(g2 + x + 1);
+        #undef CARGAR8
+        __m128i gx = _mm_sub_epi16(_mm_add_epi16(_mm_add_epi16(c0, c2), _mm_slli_epi16(c1, 1)),
+                                   _mm_add_epi16(_mm_add_epi16(a0, a2), _mm_slli_epi16(a1, 1)));
+        __m128i gy = _mm_sub_epi16(_mm_add_epi16(_mm_add_epi16(a2, c2), _mm_slli_epi16(b2, 1)),
+                                   _mm_add_epi16(_mm_add_epi16(a0, c0), _mm_slli_epi16(b0, 1)));
+        __m128i m = magnitudSobelSSE2(gx, gy);
+        _mm_storel_epi64((__m128i*)(salida + x), _mm_packus_epi16(m, m));
+        if (direccion) {
+            __m128i d = direccionSobelSSE2(gx, gy);
+            _mm_storel_epi64((__m128i*)(direccion + x), _mm_packus_epi16(d, d));
+        }
+    }
+    sobelFilaRango(g0, g1, g2, salida, direccion, ancho, x, ancho);
+}
+
+// ---- AVX2 ----
+
+__attribute__((target("avx2")))
+void brilloFilaAVX2(unsigned char* fila, int n, int delta) {
+    int magnitud = (delta < 0) ? -delta : delta;
+    __m256i d = _mm256_set1_epi8((char)(magnitud > 255 ? 255 : magnitud));
+    int i = 0;
+    for (; i + 32 <= n; i += 32) {
+        __m256i v = _mm256_loadu_si256((const __m256i*)(fila + i));
+        v = (delta >= 0) ? _mm256_adds_epu8(v, d) : _mm256_subs_epu8(v, d);
+        _mm256_storeu_si256((__m256i*)(fila + i), v);
+    }
+    brilloFilaEscalar(fila + i, n - i, delta);
+}
+
+__attribute__((target("avx2")))
+void convolucionFilaHAVX2(const unsigned char* fila, float* salida, int ancho, int canales,
+                          const float* kernel, int tamKernel) {
+    int offset = tamKernel / 2;
+    if (ancho <= 2 * offset) {
+        convolucionFilaHEscalar(fila, salida, ancho, canales, kernel, tamKernel);
+        return;
+    }
+    convolucionFilaHRango(fila, salida, ancho, canales, kernel, tamKernel, 0, offset);
+    
+    const unsigned char* base = fila - offset * canales;
+    int i = offset * canales, fin = (ancho - offset) * canales;
+    for (; i + 32 <= fin; i += 32) {
+        __m256 a0 = _mm256_setzero_ps(), a1 = a0, a2 = a0, a3 = a0;
+        for (int k = 0; k < tamKernel; k++) {
+            __m256 w = _mm256_set1_ps(kernel[k]);
+            const unsigned char* p = base + i + k * canales;
+            __m256 v0 = _mm256_cvtepi32_ps(_mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i*)p)));
+            __m256 v1 = _mm256_cvtepi32_ps(_mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i*)(p + 8))));
+            __m256 v2 = _mm256_cvtepi32_ps(_mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i*)(p + 16))));
+            __m256 v3 = _mm256_cvtepi32_ps(_mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i*)(p + 24))));
+            a0 = _mm256_add_ps(a0, _mm256_mul_ps(v0, w));
+            a1 = _mm256_add_ps(a1, _mm256_mul_ps(v1, w));
+            a2 = _mm256_add_ps(a2, _mm256_mul_ps(v2, w));
+            a3 = _mm256_add_ps(a3, _mm256_mul_ps(v3, w));
+        }
+        _mm256_storeu_ps(salida + i, a0);
+        _mm256_storeu_ps(salida + i + 8, a1);
+        _mm256_storeu_ps(salida + i + 16, a2);
+        _mm256_storeu_ps(salida + i + 24, a3);
+    }
+    convolucionFilaHInterior(fila, salida, canales, kernel, tamKernel, i, fin);
+    convolucionFilaHRango(fila, salida, ancho, canales, kernel, tamKernel, ancho - offset, ancho);
+}
+
+__attribute__((target("avx2")))
+void convolucionFilaVAVX2(const float* const* filas, unsigned char* salida, int n,
+                          const float* kernel, int tamKernel) {
+    __m256 medio = _mm256_set1_ps(0.5f);
+    int i = 0;
+    for (; i + 32 <= n; i += 32) {
+        __m256 a0 = _mm256_setzero_ps(), a1 = a0, a2 = a0, a3 = a0;
+        for (int k = 0; k < tamKernel; k++) {
+            __m256 w = _mm256_set1_ps(kernel[k]);
+            const float* f = filas[k] + i;
+            a0 = _mm256_add_ps(a0, _mm256_mul_ps(_mm256_loadu_ps(f), w));
+            a1 = _mm256_add_ps(a1, _mm256_mul_ps(_mm256_loadu_ps(f + 8), w));
+            a2 = _mm256_add_ps(a2, _mm256_mul_ps(_mm256_loadu_ps(f + 16), w));
+            a3 = _mm256_add_ps(a3, _mm256_mul_ps(_mm256_loadu_ps(f + 24), w));
+        }
+        __m256i r0 = _mm256_cvttps_epi32(_mm256_add_ps(a0, medio));
+        __m256i r1 = _mm256_cvttps_epi32(_mm256_add_ps(a1, medio));
+        __m256i r2 = _mm256_cvttps_epi32(_mm256_add_ps(a2, medio));
+        __m256i r3 = _mm256_cvttps_epi32(_mm256_add_ps(a3, medio));
+        // Los empaquetados trabajan por carriles de 128 bits; la permutación restaura el orden
+        __m256i r = _mm256_packus_epi16(_mm256_packs_epi32(r0, r1), _mm256_packs_epi32(r2, r3));
+        r = _mm256_permutevar8x32_epi32(r, _mm256_setr_epi32(0, 4, 1, 5, 2, 6, 3, 7));
+        _mm256_storeu_si256((__m256i*)(salida + i), r);
+    }
+    const float* resto[tamKernel];
+    for (int k = 0; k < tamKernel; k++) resto[k] = filas[k] + i;
+    convolucionFilaVEscalar(resto, salida + i, n - i, kernel, tamKernel);
+}
+
+__attribute__((target("avx2"), always_inline))
+static inline void convolucionFijaHAVX2Tam(const unsigned char* fila, short* salida, int ancho, int canales,
+                                           const short* pesos, int tam) {
+    int offset = tam / 2;
+    if (ancho <= 2 * offset) {
+        convolucionFijaHRango(fila, salida, ancho, canales, pesos, tam, 0, ancho);
+        return;
+    }
+    convolucionFijaHRango(fila, salida, ancho, canales, pesos, tam, 0, offset);
+    
+    const unsigned char* base = fila - offset * canales;
+    int i = offset * canales, fin = (ancho - offset) * canales;
+    __m256i cero = _mm256_setzero_si256(), redondeo = _mm256_set1_epi32(REDONDEO_H_FIJO);
+    for (; i + 32 <= fin; i += 32) {
+        __m256i a0 = redondeo, a1 = redondeo, a2 = redondeo, a3 = redondeo;
+        for (int k = 0; k < tam; k += 2) {
+            __m256i w = _mm256_set1_epi32(parPesos(pesos, k, tam));
+            const unsigned char* p = base + i + k * canales;
+            __m256i p0 = _mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i*)p));
+            __m256i p1 = _mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i*)(p + 16)));
+            __m256i q0 = (k + 1 < tam) ? _mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i*)(p + canales))) : cero;
+            __m256i q1 = (k + 1 < tam) ? _mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i*)(p + canales + 16))) : cero;
+            a0 = _mm256_add_epi32(a0, _mm256_madd_epi16(_mm256_unpacklo_epi16(p0, q0), w));
+            a1 = _mm256_add_epi32(a1, _mm256_madd_epi16(_mm256_unpackhi_epi16(p0, q0), w));
+            a2 = _mm256_add_epi32(a2, _mm256_madd_epi16(_mm256_unpacklo_epi16(p1, q1), w));
+            a3 = _mm256_add_epi32(a3, _mm256_madd_epi16(_mm256_unpackhi_epi16(p1, q1), w));
+        }
+        // unpack y packs trabajan dentro de cada carril, así que el orden queda natural
+        _mm256_storeu_si256((__m256i*)(salida + i), _mm256_packs_epi32(_mm256_srai_epi32(a0, DESPLAZAMIENTO_H_FIJO),
+                                                                       _mm256_srai_epi32(a1, DESPLAZAMIENTO_H_FIJO)));
+        _mm256_storeu_si256((__m256i*)(salida + i + 16), _mm256_packs_epi32(_mm256_srai_epi32(a2, DESPLAZAMIENTO_H_FIJO),
+                                                                            _mm256_srai_epi32(a3, DESPLAZAMIENTO_H_FIJO)));
+    }
+    convolucionFijaHInterior(fila, salida, canales, pesos, tam, i, fin);
+    convolucionFijaHRango(fila, salida, ancho, canales, pesos, tam, ancho - offset, ancho);
+}
+
+__attribute__((target("avx2")))
+void convolucionFijaHAVX2(const unsigned char* fila, short* salida, int ancho, int canales,
+                          const short* pesos, int tam) {
+    #define LLAMADA(T) convolucionFijaHAVX2Tam(fila, salida, ancho, canales, pesos, T)
+    ESPECIALIZAR_TAM(tam, LLAMADA)
+    #undef LLAMADA
+}
+
+__attribute__((target("avx2"), always_inline))
+static inline void convolucionFijaVAVX2Tam(const short* const* filas, unsigned char* salida, int n,
+                                           const short* pesos, int tam) {
+    __m256i redondeo = _mm256_set1_epi32(REDONDEO_FIJO), cero = _mm256_setzero_si256();
+    int i = 0;
+    for (; i + 32 <= n; i += 32) {
+        __m256i a0 = redondeo, a1 = redondeo, a2 = redondeo, a3 = redondeo;
+        for (int k = 0; k < tam; k += 2) {
+            __m256i w = _mm256_set1_epi32(parPesos(pesos, k, tam));
+            __m256i p0 = _mm256_loadu_si256((const __m256i*)(filas[k] + i));
+            __m256i p1 = _mm256_loadu_si256((const __m256i*)(filas[k] + i + 16));
+            __m256i q0 = (k + 1 < tam) ? _mm256_loadu_si256((const __m256i*)(filas[k + 1] + i)) : cero;
+            __m256i q1 = (k + 1 < tam) ? _mm256_loadu_si256((const __m256i*)(filas[k + 1] + i + 16)) : cero;
+            a0 = _mm256_add_epi32(a0, _mm256_madd_epi16(_mm256_unpacklo_epi16(p0, q0), w));
+            a1 = _mm256_add_epi32(a1, _mm256_madd_epi16(_mm256_unpackhi_epi16(p0, q0), w));
+            a2 = _mm256_add_epi32(a2, _mm256_madd_epi16(_mm256_unpacklo_epi16(p1, q1), w));
+            a3 = _mm256_add_epi32(a3, _mm256_madd_epi16(_mm256_unpackhi_epi16(p1, q1), w));
+        }
+        a0 = _mm256_srai_epi32(a0, DESPLAZAMIENTO_FIJO);
+        a1 = _mm256_srai_epi32(a1, DESPLAZAMIENTO_FIJO);
+        a2 = _mm256_srai_epi32(a2, DESPLAZAMIENTO_FIJO);
+        a3 = _mm256_srai_epi32(a3, DESPLAZAMIENTO_FIJO);
+        // unpack y packs se deshacen dentro de cada carril; queda cruzar los carriles del packus
+        __m256i r = _mm256_packus_epi16(_mm256_packs_epi32(a0, a1), _mm256_packs_epi32(a2, a3));
+        r = _mm256_permute4x64_epi64(r, 0xD8);
+        _mm256_storeu_si256((__m256i*)(salida + i), r);
+    }
+    const short* resto[tam];
+    for (int k = 0; k < tam; k++) resto[k] = filas[k] + i;
+    convolucionFijaVGenerica(resto, salida + i, n - i, pesos, tam);
+}
+
+__attribute__((target("avx2")))
+void convolucionFijaVAVX2(const short* const* filas, unsigned char* salida, int n,
+                          const short* pesos, int tam) {
+    #define LLAMADA(T) convolucionFijaVAVX2Tam(filas, salida, n, pesos, T)
+    ESPECIALIZAR_TAM(tam, LLAMADA)
+    #undef LLAMADA
+}
+
+// Magnitud de 16 pares (gx, gy) según opcionesSobel, en orden natural
+__attribute__((target("avx2")))
+static inline __m256i magnitudSobelAVX2(__m256i gx, __m256i gy) {
+    if (opcionesSobel.magnitud == MAGNITUD_APROX) {
+        __m256i ax = _mm256_abs_epi16(gx), ay = _mm256_abs_epi16(gy);
+        __m256i menor = _mm256_min_epi16(ax, ay);
+        return _mm256_add_epi16(_mm256_max_epi16(ax, ay),
+                                _mm256_srli_epi16(_mm256_add_epi16(menor, _mm256_slli_epi16(menor, 1)), 3));
+    }
+    // unpack/pack por carriles: lo = píxeles 0-3 y 8-11, hi = 4-7 y 12-15; packs los reordena
+    __m256i lo = _mm256_unpacklo_epi16(gx, gy), hi = _mm256_unpackhi_epi16(gx, gy);
+    __m256i m0 = _mm256_cvttps_epi32(_mm256_sqrt_ps(_mm256_cvtepi32_ps(_mm256_madd_epi16(lo, lo))));
+    __m256i m1 = _mm256_cvttps_epi32(_mm256_sqrt_ps(_mm256_cvtepi32_ps(_mm256_madd_epi16(hi, hi))));
+    return _mm256_packs_epi32(m0, m1);
+}
+
+__attribute__((target("avx2")))
+static inline __m256i direccionSobelAVX2(__m256i gx, __m256i gy) {
+    __m256i ax = _mm256_abs_epi16(gx), ay = _mm256_abs_epi16(gy);
+    __m256i num = _mm256_set1_epi16(SECTOR_NUM), den = _mm256_set1_epi16(SECTOR_DEN);
+    __m256i noHorizontal = _mm256_cmpgt_epi16(_mm256_mullo_epi16(ay, den), _mm256_mullo_epi16(ax, num));
+    __m256i noVertical = _mm256_cmpgt_epi16(_mm256_mullo_epi16(ax, den), _mm256_mullo_epi16(ay, num));
+    __m256i opuestos = _mm256_srai_epi16(_mm256_xor_si256(gx, gy), 15);
+    __m256i diagonal = _mm256_blendv_epi8(_mm256_set1_epi16(DIRECCION_45), _mm256_set1_epi16(DIRECCION_135), opuestos);
+    __m256i d = _mm256_blendv_epi8(_mm256_set1_epi16(DIRECCION_90), diagonal, noVertical);
+    return _mm256_and_si256(noHorizontal, d);
+}
+
+// Empaqueta 16 valores int16 en orden natural a 16 bytes saturados
+__attribute__((target("avx2")))
+static inline __m128i empaquetarAVX2(__m256i v) {
+    return _mm256_castsi256_si128(_mm256_permute4x64_epi64(_mm256_packus_epi16(v, v), 0x08));
+}
+
+__attribute__((target("avx2")))
+void sobelFilaAVX2(const unsigned char* g0, const unsigned char* g1, const unsigned char* g2,
+                   unsigned char* salida, unsigned char* direccion, int ancho) {
+    if (ancho < 3) {
+        sobelFilaEscalar(g0, g1, g2, salida, direccion, ancho);
+        return;
+    }
+    sobelFilaRango(g0, g1, g2, salida, direccion, ancho, 0, 1);
+    int x = 1;
+    for (; x + 16 < ancho; x += 16) {
+        #define CARGAR16(p) _mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i*)(p)))
+        __m256i a0 = CARGAR16(g0 + x - 1), b0 = CARGAR16(g0 + x), c0 = CARGAR16(g0 + x + 1);
+        __m256i a1 = CARGAR16(g1 + x - 1), c1 = CARGAR16(g1 + x + 1);
+        __m256i a2 = CARGAR16(g2 + x - 1), b2 = CARGAR16(g2 + x), c2 = CARGAR16(g2 + x + 1);
+        #undef CARGAR16
+        __m256i gx = _mm256_sub_epi16(_mm256_add_epi16(_mm256_add_epi16(c0, c2), _mm256_slli_epi16(c1, 1)),
+                                      _mm256_add_epi16(_mm256_add_epi16(a0, a2), _mm256_slli_epi16(a1, 1)));
+        __m256i gy = _mm256_sub_epi16(_mm256_add_epi16(_mm256_add_epi16(a2, c2), _mm256_slli_epi16(b2, 1)),
+                                      _mm256_add_epi16(_mm256_add_epi16(a0, c0), _mm256_slli_epi16(b0, 1)));
+        _mm_storeu_si128((__m128i*)(salida + x), empaquetarAVX2(magnitudSobelAVX2(gx, gy)));
+        if (direccion) _mm_storeu_si128((__m128i*)(direccion + x), empaquetarAVX2(direccionSobelAVX2(gx, gy)));
+    }
+    sobelFilaRango(g0, g1, g2, salida, direccion, ancho, x, ancho);
+}
+
+// La tabla se parte en 16 bloques de 16 entradas para vpshufb. En el paso t,
+// v - 16t cae en [0, 16) solo para los bytes del bloque t; sumarle 0x70 con
+// saturación deja esos bytes con el bit alto a 0 (vpshufb indexa por los 4 bits
+// bajos) y pone a 1 el bit alto del resto, para los que vpshufb devuelve 0.
+__attribute__((target("avx2")))
+void lutFilaAVX2(unsigned char* fila, int n, const unsigned char* lut) {
+    __m256i tablas[16];
+    for (int t = 0; t < 16; t++) {
+        tablas[t] = _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i*)(lut + 16 * t)));
+    }
+    __m256i dieciseis = _mm256_set1_epi8(16), desplazamiento = _mm256_set1_epi8(0x70);
+    int i = 0;
+    for (; i + 32 <= n; i += 32) {
+        __m256i v = _mm256_loadu_si256((const __m256i*)(fila + i));
+        __m256i r = _mm256_setzero_si256();
+        for (int t = 0; t < 16; t++) {
+            __m256i indice = _mm256_adds_epu8(v, desplazamiento);
+            r = _mm256_or_si256(r, _mm256_shuffle_epi8(tablas[t], indice));
+            v = _mm256_sub_epi8(v, dieciseis);
+        }
+        _mm256_storeu_si256((__m256i*)(fila + i), r);
+    }
+    lutFilaEscalar(fila + i, n - i, lut);
+}
+
+static int cpuSoportaAVX2() {
+    unsigned int a, b, c, d;
+    if (!__get_cpuid(1, &a, &b, &c, &d)) return 0;
+    if (!(c & bit_OSXSAVE) || !(c & bit_AVX)) return 0;
+    // El sistema operativo debe guardar los registros YMM (XCR0 bits 1 y 2)
+    unsigned int xcr0Bajo, xcr0Alto;
+    __asm__ volatile ("xgetbv" : "=a"(xcr0Bajo), "=d"(xcr0Alto) : "c"(0));
+    if ((xcr0Bajo & 6) != 6) return 0;
+    if (!__get_cpuid_count(7, 0, &a, &b, &c, &d)) return 0;
+    return (b & bit_AVX2) != 0;
+}
+
+#endif // IMG_X86
+
+static const FuncionesFila funcionesEscalar = {
+    "escalar", brilloFilaEscalar, convolucionFilaHEscalar, convolucionFilaVEscalar,
+    convolucionFijaHEscalar, convolucionFijaVEscalar, sobelFilaEscalar, lutFilaEscalar
+};
+#ifdef IMG_X86
+static const FuncionesFila funcionesSSE2 = {
+    "sse2", brilloFilaSSE2, convolucionFilaHSSE2, convolucionFilaVSSE2,
+    convolucionFijaHSSE2, convolucionFijaVSSE2, sobelFilaSSE2, lutFilaEscalar
+};
+static const FuncionesFila funcionesAVX2 = {
+    "avx2", brilloFilaAVX2, convolucionFilaHAVX2, convolucionFilaVAVX2,
+    convolucionFijaHAVX2, convolucionFijaVAVX2, sobelFilaAVX2, lutFilaAVX2
+};
+#endif
+
+static FuncionesFila simd = {
+    "escalar", brilloFilaEscalar, convolucionFilaHEscalar, convolucionFilaVEscalar,
+    convolucionFijaHEscalar, convolucionFijaVEscalar, sobelFilaEscalar, lutFilaEscalar
+};
+
+// Elige la mejor implementación disponible; IMG_SIMD=escalar|sse2|avx2 fuerza
+// una concreta. Un valor desconocido o un nivel que la CPU no tiene se avisa
+// y se usa la mejor disponible.
+void inicializarSIMD() {
+    const char* forzado = getenv("IMG_SIMD");
+    if (forzado && !*forzado) forzado = NULL;
+    simd = funcionesEscalar;
+    if (forzado && strcmp(forzado, "escalar") == 0) return;
+#ifdef IMG_X86
+    int avx2 = cpuSoportaAVX2();
+    if (forzado && strcmp(forzado, "sse2") == 0) {
+        simd = funcionesSSE2;
+        return;
+    }
+    if (forzado && strcmp(forzado, "avx2") == 0 && !avx2) {
+        fprintf(stderr, "Aviso: IMG_SIMD=avx2 pero la CPU no tiene AVX2; se usa SSE2\n");
+    } else if (forzado && strcmp(forzado, "avx2") != 0) {
+        fprintf(stderr, "Aviso: IMG_SIMD=%s no es escalar, sse2 ni avx2; se ignora\n", forzado);
+    }
+    simd = avx2 ? funcionesAVX2 : funcionesSSE2;
+#else
+    if (forzado) {
+        fprintf(stderr, "Aviso: IMG_SIMD=%s no está disponible en esta arquitectura; se usa escalar\n", forzado);
+    }
+#endif
+}
+
+// ==================== OPERACIONES PUNTUALES (LUT) ====================
+
+// Las operaciones que solo dependen del valor de cada muestra (brillo,
+// contraste, gamma, inversión, umbral, niveles) se reducen a una tabla de 256
+// entradas. Una cadena de operaciones se compone en una sola tabla
+// (lut[i] = op_n(...op_1(i))) y se aplica en una única pasada sobre la imagen.
+
+typedef enum {
+    PUNTUAL_BRILLO,      // a = delta
+    PUNTUAL_CONTRASTE,   // a = factor alrededor de 128
+    PUNTUAL_GAMMA,       // a = gamma (> 1 aclara)
+    PUNTUAL_INVERTIR,
+    PUNTUAL_UMBRAL,      // a = umbral: >= a pasa a 255, el resto a 0
+    PUNTUAL_NIVELES      // [a, b] de entrada se lleva a [c, d] de salida
+} TipoPuntual;
+
+typedef struct {
+    TipoPuntual tipo;
+    float a, b, c, d;
+} OperacionPuntual;
+
+static inline unsigned char saturarByte(float v) {
+    int r = (int)floorf(v + 0.5f);
+    return (r < 0) ? 0 : (r > 255) ? 255 : r;
+}
+
+void construirLUT(const OperacionPuntual* op, unsigned char lut[256]) {
+    for (int i = 0; i < 256; i++) {
+        switch (op->tipo) {
+            case PUNTUAL_BRILLO:
+                lut[i] = saturarByte(i + op->a);
+                break;
+            case PUNTUAL_CONTRASTE:
+                lut[i] = saturarByte((i - 128) * op->a + 128);
+                break;
+            case PUNTUAL_GAMMA:
+                lut[i] = saturarByte(255.0f * powf(i / 255.0f, 1.0f / op->a));
+                break;
+            case PUNTUAL_INVERTIR:
+                lut[i] = 255 - i;
+                break;
+            case PUNTUAL_UMBRAL:
+                lut[i] = (i >= op->a) ? 255 : 0;
+                break;
+            case PUNTUAL_NIVELES: {
+                float t = (op->b > op->a) ? (i - op->a) / (op->b - op->a) : (i >= op->a);
+                t = (t < 0) ? 0 : (t > 1) ? 1 : t;
+                lut[i] = saturarByte(op->c + t * (op->d - op->c));
+                break;
+            }
+        }
+    }
+}
+
+// Compone una cadena de operaciones en una sola tabla
+void componerLUT(const OperacionPuntual* ops, int numOps, unsigned char lut[256]) {
+    unsigned char paso[256];
+    for (int i = 0; i < 256; i++) lut[i] = i;
+    for (int k = 0; k < numOps; k++) {
+        construirLUT(&ops[k], paso);
+        for (int i = 0; i < 256; i++) lut[i] = paso[lut[i]];
+    }
+}
+
+// Si la tabla es un desplazamiento saturado (brillo puro) devuelve 1 y el delta
+int lutEsDesplazamiento(const unsigned char lut[256], int* delta) {
+    int d = (lut[0] > 0) ? lut[0] : lut[255] - 255;
+    for (int i = 0; i < 256; i++) {
+        int v = i + d;
+        if (lut[i] != ((v < 0) ? 0 : (v > 255) ? 255 : v)) return 0;
+    }
+    *delta = d;
+    return 1;
+}
+
+// Interpreta una operación "nombre[:p1[:p2...]]"; devuelve 0 si no es válida
+int parsearOperacionPuntual(const char* texto, OperacionPuntual* op) {
+    char nombre[32];
+    float p[4] = {0, 0, 0, 0};
+    int n = sscanf(texto, "%31[^:,]:%f:%f:%f:%f", nombre, &p[0], &p[1], &p[2], &p[3]) - 1;
+    if (n < 0) return 0;
+    op->a = p[0]; op->b = p[1]; op->c = p[2]; op->d = p[3];
+    if (strcmp(nombre, "brillo") == 0 && n == 1) op->tipo = PUNTUAL_BRILLO;
+    else if (strcmp(nombre, "contraste") == 0 && n == 1) op->tipo = PUNTUAL_CONTRASTE;
+    else if (strcmp(nombre, "gamma") == 0 && n == 1 && p[0] > 0) op->tipo = PUNTUAL_GAMMA;
+    else if (strcmp(nombre, "invertir") == 0 && n == 0) op->tipo = PUNTUAL_INVERTIR;
+    else if (strcmp(nombre, "umbral") == 0 && n == 1) op->tipo = PUNTUAL_UMBRAL;
+    else if (strcmp(nombre, "niveles") == 0 && (n == 2 || n == 4)) {
+        op->tipo = PUNTUAL_NIVELES;
+        if (n == 2) { op->c = 0; op->d = 255; }
+    } else return 0;
+    return 1;
+}
+
+// Interpreta una cadena "op1,op2,..."; devuelve el número de operaciones o -1
+int parsearCadenaPuntual(const char* texto, OperacionPuntual* ops, int max) {
+    int n = 0;
+    while (*texto) {
+        if (n == max || !parsearOperacionPuntual(texto, &ops[n])) return -1;
+        n++;
+        const char* coma = strchr(texto, ',');
+        if (!coma) break;
+        texto = coma + 1;
+    }
+    return n;
+}
+
+// Estructura para datos de hilos de operaciones puntuales
+typedef struct {
+    unsigned char* pixeles;
+    size_t stride;
+    int ancho;
+    int canales;
+    int delta;                 // Usado si esDesplazamiento
+    int esDesplazamiento;
+    const unsigned char* lut;
+} PuntualArgs;
+
+void puntualHilo(void* args, int inicio, int fin) {
+    PuntualArgs* pArgs = (PuntualArgs*)args;
+    int bytesFila = pArgs->ancho * pArgs->canales;
+    for (int y = inicio; y < fin; y++) {
+        unsigned char* fila = FILA(pArgs->pixeles, pArgs->stride, y);
+        if (pArgs->esDesplazamiento) {
+            simd.brilloFila(fila, bytesFila, pArgs->delta);
+        } else {
+            simd.lutFila(fila, bytesFila, pArgs->lut);
+        }
+    }
+}
+
+// Una pasada sobre la imagen con la tabla dada; el brillo puro usa sumas saturadas
+void aplicarLUTConcurrente(ImagenInfo* info, const unsigned char lut[256]) {
+    PuntualArgs args;
+    args.pixeles = info->pixeles;
+    args.stride = info->stride;
+    args.ancho = info->ancho;
+    args.canales = info->canales;
+    args.lut = lut;
+    args.esDesplazamiento = lutEsDesplazamiento(lut, &args.delta);
+    if (args.esDesplazamiento && args.delta == 0) return; // Identidad
+    ejecutarEnPool(puntualHilo, &args, info->alto);
+}
+
+int aplicarOperacionesPuntuales(ImagenInfo* info, const OperacionPuntual* ops, int numOps) {
+    if (!info->pixeles) {
+        printf("No hay imagen cargada.\n");
+        return 0;
+    }
+    
+    unsigned char lut[256];
+    componerLUT(ops, numOps, lut);
+    aplicarLUTConcurrente(info, lut);
+    
+    INFORMAR("%d operaciones puntuales compuestas en una tabla y aplicadas en una pasada con %d hilos en imagen %s.\n",
+           numOps, hilosPool(), info->canales == 1 ? "grises" : "RGB");
+    return 1;
+}
+
+int ajustarBrilloConcurrente(ImagenInfo* info, int delta) {
+    if (!info->pixeles) {
+        printf("No hay imagen cargada.\n");
+        return 0;
+    }
+
+    OperacionPuntual op = {PUNTUAL_BRILLO, (float)delta, 0, 0, 0};
+    unsigned char lut[256];
+    construirLUT(&op, lut);
+    aplicarLUTConcurrente(info, lut);
+
+    INFORMAR("Brillo ajustado concurrentemente con %d hilos (delta: %+d) en imagen %s.\n", 
+           hilosPool(), delta, info->canales == 1 ? "grises" : "RGB");
+    return 1;
+}
+
+// ==================== FUNCIÓN 1: CONVOLUCIÓN ====================
+
+// El Gaussiano es separable: G(x, y) = g(x) * g(y). Se aplica como una pasada
+// horizontal 1D (bytes -> float intermedio) seguida de una vertical 1D
+// (float -> bytes), O(2k) por muestra en lugar de O(k²). Las filas se
+// procesan con simd.convolucionFilaH/V o, con --conv-entera, en punto fijo.
+
+// Las pasadas verticales arman en la pila un puntero por fila del kernel;
+// más allá de este tamaño conviene el filtro IIR (--desenfoque 0,SIGMA)
+#define MAX_TAM_KERNEL 1001
+
+// Kernel Gaussiano 1D normalizado (suma 1)
+float* generarKernelGaussiano(int tam, float sigma) {
+    float* kernel = (float*)malloc(tam * sizeof(float));
+    if (!kernel) return NULL;
+
+    float suma = 0.0;
+    int centro = tam / 2;
+    
+    for (int i = 0; i < tam; i++) {
+        float d = i - centro;
+        kernel[i] = exp(-(d*d) / (2.0 * sigma * sigma));
+        suma += kernel[i];
+    }
+
+    // Normalizar
+    for (int i = 0; i < tam; i++) {
+        kernel[i] /= suma;
+    }
+
+    return kernel;
+}
+
+// ---- Punto fijo ----
+
+// Con --conv-entera el kernel se cuantifica a pesos enteros de 16 bits que
+// suman 2^14 y las pasadas usan simd.convolucionFijaH/V. Frente a la ruta en
+// float el resultado difiere como mucho en ±1 (comprobado con kernels de hasta
+// 201 taps). Si algún peso cuantificado sale negativo (kernels enormes y casi
+// planos) la fila intermedia podría desbordar y se usa float.
+
+static int convolucionEntera = 0; // --conv-entera
+
+// Kernel 1D en la precisión elegida; la fila intermedia tiene bytesMuestra por muestra
+typedef struct {
+    int tam;
+    float* pesos;            // Normalizado (suma 1)
+    int entero;
+    short* pesosH;           // Punto fijo: suman 2^BITS_FIJO_H y 2^BITS_FIJO_V (sin usar si entero = 0)
+    short* pesosV;
+    size_t bytesMuestra;
+} KernelConvolucion;
+
+// Redondea los pesos a enteros que suman exactamente 2^bits (el error va al
+// tap central); devuelve 0 si el tap central queda negativo
+static int cuantificarKernel(const float* kernel, int tam, int bits, short* pesos) {
+    int suma = 0;
+    for (int k = 0; k < tam; k++) {
+        pesos[k] = (short)lrintf(kernel[k] * (1 << bits));
+        suma += pesos[k];
+    }
+    int central = pesos[tam / 2] + (1 << bits) - suma;
+    pesos[tam / 2] = (short)central;
+    return central >= 0;
+}
+
+// Gaussiano de tam pesos en la precisión de convolucionEntera; devuelve 0 si no hay memoria
+int crearKernelConvolucion(KernelConvolucion* k, int tam, float sigma) {
+    memset(k, 0, sizeof(*k));
+    k->tam = tam;
+    k->entero = convolucionEntera;
+    k->bytesMuestra = k->entero ? sizeof(short) : sizeof(float);
+    k->pesos = generarKernelGaussiano(tam, sigma);
+    if (!k->pesos) return 0;
+    if (!k->entero) return 1;
+    
+    k->pesosH = (short*)malloc(tam * sizeof(short));
+    k->pesosV = (short*)malloc(tam * sizeof(short));
+    if (!k->pesosH || !k->pesosV) return 0;
+    if (!cuantificarKernel(k->pesos, tam, BITS_FIJO_H, k->pesosH) ||
+        !cuantificarKernel(k->pesos, tam, BITS_FIJO_V, k->pesosV)) {
+        k->entero = 0;
+        k->bytesMuestra = sizeof(float);
+    }
+    return 1;
+}
+
+void liberarKernelConvolucion(KernelConvolucion* k) {
+    free(k->pesos);
+    free(k->pesosH);
+    free(k->pesosV);
+    k->pesos = NULL;
+    k->pesosH = k->pesosV = NULL;
+}
+
+// Pasada horizontal de una fila a la fila intermedia (float o int16)
+static inline void convolucionFilaH(const KernelConvolucion* k, const unsigned char* fila, void* salida,
+                                    int ancho, int canales) {
+    if (k->entero) simd.convolucionFijaH(fila, (short*)salida, ancho, canales, k->pesosH, k->tam);
+    else simd.convolucionFilaH(fila, (float*)salida, ancho, canales, k->pesos, k->tam);
+}
+
+// Pasada vertical sobre k->tam filas intermedias
+static inline void convolucionFilaV(const KernelConvolucion* k, const void* const* filas, unsigned char* salida, int n) {
+    if (k->entero) simd.convolucionFijaV((const short* const*)filas, salida, n, k->pesosV, k->tam);
+    else simd.convolucionFilaV((const float* const*)filas, salida, n, k->pesos, k->tam);
+}
+
+// Pasada horizontal de una fila constante: la fila intermedia fuera de la imagen con
+// el borde constante. NULL con los demás modos; *ok = 0 si no hay memoria
+static unsigned char* crearFilaIntermediaConstante(const KernelConvolucion* k, int ancho, int canales, int* ok) {
+    unsigned char* constante = crearFilaConstante((size_t)ancho * canales, ok);
+    if (!constante) return NULL;
+    unsigned char* fila = (unsigned char*)malloc((size_t)ancho * canales * k->bytesMuestra);
+    if (fila) convolucionFilaH(k, constante, fila, ancho, canales);
+    else *ok = 0;
+    free(constante);
+    return fila;
+}
+
+// Estructura para datos de hilos de convolución (ambas pasadas)
+typedef struct {
+    const unsigned char* pixelesOrigen;
+    unsigned char* pixelesDestino;
+    unsigned char* intermedio;       // ancho * canales muestras por fila, alto filas
+    const unsigned char* filaConstante; // Fila intermedia del borde constante
+    size_t strideOrigen;
+    size_t strideDestino;
+    const KernelConvolucion* kernel;
+    int ancho;
+    int alto;
+    int canales;
+} ConvolucionArgs;
+
+void convolucionHorizontalHilo(void* args, int inicio, int fin) {
+    ConvolucionArgs* cArgs = (ConvolucionArgs*)args;
+    size_t bytesFila = (size_t)cArgs->ancho * cArgs->canales * cArgs->kernel->bytesMuestra;
+    for (int y = inicio; y < fin; y++) {
+        convolucionFilaH(cArgs->kernel, FILA(cArgs->pixelesOrigen, cArgs->strideOrigen, y),
+                         cArgs->intermedio + y * bytesFila, cArgs->ancho, cArgs->canales);
+    }
+}
+
+void convolucionVerticalHilo(void* args, int inicio, int fin) {
+    ConvolucionArgs* cArgs = (ConvolucionArgs*)args;
+    size_t n = (size_t)cArgs->ancho * cArgs->canales;
+    size_t bytesFila = n * cArgs->kernel->bytesMuestra;
+    int tamKernel = cArgs->kernel->tam;
+    int offset = tamKernel / 2;
+    const void* filas[tamKernel];
+    
+    for (int y = inicio; y < fin; y++) {
+        for (int k = 0; k < tamKernel; k++) {
+            filas[k] = filaBorde(cArgs->intermedio, bytesFila, y + k - offset, cArgs->alto, cArgs->filaConstante);
+        }
+        convolucionFilaV(cArgs->kernel, filas, FILA(cArgs->pixelesDestino, cArgs->strideDestino, y), (int)n);
+    }
+}
+
+int aplicarConvolucionConcurrente(ImagenInfo* info, int tamKernel, float sigma) {
+    if (!info->pixeles) {
+        printf("No hay imagen cargada.\n");
+        return 0;
+    }
+    
+    if (tamKernel % 2 == 0 || tamKernel < 3 || tamKernel > MAX_TAM_KERNEL) {
+        printf("El tamaño del kernel debe ser impar y estar entre 3 y %d.\n", MAX_TAM_KERNEL);
+        return 0;
+    }
+    
+    if (sigma <= 0) {
+        printf("El valor de sigma debe ser positivo.\n");
+        return 0;
+    }
+    
+    // Generar kernel Gaussiano 1D
+    KernelConvolucion kernel;
+    if (!crearKernelConvolucion(&kernel, tamKernel, sigma)) {
+        liberarKernelConvolucion(&kernel);
+        return 0;
+    }
+    
+    // Buffer intermedio de la pasada horizontal
+    unsigned char* intermedio = (unsigned char*)malloc((size_t)info->ancho * info->canales * info->alto *
+                                                       kernel.bytesMuestra);
+    if (!intermedio) {
+        fprintf(stderr, "Error de memoria al asignar buffer intermedio\n");
+        liberarKernelConvolucion(&kernel);
+        return 0;
+    }
+    
+    // Crear imagen destino
+    int ok = 1;
+    unsigned char* filaConstante = crearFilaIntermediaConstante(&kernel, info->ancho, info->canales, &ok);
+    size_t stride;
+    unsigned char* pixelesDestino = ok ? crearBufferPixeles(info->ancho, info->alto, info->canales, &stride) : NULL;
+    if (!pixelesDestino) {
+        free(filaConstante);
+        free(intermedio);
+        liberarKernelConvolucion(&kernel);
+        return 0;
+    }
+    
+    // Repartir filas entre los hilos del pool: primero horizontal, luego vertical
+    ConvolucionArgs args;
+    args.pixelesOrigen = info->pixeles;
+    args.pixelesDestino = pixelesDestino;
+    args.intermedio = intermedio;
+    args.filaConstante = filaConstante;
+    args.strideOrigen = info->stride;
+    args.strideDestino = stride;
+    args.kernel = &kernel;
+    args.ancho = info->ancho;
+    args.alto = info->alto;
+    args.canales = info->canales;
+    ejecutarEnPool(convolucionHorizontalHilo, &args, info->alto);
+    ejecutarEnPool(convolucionVerticalHilo, &args, info->alto);
+    
+    // Reemplazar imagen original (preservando dimensiones)
+    reemplazarPixeles(info, pixelesDestino, stride, info->ancho, info->alto, info->canales);
+    
+    free(filaConstante);
+    free(intermedio);
+    liberarKernelConvolucion(&kernel);
+    
+    INFORMAR("Convolución aplicada concurrentemente con %d hilos (kernel %dx%d separable%s, sigma=%.1f) en imagen %s.\n", 
+           hilosPool(), tamKernel, tamKernel, kernel.entero ? " en punto fijo" : "", sigma,
+           info->canales == 1 ? "grises" : "RGB");
+    return 1;
+}
+
+// ==================== DESENFOQUE RECURSIVO (IIR) ====================
+
+// Aproximación recursiva del Gaussiano de Young y van Vliet (1995): una pasada
+// causal y otra anticausal de orden 3 por dirección. El coste por muestra es
+// constante, independiente de sigma, lo que la hace útil para sigma > 5.
+// Con réplica y constante el estado inicial de cada pasada es el estacionario
+// de la entrada que sigue al borde (la anticausal con la matriz de Triggs y
+// Sdika, 2006) y es exacto. Con reflejar y envolver la recursión arranca
+// antes, sobre las muestras que --modo-borde pone fuera de la imagen, durante
+// lo que tarda la respuesta al impulso en hacerse despreciable.
+
+#define ANCHO_FRANJA_IIR 64 // Columnas (floats) por franja en la pasada vertical
+
+typedef struct {
+    float B;             // Ganancia de entrada
+    float b1, b2, b3;    // Coeficientes de realimentación ya divididos por b0
+    float M[3][3];       // Estado anticausal en el borde derecho a partir del causal
+    int extension;       // Muestras fuera del borde que recorre la recursión (0: estado exacto)
+} CoefIIR;
+
+typedef struct {
+    const unsigned char* pixelesOrigen;
+    unsigned char* pixelesDestino;
+    float* intermedio;   // ancho * canales floats por fila
+    size_t strideOrigen;
+    size_t strideDestino;
+    CoefIIR coef;
+    int ancho;
+    int alto;
+    int canales;
+    int falloMemoria;    // Algún hilo no pudo reservar su buffer: el destino está incompleto
+} RecursivoArgs;
+
+CoefIIR calcularCoeficientesIIR(float sigma) {
+    double q = (sigma >= 2.5) ? 0.98711 * sigma - 0.96330
+                              : 3.97156 - 4.14554 * sqrt(1.0 - 0.26891 * sigma);
+    double q2 = q * q, q3 = q2 * q;
+    double b0 = 1.57825 + 2.44413 * q + 1.4281 * q2 + 0.422205 * q3;
+    double b1 = 2.44413 * q + 2.85619 * q2 + 1.26661 * q3;
+    double b2 = -(1.4281 * q2 + 1.26661 * q3);
+    double b3 = 0.422205 * q3;
+    CoefIIR coef;
+    coef.b1 = b1 / b0;
+    coef.b2 = b2 / b0;
+    coef.b3 = b3 / b0;
+    coef.B = 1.0 - (coef.b1 + coef.b2 + coef.b3);
+    
+    // Con réplica en el borde, la desviación del estado causal respecto a la
+    // entrada constante decae según la recursión homogénea; la anticausal la
+    // recorre de vuelta. Se simula para cada vector base y se obtiene M.
+    int largo = (int)(20.0 * q) + 64;
+    double* e = (double*)malloc(largo * sizeof(double));
+    for (int j = 0; j < 3; j++) {
+        for (int i = 0; i < 3; i++) coef.M[i][j] = (i == j) ? 1.0f : 0.0f;
+        if (!e) continue;
+        double e1 = (j == 0), e2 = (j == 1), e3 = (j == 2);
+        for (int n = 0; n < largo; n++) {
+            e[n] = coef.b1 * e1 + coef.b2 * e2 + coef.b3 * e3;
+            e3 = e2; e2 = e1; e1 = e[n];
+        }
+        double f1 = 0, f2 = 0, f3 = 0;
+        for (int n = largo - 1; n >= 0; n--) {
+            double f = coef.B * e[n] + coef.b1 * f1 + coef.b2 * f2 + coef.b3 * f3;
+            f3 = f2; f2 = f1; f1 = f;
+        }
+        coef.M[0][j] = f1;
+        coef.M[1][j] = f2;
+        coef.M[2][j] = f3;
+    }
+    free(e);
+    
+    // Con reflejar y envolver, hasta que la respuesta al impulso de la pasada
+    // causal (lo que resta de ella) cae por debajo de 1/1000
+    coef.extension = 0;
+    if (opcionesBorde.modo == BORDE_REFLEJAR || opcionesBorde.modo == BORDE_ENVOLVER) {
+        double h1 = coef.B, h2 = 0, h3 = 0, resto = 1.0 - coef.B;
+        while (resto > 1e-3 && coef.extension < 100000) {
+            double h = coef.b1 * h1 + coef.b2 * h2 + coef.b3 * h3;
+            h3 = h2; h2 = h1; h1 = h;
+            resto -= h;
+            coef.extension++;
+        }
+    }
+    return coef;
+}
+
+// Muestra del canal c en la posición x de la fila según el modo de borde
+static inline float muestraBordeIIR(const unsigned char* fila, int x, int ancho, int canales, int c) {
+    int px = indiceBorde(x, ancho);
+    return (px < 0) ? opcionesBorde.constante : fila[px * canales + c];
+}
+
+// Convierte el estado causal final (u1 = último, u2, u3) en el anticausal inicial
+static inline void iniciarAnticausal(const CoefIIR* k, float borde, float* w1, float* w2, float* w3) {
+    float d1 = *w1 - borde, d2 = *w2 - borde, d3 = *w3 - borde;
+    *w1 = borde + k->M[0][0] * d1 + k->M[0][1] * d2 + k->M[0][2] * d3;
+    *w2 = borde + k->M[1][0] * d1 + k->M[1][1] * d2 + k->M[1][2] * d3;
+    *w3 = borde + k->M[2][0] * d1 + k->M[2][1] * d2 + k->M[2][2] * d3;
+}
+
+// Filas completas: recursión causal y anticausal por canal sobre datos intercalados.
+// Los bordes se inicializan con el estado estacionario de la muestra exterior
+// tras recorrer k.extension muestras fuera de la fila.
+void recursivoHorizontalHilo(void* args, int inicio, int fin) {
+    RecursivoArgs* rArgs = (RecursivoArgs*)args;
+    CoefIIR k = rArgs->coef;
+    int ancho = rArgs->ancho, canales = rArgs->canales;
+    int extension = k.extension;
+    size_t n = (size_t)ancho * canales;
+    
+    // Salida causal de las muestras tras el borde derecho
+    float* exterior = (float*)malloc((size_t)(extension + 1) * sizeof(float));
+    if (!exterior) {
+        fprintf(stderr, "Error de memoria en desenfoque recursivo\n");
+        __atomic_store_n(&rArgs->falloMemoria, 1, __ATOMIC_RELAXED);
+        return;
+    }
+    
+    for (int y = inicio; y < fin; y++) {
+        const unsigned char* fila = FILA(rArgs->pixelesOrigen, rArgs->strideOrigen, y);
+        float* salida = rArgs->intermedio + y * n;
+        for (int c = 0; c < canales; c++) {
+            float w1 = muestraBordeIIR(fila, -extension - 1, ancho, canales, c), w2 = w1, w3 = w1;
+            for (int x = -extension; x < 0; x++) {
+                float w = k.B * muestraBordeIIR(fila, x, ancho, canales, c) + k.b1 * w1 + k.b2 * w2 + k.b3 * w3;
+                w3 = w2; w2 = w1; w1 = w;
+            }
+            for (int x = 0; x < ancho; x++) {
+                float w = k.B * fila[x * canales + c] + k.b1 * w1 + k.b2 * w2 + k.b3 * w3;
+                salida[x * canales + c] = w;
+                w3 = w2; w2 = w1; w1 = w;
+            }
+            for (int x = 0; x < extension; x++) {
+                float w = k.B * muestraBordeIIR(fila, ancho + x, ancho, canales, c) + k.b1 * w1 + k.b2 * w2 + k.b3 * w3;
+                exterior[x] = w;
+                w3 = w2; w2 = w1; w1 = w;
+            }
+            iniciarAnticausal(&k, muestraBordeIIR(fila, ancho + extension, ancho, canales, c), &w1, &w2, &w3);
+            for (int x = extension - 1; x >= 0; x--) {
+                float w = k.B * exterior[x] + k.b1 * w1 + k.b2 * w2 + k.b3 * w3;
+                w3 = w2; w2 = w1; w1 = w;
+            }
+            for (int x = ancho - 1; x >= 0; x--) {
+                float w = k.B * salida[x * canales + c] + k.b1 * w1 + k.b2 * w2 + k.b3 * w3;
+                salida[x * canales + c] = w;
+                w3 = w2; w2 = w1; w1 = w;
+            }
+        }
+    }
+    free(exterior);
+}
+
+// Fila y del intermedio en la franja x0 según el modo de borde
+static inline const float* filaIntermedioIIR(const RecursivoArgs* rArgs, int y, size_t x0, const float* constante) {
+    int py = indiceBorde(y, rArgs->alto);
+    return (py < 0) ? constante : rArgs->intermedio + (size_t)py * rArgs->ancho * rArgs->canales + x0;
+}
+
+// Franjas de columnas: cada hilo recorre todas las filas para sus columnas,
+// accediendo a memoria contigua dentro de cada fila
+void recursivoVerticalHilo(void* args, int inicio, int fin) {
+    RecursivoArgs* rArgs = (RecursivoArgs*)args;
+    CoefIIR k = rArgs->coef;
+    int alto = rArgs->alto;
+    int extension = k.extension;
+    size_t n = (size_t)rArgs->ancho * rArgs->canales;
+    float w1[ANCHO_FRANJA_IIR], w2[ANCHO_FRANJA_IIR], w3[ANCHO_FRANJA_IIR];
+    float constante[ANCHO_FRANJA_IIR];
+    for (int i = 0; i < ANCHO_FRANJA_IIR; i++) constante[i] = opcionesBorde.constante;
+    
+    // Las extension + 1 filas de entrada bajo el borde inferior; después, su salida causal
+    float* exterior = (float*)malloc((size_t)(extension + 1) * ANCHO_FRANJA_IIR * sizeof(float));
+    if (!exterior) {
+        fprintf(stderr, "Error de memoria en desenfoque recursivo\n");
+        __atomic_store_n(&rArgs->falloMemoria, 1, __ATOMIC_RELAXED);
+        return;
+    }
+    
+    for (int franja = inicio; franja < fin; franja++) {
+        size_t x0 = (size_t)franja * ANCHO_FRANJA_IIR;
+        int m = (n - x0 < ANCHO_FRANJA_IIR) ? (int)(n - x0) : ANCHO_FRANJA_IIR;
+        
+        // La pasada causal trabaja en sitio: se guardan antes las filas bajo el borde
+        for (int e = 0; e <= extension; e++) {
+            memcpy(exterior + (size_t)e * ANCHO_FRANJA_IIR, filaIntermedioIIR(rArgs, alto + e, x0, constante),
+                   (size_t)m * sizeof(float));
+        }
+        const float* entrada = filaIntermedioIIR(rArgs, -extension - 1, x0, constante);
+        for (int i = 0; i < m; i++) w1[i] = w2[i] = w3[i] = entrada[i];
+        for (int y = -extension; y < 0; y++) {
+            entrada = filaIntermedioIIR(rArgs, y, x0, constante);
+            for (int i = 0; i < m; i++) {
+                float w = k.B * entrada[i] + k.b1 * w1[i] + k.b2 * w2[i] + k.b3 * w3[i];
+                w3[i] = w2[i]; w2[i] = w1[i]; w1[i] = w;
+            }
+        }
+        float* fila;
+        for (int y = 0; y < alto; y++) {
+            fila = rArgs->intermedio + y * n + x0;
+            for (int i = 0; i < m; i++) {
+                float w = k.B * fila[i] + k.b1 * w1[i] + k.b2 * w2[i] + k.b3 * w3[i];
+                fila[i] = w;
+                w3[i] = w2[i]; w2[i] = w1[i]; w1[i] = w;
+            }
+        }
+        for (int e = 0; e < extension; e++) {
+            fila = exterior + (size_t)e * ANCHO_FRANJA_IIR;
+            for (int i = 0; i < m; i++) {
+                float w = k.B * fila[i] + k.b1 * w1[i] + k.b2 * w2[i] + k.b3 * w3[i];
+                fila[i] = w;
+                w3[i] = w2[i]; w2[i] = w1[i]; w1[i] = w;
+            }
+        }
+        const float* borde = exterior + (size_t)extension * ANCHO_FRANJA_IIR;
+        for (int i = 0; i < m; i++) iniciarAnticausal(&k, borde[i], &w1[i], &w2[i], &w3[i]);
+        for (int e = extension - 1; e >= 0; e--) {
+            fila = exterior + (size_t)e * ANCHO_FRANJA_IIR;
+            for (int i = 0; i < m; i++) {
+                float w = k.B * fila[i] + k.b1 * w1[i] + k.b2 * w2[i] + k.b3 * w3[i];
+                w3[i] = w2[i]; w2[i] = w1[i]; w1[i] = w;
+            }
+        }
+        for (int y = alto - 1; y >= 0; y--) {
+            fila = rArgs->intermedio + y * n + x0;
+            unsigned char* destino = FILA(rArgs->pixelesDestino, rArgs->strideDestino, y) + x0;
+            for (int i = 0; i < m; i++) {
+                float w = k.B * fila[i] + k.b1 * w1[i] + k.b2 * w2[i] + k.b3 * w3[i];
+                w3[i] = w2[i]; w2[i] = w1[i]; w1[i] = w;
+                int resultado = (int)(w + 0.5);
+                destino[i] = (resultado < 0) ? 0 : (resultado > 255) ? 255 : resultado;
+            }
+        }
+    }
+    free(exterior);
+}
+
+int aplicarDesenfoqueRecursivo(ImagenInfo* info, float sigma) {
+    if (!info->pixeles) {
+        printf("No hay imagen cargada.\n");
+        return 0;
+    }
+    
+    if (sigma < 0.5) {
+        printf("El desenfoque recursivo requiere sigma >= 0.5.\n");
+        return 0;
+    }
+    
+    size_t n = (size_t)info->ancho * info->canales;
+    float* intermedio = (float*)malloc(n * info->alto * sizeof(float));
+    if (!intermedio) {
+        fprintf(stderr, "Error de memoria al asignar buffer intermedio\n");
+        return 0;
+    }
+    
+    size_t stride;
+    unsigned char* pixelesDestino = crearBufferPixeles(info->ancho, info->alto, info->canales, &stride);
+    if (!pixelesDestino) {
+        free(intermedio);
+        return 0;
+    }
+    
+    // Pasada horizontal repartida por filas, vertical por franjas de columnas
+    RecursivoArgs args;
+    args.pixelesOrigen = info->pixeles;
+    args.pixelesDestino = pixelesDestino;
+    args.intermedio = intermedio;
+    args.strideOrigen = info->stride;
+    args.strideDestino = stride;
+    args.coef = calcularCoeficientesIIR(sigma);
+    args.ancho = info->ancho;
+    args.alto = info->alto;
+    args.canales = info->canales;
+    args.falloMemoria = 0;
+    ejecutarEnPool(recursivoHorizontalHilo, &args, info->alto);
+    if (!args.falloMemoria) {
+        ejecutarEnPool(recursivoVerticalHilo, &args, (int)((n + ANCHO_FRANJA_IIR - 1) / ANCHO_FRANJA_IIR));
+    }
+    if (args.falloMemoria) {
+        devolverBuffer(pixelesDestino, stride * (size_t)info->alto);
+        free(intermedio);
+        return 0;
+    }
+    
+    reemplazarPixeles(info, pixelesDestino, stride, info->ancho, info->alto, info->canales);
+    free(intermedio);
+    
+    INFORMAR("Desenfoque recursivo (IIR) aplicado concurrentemente con %d hilos (sigma=%.1f) en imagen %s.\n",
+           hilosPool(), sigma, info->canales == 1 ? "grises" : "RGB");
+    return 1;
+}
+
+// ==================== FUNCIÓN 2: ROTACIÓN ====================
+
+// El destino se reparte en teselas cuadradas que los hilos toman de una en
+// una: las bandas superior e inferior de un giro arbitrario son casi todo
+// negro y se resuelven enseguida sin desequilibrar el reparto.
+#define TESELA_ROTACION 32 // Lado (píxeles) de la tesela
+
+// Estructura para datos de hilos de rotación
+typedef struct {
+    const unsigned char* pixelesOrigen;
+    unsigned char* pixelesDestino;
+    size_t strideOrigen;
+    size_t strideDestino;
+    float cosAngulo;
+    float sinAngulo;
+    int anchoOrigen;
+    int altoOrigen;
+    int anchoDestino;
+    int altoDestino;
+    int canales;
+    int teselasX;        // Teselas por fila del destino
+} RotacionArgs;
+
+// Transformación inversa: posición en el origen del píxel (x, y) del destino
+static inline void origenRotacion(const RotacionArgs* r, float x, float y, float* xOrigen, float* yOrigen) {
+    float dx = x - r->anchoDestino / 2;
+    float dy = y - r->altoDestino / 2;
+    *xOrigen = dx * r->cosAngulo + dy * r->sinAngulo + r->anchoOrigen / 2;
+    *yOrigen = -dx * r->sinAngulo + dy * r->cosAngulo + r->altoOrigen / 2;
+}
+
+// Proyección de cuatro puntos sobre el eje (ex, ey): mínimo y máximo
+static void proyectarEsquinas(const float* xs, const float* ys, float ex, float ey, float* minimo, float* maximo) {
+    *minimo = *maximo = xs[0] * ex + ys[0] * ey;
+    for (int i = 1; i < 4; i++) {
+        float p = xs[i] * ex + ys[i] * ey;
+        if (p < *minimo) *minimo = p;
+        if (p > *maximo) *maximo = p;
+    }
+}
+
+// 1 si ningún píxel de la tesela [x0, x1) x [y0, y1) cae dentro del origen.
+// La tesela transformada es un cuadrado girado; se comprueba con ejes
+// separadores (los del rectángulo del origen y los del cuadrado girado).
+static int teselaFueraDelOrigen(const RotacionArgs* r, int x0, int y0, int x1, int y1) {
+    float tx[4], ty[4];
+    origenRotacion(r, x0, y0, &tx[0], &ty[0]);
+    origenRotacion(r, x1 - 1, y0, &tx[1], &ty[1]);
+    origenRotacion(r, x0, y1 - 1, &tx[2], &ty[2]);
+    origenRotacion(r, x1 - 1, y1 - 1, &tx[3], &ty[3]);
+    
+    // Región del origen con interpolación válida, ampliada un píxel por seguridad
+    float ox[4] = {-1, (float)r->anchoOrigen, -1, (float)r->anchoOrigen};
+    float oy[4] = {-1, -1, (float)r->altoOrigen, (float)r->altoOrigen};
+    float ejes[4][2] = {
+        {1, 0}, {0, 1},
+        {r->cosAngulo, -r->sinAngulo}, {r->sinAngulo, r->cosAngulo}
+    };
+    for (int e = 0; e < 4; e++) {
+        float minT, maxT, minO, maxO;
+        proyectarEsquinas(tx, ty, ejes[e][0], ejes[e][1], &minT, &maxT);
+        proyectarEsquinas(ox, oy, ejes[e][0], ejes[e][1], &minO, &maxO);
+        if (maxT < minO || maxO < minT) return 1;
+    }
+    return 0;
+}
+
+// Reparte teselas del destino; las que quedan fuera del origen se rellenan de negro
+void rotacionHilo(void* args, int inicio, int fin) {
+    RotacionArgs* rArgs = (RotacionArgs*)args;
+    int canales = rArgs->canales;
+    
+    for (int t = inicio; t < fin; t++) {
+        int xt = (t % rArgs->teselasX) * TESELA_ROTACION;
+        int yt = (t / rArgs->teselasX) * TESELA_ROTACION;
+        int xFin = (xt + TESELA_ROTACION < rArgs->anchoDestino) ? xt + TESELA_ROTACION : rArgs->anchoDestino;
+        int yFin = (yt + TESELA_ROTACION < rArgs->altoDestino) ? yt + TESELA_ROTACION : rArgs->altoDestino;
+        
+        if (teselaFueraDelOrigen(rArgs, xt, yt, xFin, yFin)) {
+            for (int y = yt; y < yFin; y++) {
+                memset(FILA(rArgs->pixelesDestino, rArgs->strideDestino, y) + xt * canales, 0,
+                       (size_t)(xFin - xt) * canales);
+            }
+            continue;
+        }
+        
+        for (int y = yt; y < yFin; y++) {
+            unsigned char* filaDestino = FILA(rArgs->pixelesDestino, rArgs->strideDestino, y);
+            for (int x = xt; x < xFin; x++) {
+                unsigned char* destino = filaDestino + x * canales;
+                float xOrigen, yOrigen;
+                origenRotacion(rArgs, x, y, &xOrigen, &yOrigen);
+                
+                // Interpolación bilineal
+                int x0 = (int)xOrigen;
+                int y0 = (int)yOrigen;
+                int x1 = x0 + 1;
+                int y1 = y0 + 1;
+                
+                if (x0 >= 0 && x1 < rArgs->anchoOrigen && y0 >= 0 && y1 < rArgs->altoOrigen) {
+                    float wx = xOrigen - x0;
+                    float wy = yOrigen - y0;
+                    const unsigned char* p00 = FILA(rArgs->pixelesOrigen, rArgs->strideOrigen, y0) + x0 * canales;
+                    const unsigned char* p10 = p00 + canales;
+                    const unsigned char* p01 = FILA(rArgs->pixelesOrigen, rArgs->strideOrigen, y1) + x0 * canales;
+                    const unsigned char* p11 = p01 + canales;
+                    
+                    for (int c = 0; c < canales; c++) {
+                        float val = (1-wx)*(1-wy)*p00[c] +
+                                   wx*(1-wy)*p10[c] +
+                                   (1-wx)*wy*p01[c] +
+                                   wx*wy*p11[c];
+                        destino[c] = (unsigned char)(val + 0.5);
+                    }
+                } else {
+                    // Pixel fuera de rango, usar negro
+                    for (int c = 0; c < canales; c++) {
+                        destino[c] = 0;
+                    }
+                }
+            }
+        }
+    }
+}
+
+// ---- Giros exactos de 90°, 180° y 270° ----
+
+// Los múltiplos de 90° son una permutación de píxeles: se copian sin
+// interpolar. El destino se recorre por bloques cuadrados para que las
+// columnas del origen que lee cada bloque sigan en caché entre filas.
+
+#define BLOQUE_GIRO 64 // Lado (píxeles) del bloque de destino
+
+typedef struct {
+    const unsigned char* pixelesOrigen;
+    unsigned char* pixelesDestino;
+    size_t strideOrigen;
+    size_t strideDestino;
+    int anchoOrigen;
+    int altoOrigen;
+    int anchoDestino;
+    int altoDestino;
+    int canales;
+    int cuartos;         // 1 = 90°, 2 = 180°, 3 = 270° (sentido horario)
+} GiroArgs;
+
+// Píxel de origen de destino(x, y) y paso en bytes hacia el de destino(x + 1, y)
+static inline const unsigned char* origenGiro(const GiroArgs* g, int x, int y, ptrdiff_t* paso) {
+    int c = g->canales;
+    switch (g->cuartos) {
+        case 1:  // destino(x, y) = origen(y, alto - 1 - x)
+            *paso = -(ptrdiff_t)g->strideOrigen;
+            return FILA(g->pixelesOrigen, g->strideOrigen, g->altoOrigen - 1 - x) + y * c;
+        case 2:  // destino(x, y) = origen(ancho - 1 - x, alto - 1 - y)
+            *paso = -c;
+            return FILA(g->pixelesOrigen, g->strideOrigen, g->altoOrigen - 1 - y) + (g->anchoOrigen - 1 - x) * c;
+        default: // destino(x, y) = origen(ancho - 1 - y, x)
+            *paso = (ptrdiff_t)g->strideOrigen;
+            return FILA(g->pixelesOrigen, g->strideOrigen, x) + (g->anchoOrigen - 1 - y) * c;
+    }
+}
+
+// Reparte filas de bloques del destino
+void giroHilo(void* args, int inicio, int fin) {
+    GiroArgs* g = (GiroArgs*)args;
+    int c = g->canales;
+    for (int by = inicio; by < fin; by++) {
+        int y0 = by * BLOQUE_GIRO;
+        int y1 = (y0 + BLOQUE_GIRO < g->altoDestino) ? y0 + BLOQUE_GIRO : g->altoDestino;
+        for (int x0 = 0; x0 < g->anchoDestino; x0 += BLOQUE_GIRO) {
+            int x1 = (x0 + BLOQUE_GIRO < g->anchoDestino) ? x0 + BLOQUE_GIRO : g->anchoDestino;
+            for (int y = y0; y < y1; y++) {
+                ptrdiff_t paso;
+                const unsigned char* origen = origenGiro(g, x0, y, &paso);
+                unsigned char* destino = FILA(g->pixelesDestino, g->strideDestino, y) + x0 * c;
+                if (c == 1) {
+                    for (int x = x0; x < x1; x++, origen += paso) *destino++ = *origen;
+                } else {
+                    for (int x = x0; x < x1; x++, origen += paso, destino += 3) {
+                        destino[0] = origen[0]; destino[1] = origen[1]; destino[2] = origen[2];
+                    }
+                }
+            }
+        }
+    }
+}
+
+// Devuelve 0..3 si el ángulo es un múltiplo exacto de 90° (en cuartos de vuelta), o -1
+int cuartosDeVuelta(float angulo) {
+    float normalizado = fmodf(angulo, 360.0f);
+    if (normalizado < 0) normalizado += 360.0f;
+    if (normalizado != floorf(normalizado) || (int)normalizado % 90 != 0) return -1;
+    return ((int)normalizado / 90) % 4;
+}
+
+// Devuelve 0 si no hay memoria para el destino
+int girarImagenExacto(ImagenInfo* info, int cuartos) {
+    int anchoDestino = (cuartos == 2) ? info->ancho : info->alto;
+    int altoDestino = (cuartos == 2) ? info->alto : info->ancho;
+    size_t stride;
+    unsigned char* pixelesDestino = crearBufferPixeles(anchoDestino, altoDestino, info->canales, &stride);
+    if (!pixelesDestino) {
+        return 0;
+    }
+    
+    GiroArgs args;
+    args.pixelesOrigen = info->pixeles;
+    args.pixelesDestino = pixelesDestino;
+    args.strideOrigen = info->stride;
+    args.strideDestino = stride;
+    args.anchoOrigen = info->ancho;
+    args.altoOrigen = info->alto;
+    args.anchoDestino = anchoDestino;
+    args.altoDestino = altoDestino;
+    args.canales = info->canales;
+    args.cuartos = cuartos;
+    ejecutarEnPool(giroHilo, &args, (altoDestino + BLOQUE_GIRO - 1) / BLOQUE_GIRO);
+    
+    reemplazarPixeles(info, pixelesDestino, stride, anchoDestino, altoDestino, info->canales);
+    return 1;
+}
+
+int rotarImagenConcurrente(ImagenInfo* info, float angulo) {
+    if (!info->pixeles) {
+        printf("No hay imagen cargada.\n");
+        return 0;
+    }
+    
+    // Múltiplos de 90°: permutación exacta, sin interpolación ni bordes negros
+    int cuartos = cuartosDeVuelta(angulo);
+    if (cuartos == 0) {
+        INFORMAR("Rotación de %.1f°: la imagen no cambia.\n", angulo);
+        return 1;
+    }
+    if (cuartos > 0) {
+        if (!girarImagenExacto(info, cuartos)) {
+            return 0;
+        }
+        INFORMAR("Imagen rotada exactamente %.1f° con %d hilos (nueva dimensión: %dx%d) en imagen %s.\n",
+               angulo, hilosPool(), info->ancho, info->alto, info->canales == 1 ? "grises" : "RGB");
+        return 1;
+    }
+    
+    float radianes = angulo * M_PI / 180.0;
+    float cosAngulo = cos(radianes);
+    float sinAngulo = sin(radianes);
+    
+    // Calcular nuevas dimensiones
+    int anchoDestino = (int)(fabs(info->ancho * cosAngulo) + fabs(info->alto * sinAngulo)) + 1;
+    int altoDestino = (int)(fabs(info->ancho * sinAngulo) + fabs(info->alto * cosAngulo)) + 1;
+    
+    // Crear imagen destino
+    size_t stride;
+    unsigned char* pixelesDestino = crearBufferPixeles(anchoDestino, altoDestino, info->canales, &stride);
+    if (!pixelesDestino) {
+        return 0;
+    }
+    
+    // Repartir filas entre los hilos del pool
+    RotacionArgs args;
+    args.pixelesOrigen = info->pixeles;
+    args.pixelesDestino = pixelesDestino;
+    args.strideOrigen = info->stride;
+    args.strideDestino = stride;
+    args.cosAngulo = cosAngulo;
+    args.sinAngulo = sinAngulo;
+    args.anchoOrigen = info->ancho;
+    args.altoOrigen = info->alto;
+    args.anchoDestino = anchoDestino;
+    args.altoDestino = altoDestino;
+    args.canales = info->canales;
+    args.teselasX = (anchoDestino + TESELA_ROTACION - 1) / TESELA_ROTACION;
+    int teselasY = (altoDestino + TESELA_ROTACION - 1) / TESELA_ROTACION;
+    ejecutarEnPoolPorBloques(rotacionHilo, &args, args.teselasX * teselasY, 1);
+    
+    // Reemplazar imagen original
+    reemplazarPixeles(info, pixelesDestino, stride, anchoDestino, altoDestino, info->canales);
+    
+    INFORMAR("Imagen rotada concurrentemente %.1f° con %d hilos (nueva dimensión: %dx%d) en imagen %s.\n", 
+           angulo, hilosPool(), anchoDestino, altoDestino, info->canales == 1 ? "grises" : "RGB");
+    return 1;
+}
+
+// ==================== FUNCIÓN 3: DETECCIÓN DE BORDES ====================
+
+// Estructura para datos de hilos de detección de bordes
+typedef struct {
+    const unsigned char* pixelesOrigen;
+    unsigned char* pixelesDestino;
+    size_t strideOrigen;
+    size_t strideDestino;
+    int ancho;
+    int alto;
+    int canales;
+    const unsigned char* filaConstante; // Fila en grises del borde constante
+    unsigned char* direccionDestino;    // Dirección del gradiente (mismo stride que pixelesDestino) o NULL
+    int falloMemoria;                   // Algún hilo no pudo reservar su buffer: el destino está incompleto
+} BordesArgs;
+
+// Convierte una fila RGB a grises con el promedio entero de los tres canales
+void grisFila(const unsigned char* fila, unsigned char* gris, int ancho) {
+    for (int x = 0; x < ancho; x++) {
+        const unsigned char* p = fila + x * 3;
+        gris[x] = (p[0] + p[1] + p[2]) / 3;
+    }
+}
+
+// Fila y en grises según el modo de borde; en RGB se convierte en ranura
+static const unsigned char* filaGrisBordes(const BordesArgs* bArgs, int y, unsigned char* ranura) {
+    int py = indiceBorde(y, bArgs->alto);
+    if (py < 0) return bArgs->filaConstante;
+    const unsigned char* fila = FILA(bArgs->pixelesOrigen, bArgs->strideOrigen, py);
+    if (bArgs->canales == 1) return fila;
+    grisFila(fila, ranura, bArgs->ancho);
+    return ranura;
+}
+
+void bordesHilo(void* args, int inicio, int fin) {
+    BordesArgs* bArgs = (BordesArgs*)args;
+    int ancho = bArgs->ancho;
+    
+    // Anillo de tres filas en grises: la fila r ocupa la ranura (r - inicio + 1) % 3,
+    // así que cada fila del bloque se convierte una sola vez
+    unsigned char* grises = NULL;
+    if (bArgs->canales == 3) {
+        grises = (unsigned char*)malloc((size_t)ancho * 3);
+        if (!grises) {
+            fprintf(stderr, "Error de memoria en detección de bordes\n");
+            __atomic_store_n(&bArgs->falloMemoria, 1, __ATOMIC_RELAXED);
+            return;
+        }
+    }
+    
+    const unsigned char* ventana[3];
+    for (int k = 0; k < 2; k++) {
+        ventana[k] = filaGrisBordes(bArgs, inicio - 1 + k, grises ? grises + (size_t)k * ancho : NULL);
+    }
+    for (int y = inicio; y < fin; y++) {
+        int ranura = (y - inicio + 2) % 3;
+        ventana[2] = filaGrisBordes(bArgs, y + 1, grises ? grises + (size_t)ranura * ancho : NULL);
+        unsigned char* direccion = bArgs->direccionDestino ? FILA(bArgs->direccionDestino, bArgs->strideDestino, y) : NULL;
+        simd.sobelFila(ventana[0], ventana[1], ventana[2],
+                       FILA(bArgs->pixelesDestino, bArgs->strideDestino, y), direccion, ancho);
+        ventana[0] = ventana[1];
+        ventana[1] = ventana[2];
+    }
+    free(grises);
+}
+
+// Con direccion != NULL devuelve también en ella la dirección del gradiente
+int detectarBordesConcurrente(ImagenInfo* info, ImagenInfo* direccion) {
+    if (!info->pixeles) {
+        printf("No hay imagen cargada.\n");
+        return 0;
+    }
+    
+    // Crear imagen destino (siempre grayscale) y, si se pide, la de direcciones
+    int ok = 1;
+    unsigned char* filaConstante = crearFilaConstante(info->ancho, &ok);
+    size_t stride;
+    unsigned char* pixelesDestino = ok ? crearBufferPixeles(info->ancho, info->alto, 1, &stride) : NULL;
+    unsigned char* pixelesDireccion = NULL;
+    if (pixelesDestino && direccion) {
+        pixelesDireccion = crearBufferPixeles(info->ancho, info->alto, 1, &stride);
+        if (!pixelesDireccion) {
+            devolverBuffer(pixelesDestino, stride * (size_t)info->alto);
+            pixelesDestino = NULL;
+        }
+    }
+    if (!pixelesDestino) {
+        free(filaConstante);
+        return 0;
+    }
+    
+    // Repartir filas entre los hilos del pool
+    BordesArgs args;
+    args.pixelesOrigen = info->pixeles;
+    args.pixelesDestino = pixelesDestino;
+    args.strideOrigen = info->stride;
+    args.strideDestino = stride;
+    args.ancho = info->ancho;
+    args.alto = info->alto;
+    args.canales = info->canales;
+    args.filaConstante = filaConstante;
+    args.direccionDestino = pixelesDireccion;
+    args.falloMemoria = 0;
+    ejecutarEnPool(bordesHilo, &args, info->alto);
+    free(filaConstante);
+    if (args.falloMemoria) {
+        devolverBuffer(pixelesDestino, stride * (size_t)info->alto);
+        if (pixelesDireccion) devolverBuffer(pixelesDireccion, stride * (size_t)info->alto);
+        return 0;
+    }
+    
+    if (direccion) reemplazarPixeles(direccion, pixelesDireccion, stride, info->ancho, info->alto, 1);
+    
+    // Reemplazar imagen original (preservando dimensiones); resultado siempre grayscale
+    reemplazarPixeles(info, pixelesDestino, stride, info->ancho, info->alto, 1);
+    
+    INFORMAR("Detección de bordes aplicada concurrentemente con %d hilos (operador Sobel) - resultado: grayscale.\n", hilosPool());
+    return 1;
+}
+
+// ==================== FUNCIÓN 4: ESCALADO ====================
+
+// Las posiciones de origen y los pesos bilineales dependen solo de la columna
+// (o de la fila) destino, así que se calculan una vez en tablas. Los pesos van
+// en punto fijo sobre PESO_UNO: cada fila de origen se interpola primero en
+// horizontal a un buffer de enteros (escala PESO_UNO) y la mezcla vertical de
+// dos de esas filas es una suma de productos enteros. Las filas horizontales
+// se reutilizan entre filas destino consecutivas que comparten fila de origen.
+
+#define BITS_PESO 8
+#define PESO_UNO (1 << BITS_PESO)
+
+typedef struct {
+    int* desplazamiento0;    // Por columna destino: byte del píxel x0 en la fila de origen
+    int* desplazamiento1;    // Byte del píxel x1
+    unsigned short* pesoX;   // Peso de x1 (0..PESO_UNO)
+    int* fila0;              // Por fila destino: y0, y1 y peso de y1
+    int* fila1;
+    unsigned short* pesoY;
+} TablasEscalado;
+
+// Reducción por promedio de área: cada píxel destino cubre un rectángulo de
+// ratioX x ratioY píxeles de origen y es la media de todos ellos, ponderando
+// la fracción cubierta de los píxeles del borde. Por eje, cada posición
+// destino tiene su primer índice de origen y hasta maxCuenta pesos que suman 1.
+#define RATIO_MINIMO_AREA 2.0f // Se usa promedio de área si la reducción supera este factor
+
+typedef struct {
+    int* primero;
+    int* cuenta;
+    float* pesos;            // maxCuenta pesos por posición destino
+    int maxCuenta;
+} EjeArea;
+
+// Estructura para datos de hilos de escalado
+typedef struct {
+    const unsigned char* pixelesOrigen;
+    unsigned char* pixelesDestino;
+    size_t strideOrigen;
+    size_t strideDestino;
+    int anchoOrigen;
+    int altoOrigen;
+    int anchoDestino;
+    int altoDestino;
+    int canales;
+    TablasEscalado tablas;   // Modo bilineal
+    EjeArea areaX, areaY;    // Modo promedio de área
+    int falloMemoria;        // Algún hilo no pudo reservar su buffer: el destino está incompleto
+} EscaladoArgs;
+
+static void liberarTablasEscalado(TablasEscalado* t) {
+    free(t->desplazamiento0);
+    free(t->desplazamiento1);
+    free(t->pesoX);
+    free(t->fila0);
+    free(t->fila1);
+    free(t->pesoY);
+}
+
+// Índices y pesos de un eje: el destino i toma el origen i * ratio
+static void calcularEjeEscalado(int tamOrigen, int tamDestino, int* i0, int* i1, unsigned short* peso) {
+    float ratio = (float)tamOrigen / tamDestino;
+    for (int i = 0; i < tamDestino; i++) {
+        float origen = i * ratio;
+        int a = (int)origen;
+        i0[i] = a;
+        i1[i] = (a + 1 < tamOrigen) ? a + 1 : a;
+        peso[i] = (unsigned short)((origen - a) * PESO_UNO + 0.5f);
+    }
+}
+
+int crearTablasEscalado(TablasEscalado* t, int anchoOrigen, int altoOrigen,
+                        int anchoDestino, int altoDestino, int canales) {
+    t->desplazamiento0 = (int*)malloc(anchoDestino * sizeof(int));
+    t->desplazamiento1 = (int*)malloc(anchoDestino * sizeof(int));
+    t->pesoX = (unsigned short*)malloc(anchoDestino * sizeof(unsigned short));
+    t->fila0 = (int*)malloc(altoDestino * sizeof(int));
+    t->fila1 = (int*)malloc(altoDestino * sizeof(int));
+    t->pesoY = (unsigned short*)malloc(altoDestino * sizeof(unsigned short));
+    if (!t->desplazamiento0 || !t->desplazamiento1 || !t->pesoX || !t->fila0 || !t->fila1 || !t->pesoY) {
+        fprintf(stderr, "Error de memoria al crear las tablas de escalado\n");
+        liberarTablasEscalado(t);
+        return 0;
+    }
+    calcularEjeEscalado(anchoOrigen, anchoDestino, t->desplazamiento0, t->desplazamiento1, t->pesoX);
+    for (int x = 0; x < anchoDestino; x++) {
+        t->desplazamiento0[x] *= canales;
+        t->desplazamiento1[x] *= canales;
+    }
+    calcularEjeEscalado(altoOrigen, altoDestino, t->fila0, t->fila1, t->pesoY);
+    return 1;
+}
+
+// Interpola en horizontal una fila de origen; el resultado queda en escala PESO_UNO
+static void escaladoHorizontalFila(const EscaladoArgs* e, const unsigned char* fila, unsigned short* salida) {
+    const TablasEscalado* t = &e->tablas;
+    if (e->canales == 1) {
+        for (int x = 0; x < e->anchoDestino; x++) {
+            int w = t->pesoX[x];
+            salida[x] = (unsigned short)(fila[t->desplazamiento0[x]] * (PESO_UNO - w) + fila[t->desplazamiento1[x]] * w);
+        }
+    } else {
+        for (int x = 0; x < e->anchoDestino; x++) {
+            int w = t->pesoX[x];
+            const unsigned char* p0 = fila + t->desplazamiento0[x];
+            const unsigned char* p1 = fila + t->desplazamiento1[x];
+            unsigned short* s = salida + x * 3;
+            s[0] = (unsigned short)(p0[0] * (PESO_UNO - w) + p1[0] * w);
+            s[1] = (unsigned short)(p0[1] * (PESO_UNO - w) + p1[1] * w);
+            s[2] = (unsigned short)(p0[2] * (PESO_UNO - w) + p1[2] * w);
+        }
+    }
+}
+
+void escaladoHilo(void* args, int inicio, int fin) {
+    EscaladoArgs* eArgs = (EscaladoArgs*)args;
+    const TablasEscalado* t = &eArgs->tablas;
+    int n = eArgs->anchoDestino * eArgs->canales;
+    
+    // Dos filas interpoladas en horizontal y la fila de origen que contiene cada una
+    unsigned short* buffer = (unsigned short*)malloc((size_t)n * 2 * sizeof(unsigned short));
+    if (!buffer) {
+        fprintf(stderr, "Error de memoria en escalado\n");
+        __atomic_store_n(&eArgs->falloMemoria, 1, __ATOMIC_RELAXED);
+        return;
+    }
+    unsigned short* horizontal[2] = {buffer, buffer + n};
+    int filaCargada[2] = {-1, -1};
+    
+    for (int y = inicio; y < fin; y++) {
+        int y0 = t->fila0[y], y1 = t->fila1[y];
+        
+        // h0 tiene y0 y h1 tiene y1: se reutiliza lo ya interpolado (o se intercambia)
+        if (filaCargada[0] != y0 && filaCargada[1] == y0) {
+            unsigned short* temp = horizontal[0]; horizontal[0] = horizontal[1]; horizontal[1] = temp;
+            int tempFila = filaCargada[0]; filaCargada[0] = filaCargada[1]; filaCargada[1] = tempFila;
+        }
+        if (filaCargada[0] != y0) {
+            escaladoHorizontalFila(eArgs, FILA(eArgs->pixelesOrigen, eArgs->strideOrigen, y0), horizontal[0]);
+            filaCargada[0] = y0;
+        }
+        if (filaCargada[1] != y1) {
+            escaladoHorizontalFila(eArgs, FILA(eArgs->pixelesOrigen, eArgs->strideOrigen, y1), horizontal[1]);
+            filaCargada[1] = y1;
+        }
+        
+        const unsigned short* h0 = horizontal[0];
+        const unsigned short* h1 = horizontal[1];
+        unsigned int w1 = t->pesoY[y], w0 = PESO_UNO - w1;
+        unsigned char* filaDestino = FILA(eArgs->pixelesDestino, eArgs->strideDestino, y);
+        for (int i = 0; i < n; i++) {
+            filaDestino[i] = (unsigned char)((h0[i] * w0 + h1[i] * w1 + (1u << (2 * BITS_PESO - 1))) >> (2 * BITS_PESO));
+        }
+    }
+    free(buffer);
+}
+
+static void liberarEjeArea(EjeArea* eje) {
+    free(eje->primero);
+    free(eje->cuenta);
+    free(eje->pesos);
+}
+
+// Pesos de cobertura de un eje con tamOrigen >= tamDestino; devuelve 0 si no hay memoria
+int crearEjeArea(EjeArea* eje, int tamOrigen, int tamDestino) {
+    double ratio = (double)tamOrigen / tamDestino;
+    eje->maxCuenta = (int)ceil(ratio) + 1;
+    eje->primero = (int*)malloc(tamDestino * sizeof(int));
+    eje->cuenta = (int*)malloc(tamDestino * sizeof(int));
+    eje->pesos = (float*)malloc((size_t)tamDestino * eje->maxCuenta * sizeof(float));
+    if (!eje->primero || !eje->cuenta || !eje->pesos) {
+        fprintf(stderr, "Error de memoria al crear las tablas de escalado\n");
+        liberarEjeArea(eje);
+        return 0;
+    }
+    for (int i = 0; i < tamDestino; i++) {
+        double inicio = i * ratio, fin = (i + 1) * ratio;
+        int a = (int)inicio;
+        int b = (int)ceil(fin);
+        if (b > tamOrigen) b = tamOrigen;
+        eje->primero[i] = a;
+        eje->cuenta[i] = 0;
+        for (int k = a; k < b && eje->cuenta[i] < eje->maxCuenta; k++) {
+            double cubierto = ((k + 1 < fin) ? k + 1 : fin) - ((k > inicio) ? k : inicio);
+            eje->pesos[(size_t)i * eje->maxCuenta + eje->cuenta[i]++] = (float)(cubierto / ratio);
+        }
+    }
+    return 1;
+}
+
+// Reduce en horizontal una fila de origen con los pesos de cobertura de cada columna destino
+static void reducirFilaArea(const EscaladoArgs* e, const unsigned char* fila, float* salida) {
+    const EjeArea* ex = &e->areaX;
+    for (int x = 0; x < e->anchoDestino; x++) {
+        const float* pesos = ex->pesos + (size_t)x * ex->maxCuenta;
+        if (e->canales == 1) {
+            const unsigned char* p = fila + ex->primero[x];
+            float h = 0;
+            for (int j = 0; j < ex->cuenta[x]; j++) h += pesos[j] * p[j];
+            salida[x] = h;
+        } else {
+            const unsigned char* p = fila + ex->primero[x] * 3;
+            float h0 = 0, h1 = 0, h2 = 0;
+            for (int j = 0; j < ex->cuenta[x]; j++, p += 3) {
+                h0 += pesos[j] * p[0]; h1 += pesos[j] * p[1]; h2 += pesos[j] * p[2];
+            }
+            salida[x * 3] = h0; salida[x * 3 + 1] = h1; salida[x * 3 + 2] = h2;
+        }
+    }
+}
+
+void escaladoAreaHilo(void* args, int inicio, int fin) {
+    EscaladoArgs* eArgs = (EscaladoArgs*)args;
+    const EjeArea* ey = &eArgs->areaY;
+    int n = eArgs->anchoDestino * eArgs->canales;
+    
+    // Fila reducida en horizontal, la última fila reducida (la comparten dos filas
+    // destino cuando la cobertura es fraccionaria) y el acumulador de la fila destino
+    float* buffer = (float*)malloc((size_t)n * 3 * sizeof(float));
+    if (!buffer) {
+        fprintf(stderr, "Error de memoria en escalado\n");
+        __atomic_store_n(&eArgs->falloMemoria, 1, __ATOMIC_RELAXED);
         return;
     }
+    float* horizontal = buffer;
+    float* guardada = buffer + n;
+    float* acumulado = buffer + 2 * n;
+    int filaGuardada = -1;
+    
+    for (int y = inicio; y < fin; y++) {
+        memset(acumulado, 0, (size_t)n * sizeof(float));
+        for (int k = 0; k < ey->cuenta[y]; k++) {
+            int filaOrigen = ey->primero[y] + k;
+            const float* reducida = guardada;
+            if (filaOrigen != filaGuardada) {
+                reducirFilaArea(eArgs, FILA(eArgs->pixelesOrigen, eArgs->strideOrigen, filaOrigen), horizontal);
+                reducida = horizontal;
+                if (k == ey->cuenta[y] - 1) {
+                    float* temp = guardada; guardada = horizontal; horizontal = temp;
+                    filaGuardada = filaOrigen;
+                }
+            }
+            float wy = ey->pesos[(size_t)y * ey->maxCuenta + k];
+            for (int i = 0; i < n; i++) acumulado[i] += wy * reducida[i];
+        }
+        
+        unsigned char* filaDestino = FILA(eArgs->pixelesDestino, eArgs->strideDestino, y);
+        for (int i = 0; i < n; i++) {
+            int v = (int)(acumulado[i] + 0.5f);
+            filaDestino[i] = (v > 255) ? 255 : v;
+        }
+    }
+    free(buffer);
+}
+
+typedef enum {
+    ESCALADO_AUTO,       // Promedio de área si la reducción supera RATIO_MINIMO_AREA, si no bilineal
+    ESCALADO_BILINEAL,
+    ESCALADO_AREA        // Promedio de área en cualquier reducción (bilineal si algún eje se amplía)
+} ModoEscalado;
+
+// Escala info a un buffer nuevo sin tocar info; devuelve NULL si no hay memoria.
+// En *area indica si se usó promedio de área.
+unsigned char* escalarABuffer(const ImagenInfo* info, int nuevoAncho, int nuevoAlto, ModoEscalado modo,
+                              size_t* stride, int* area) {
+    unsigned char* pixelesDestino = crearBufferPixeles(nuevoAncho, nuevoAlto, info->canales, stride);
+    if (!pixelesDestino) {
+        return NULL;
+    }
+    
+    // Repartir filas entre los hilos del pool
+    EscaladoArgs args;
+    args.pixelesOrigen = info->pixeles;
+    args.pixelesDestino = pixelesDestino;
+    args.strideOrigen = info->stride;
+    args.strideDestino = *stride;
+    args.anchoOrigen = info->ancho;
+    args.altoOrigen = info->alto;
+    args.anchoDestino = nuevoAncho;
+    args.altoDestino = nuevoAlto;
+    args.canales = info->canales;
+    args.falloMemoria = 0;
+    
+    // Reducciones fuertes: promedio de área en una pasada (bilineal solo mira 2x2 y produce aliasing)
+    float ratioX = (float)info->ancho / nuevoAncho, ratioY = (float)info->alto / nuevoAlto;
+    *area = ratioX >= 1 && ratioY >= 1 && modo != ESCALADO_BILINEAL &&
+            (modo == ESCALADO_AREA || ratioX > RATIO_MINIMO_AREA || ratioY > RATIO_MINIMO_AREA);
+    if (*area) {
+        if (!crearEjeArea(&args.areaX, info->ancho, nuevoAncho)) {
+            devolverBuffer(pixelesDestino, *stride * (size_t)nuevoAlto);
+            return NULL;
+        }
+        if (!crearEjeArea(&args.areaY, info->alto, nuevoAlto)) {
+            liberarEjeArea(&args.areaX);
+            devolverBuffer(pixelesDestino, *stride * (size_t)nuevoAlto);
+            return NULL;
+        }
+        ejecutarEnPool(escaladoAreaHilo, &args, nuevoAlto);
+        liberarEjeArea(&args.areaX);
+        liberarEjeArea(&args.areaY);
+    } else {
+        if (!crearTablasEscalado(&args.tablas, info->ancho, info->alto, nuevoAncho, nuevoAlto, info->canales)) {
+            devolverBuffer(pixelesDestino, *stride * (size_t)nuevoAlto);
+            return NULL;
+        }
+        ejecutarEnPool(escaladoHilo, &args, nuevoAlto);
+        liberarTablasEscalado(&args.tablas);
+    }
+    if (args.falloMemoria) {
+        devolverBuffer(pixelesDestino, *stride * (size_t)nuevoAlto);
+        return NULL;
+    }
+    return pixelesDestino;
+}
+
+int escalarImagenModo(ImagenInfo* info, int nuevoAncho, int nuevoAlto, ModoEscalado modo) {
+    if (!info->pixeles) {
+        printf("No hay imagen cargada.\n");
+        return 0;
+    }
+    
+    if (nuevoAncho <= 0 || nuevoAlto <= 0) {
+        printf("Las dimensiones deben ser positivas.\n");
+        return 0;
+    }
+    
+    size_t stride;
+    int area;
+    unsigned char* pixelesDestino = escalarABuffer(info, nuevoAncho, nuevoAlto, modo, &stride, &area);
+    if (!pixelesDestino) {
+        return 0;
+    }
+    
+    // Reemplazar imagen original
+    int anchoOriginal = info->ancho;
+    int altoOriginal = info->alto;
+    reemplazarPixeles(info, pixelesDestino, stride, nuevoAncho, nuevoAlto, info->canales);
+    
+    INFORMAR("Imagen escalada concurrentemente con %d hilos (de %dx%d a %dx%d, %s) en imagen %s.\n", 
+           hilosPool(), anchoOriginal, altoOriginal, nuevoAncho, nuevoAlto,
+           area ? "promedio de área" : "bilineal", info->canales == 1 ? "grises" : "RGB");
+    return 1;
+}
+
+int escalarImagenConcurrente(ImagenInfo* info, int nuevoAncho, int nuevoAlto) {
+    return escalarImagenModo(info, nuevoAncho, nuevoAlto, ESCALADO_AUTO);
+}
+
+// ==================== MINIATURAS ====================
+
+// Varias miniaturas desde una sola decodificación. Los tamaños (lado mayor)
+// se generan de mayor a menor en cascada: cada nivel se reduce por promedio
+// de área desde el anterior, no desde el original. Después los PNG de todos
+// los niveles se codifican en paralelo, uno por hilo.
+
+#define MAX_MINIATURAS 16
+
+typedef struct {
+    ImagenInfo* niveles;
+    char (*rutas)[4096];
+} MiniaturasArgs;
+
+void guardarMiniaturaHilo(void* args, int inicio, int fin) {
+    MiniaturasArgs* mArgs = (MiniaturasArgs*)args;
+    for (int i = inicio; i < fin; i++) {
+        if (!guardarPNG(&mArgs->niveles[i], mArgs->rutas[i])) {
+            liberarImagen(&mArgs->niveles[i]); // Marca el fallo
+        }
+    }
+}
+
+// Ruta de la miniatura: "salida.png" con lado 256 da "salida_256.png"
+void rutaMiniatura(const char* rutaBase, int lado, char* ruta, size_t tam) {
+    const char* barra = strrchr(rutaBase, '/');
+    const char* punto = strrchr(rutaBase, '.');
+    int largo = (punto && (!barra || punto > barra)) ? (int)(punto - rutaBase) : (int)strlen(rutaBase);
+    snprintf(ruta, tam, "%.*s_%d.png", largo, rutaBase, lado);
+}
+
+static int compararEnterosDesc(const void* a, const void* b) {
+    return *(const int*)b - *(const int*)a;
+}
+
+// Genera y guarda una miniatura por lado pedido; devuelve 0 si alguna falla
+int generarMiniaturas(const ImagenInfo* info, const int* lados, int numLados, const char* rutaBase) {
+    if (!info->pixeles) {
+        printf("No hay imagen cargada.\n");
+        return 0;
+    }
+    
+    // Lados de mayor a menor y sin repetir: dos iguales irían al mismo archivo
+    // desde hilos distintos
+    int orden[MAX_MINIATURAS];
+    memcpy(orden, lados, numLados * sizeof(int));
+    qsort(orden, numLados, sizeof(int), compararEnterosDesc);
+    int unicos = 0;
+    for (int i = 0; i < numLados; i++) {
+        if (unicos == 0 || orden[i] != orden[unicos - 1]) orden[unicos++] = orden[i];
+    }
+    numLados = unicos;
+    
+    ImagenInfo niveles[MAX_MINIATURAS];
+    char rutas[MAX_MINIATURAS][4096];
+    memset(niveles, 0, sizeof(niveles));
+    int ok = 1;
+    const ImagenInfo* anterior = info;
+    for (int i = 0; i < numLados && ok; i++) {
+        int mayor = (info->ancho > info->alto) ? info->ancho : info->alto;
+        float escala = (orden[i] < mayor) ? (float)orden[i] / mayor : 1.0f; // Nunca se amplía
+        int ancho = (int)(info->ancho * escala + 0.5f), alto = (int)(info->alto * escala + 0.5f);
+        if (ancho < 1) ancho = 1;
+        if (alto < 1) alto = 1;
+        
+        if (ancho == anterior->ancho && alto == anterior->alto) {
+            ok = copiarImagen(anterior, &niveles[i]);
+        } else {
+            size_t stride;
+            int area;
+            unsigned char* pixeles = escalarABuffer(anterior, ancho, alto, ESCALADO_AREA, &stride, &area);
+            ok = pixeles != NULL;
+            if (ok) reemplazarPixeles(&niveles[i], pixeles, stride, ancho, alto, info->canales);
+        }
+        rutaMiniatura(rutaBase, orden[i], rutas[i], sizeof(rutas[i]));
+        anterior = &niveles[i];
+    }
+    
+    if (ok) {
+        MiniaturasArgs args = {niveles, rutas};
+        ejecutarEnPoolPorBloques(guardarMiniaturaHilo, &args, numLados, 1);
+        for (int i = 0; i < numLados; i++) ok = ok && niveles[i].pixeles != NULL;
+    }
+    for (int i = 0; i < numLados; i++) liberarImagen(&niveles[i]);
+    
+    if (ok) {
+        INFORMAR("%d miniaturas generadas en cascada y guardadas en paralelo con %d hilos.\n", numLados, hilosPool());
+    }
+    return ok;
+}
+
+// ==================== PIPELINE (LÍNEA DE COMANDOS) ====================
+
+// Secuencia de operaciones que se ejecuta sin el menú, p. ej.:
+//   img_final -i in.png --desenfoque 5,1.0 --rotar 90 --escalar 800x600 -o out.png
+
+#define MAX_OPERACIONES 64
+#define MAX_PUNTUALES 32
+
+typedef enum {
+    OP_BRILLO,
+    OP_PUNTUAL,
+    OP_DESENFOQUE,
+    OP_ROTAR,
+    OP_BORDES,
+    OP_ESCALAR,
+    OP_MINIATURAS           // Solo como última operación: sustituye al guardado
+} TipoOperacion;
+
+typedef struct {
+    TipoOperacion tipo;
+    int entero1, entero2;   // Delta de brillo, tamaño de kernel o nuevas dimensiones
+    float real;             // Sigma o ángulo
+    int numPuntuales;
+    OperacionPuntual puntuales[MAX_PUNTUALES];
+    int numLados;           // Lados mayores de las miniaturas
+    int lados[MAX_MINIATURAS];
+} Operacion;
+
+typedef struct {
+    Operacion ops[MAX_OPERACIONES];
+    int numOps;
+} Pipeline;
+
+typedef struct {
+    const char* opcion;
+    const char* alias;
+    TipoOperacion tipo;
+    const char* argumento;  // NULL si la opción no lleva valor
+} OpcionOperacion;
+
+static const OpcionOperacion opcionesOperacion[] = {
+    {"--brillo",     "--brightness", OP_BRILLO,     "DELTA"},
+    {"--puntual",    "--point",      OP_PUNTUAL,    "OP1,OP2,..."},
+    {"--desenfoque", "--blur",       OP_DESENFOQUE, "TAM,SIGMA"},
+    {"--rotar",      "--rotate",     OP_ROTAR,      "GRADOS"},
+    {"--bordes",     "--sobel",      OP_BORDES,     NULL},
+    {"--escalar",    "--resize",     OP_ESCALAR,    "ANCHOxALTO"},
+    {"--miniaturas", "--thumbnails", OP_MINIATURAS, "L1,L2,..."},
+};
+
+#define NUM_OPCIONES_OPERACION (int)(sizeof(opcionesOperacion) / sizeof(opcionesOperacion[0]))
+
+// Devuelve la opción de operación con ese nombre, o NULL
+const OpcionOperacion* buscarOpcionOperacion(const char* nombre) {
+    for (int i = 0; i < NUM_OPCIONES_OPERACION; i++) {
+        if (strcmp(nombre, opcionesOperacion[i].opcion) == 0 ||
+            strcmp(nombre, opcionesOperacion[i].alias) == 0) {
+            return &opcionesOperacion[i];
+        }
+    }
+    return NULL;
+}
+
+// Nombre de la operación sin guiones (para las estadísticas)
+const char* nombreOperacion(TipoOperacion tipo) {
+    for (int i = 0; i < NUM_OPCIONES_OPERACION; i++) {
+        if (opcionesOperacion[i].tipo == tipo) return opcionesOperacion[i].opcion + 2;
+    }
+    return "?";
+}
+
+// Interpreta el valor de una operación; devuelve 0 si no es válido
+int parsearOperacion(TipoOperacion tipo, const char* valor, Operacion* op) {
+    int usados = 0;
+    memset(op, 0, sizeof(*op));
+    op->tipo = tipo;
+    switch (tipo) {
+        case OP_BRILLO:
+            return sscanf(valor, "%d%n", &op->entero1, &usados) == 1 && valor[usados] == '\0';
+        case OP_PUNTUAL:
+            op->numPuntuales = parsearCadenaPuntual(valor, op->puntuales, MAX_PUNTUALES);
+            return op->numPuntuales > 0;
+        case OP_DESENFOQUE:
+            return sscanf(valor, "%d,%f%n", &op->entero1, &op->real, &usados) == 2 && valor[usados] == '\0' &&
+                   op->entero1 >= 0 && op->entero1 <= MAX_TAM_KERNEL;
+        case OP_ROTAR:
+            return sscanf(valor, "%f%n", &op->real, &usados) == 1 && valor[usados] == '\0';
+        case OP_BORDES:
+            return 1;
+        case OP_ESCALAR:
+            return sscanf(valor, "%dx%d%n", &op->entero1, &op->entero2, &usados) == 2 && valor[usados] == '\0';
+        case OP_MINIATURAS:
+            while (*valor) {
+                if (op->numLados == MAX_MINIATURAS ||
+                    sscanf(valor, "%d%n", &op->lados[op->numLados], &usados) != 1 || op->lados[op->numLados] < 1) {
+                    return 0;
+                }
+                op->numLados++;
+                valor += usados;
+                if (*valor == ',') valor++;
+                else if (*valor) return 0;
+            }
+            return op->numLados > 0;
+    }
+    return 0;
+}
+
+// Ejecuta una operación sobre la imagen; devuelve 0 si falla
+int ejecutarOperacion(ImagenInfo* info, const Operacion* op) {
+    switch (op->tipo) {
+        case OP_BRILLO:
+            return ajustarBrilloConcurrente(info, op->entero1);
+        case OP_PUNTUAL:
+            return aplicarOperacionesPuntuales(info, op->puntuales, op->numPuntuales);
+        case OP_DESENFOQUE:
+            if (op->entero1 == 0) return aplicarDesenfoqueRecursivo(info, op->real);
+            return aplicarConvolucionConcurrente(info, op->entero1, op->real);
+        case OP_ROTAR:
+            return rotarImagenConcurrente(info, op->real);
+        case OP_BORDES:
+            return detectarBordesConcurrente(info, NULL);
+        case OP_ESCALAR:
+            return escalarImagenConcurrente(info, op->entero1, op->entero2);
+        case OP_MINIATURAS:
+            fprintf(stderr, "--miniaturas debe ser la última operación\n");
+            return 0;
+    }
+    return 0;
+}
+
+// ==================== FUSIÓN DE OPERACIONES ====================
+
+// Un tramo de operaciones consecutivas de vecindad (desenfoque Gaussiano,
+// Sobel) y puntuales se evalúa como un grafo lineal sin materializar imágenes
+// intermedias. Las operaciones puntuales se componen en tablas que se aplican
+// a cada fila justo después de producirla (o, al principio del tramo, al leer
+// la entrada). Las de vecindad se ejecutan por franjas de filas del tamaño de
+// la caché: para cada franja de la salida se calcula qué filas necesita cada
+// etapa (su radio más el de las siguientes) y la franja recorre toda la cadena
+// en buffers privados del hilo, sin volver a memoria entre operaciones. Las
+// filas del halo se recalculan en las franjas vecinas; el resultado es el
+// mismo que ejecutando las operaciones una a una.
+
+#define TAM_FRANJA_FUSION (256 * 1024) // Bytes de trabajo por franja (cabe en L2)
+#define ALTO_MINIMO_FRANJA_FUSION 8
+
+static int fusionHabilitada = 1; // --sin-fusion la desactiva
+
+typedef struct {
+    int activa;
+    int esDesplazamiento;    // Brillo puro: sumas saturadas en lugar de la tabla
+    int delta;
+    unsigned char lut[256];
+} TablaFila;
+
+typedef enum {
+    ETAPA_CONVOLUCION,
+    ETAPA_SOBEL
+} TipoEtapa;
+
+typedef struct {
+    TipoEtapa tipo;
+    int radio;               // Filas de vecindad por encima y por debajo
+    int canalesEntrada;
+    int canalesSalida;
+    KernelConvolucion kernel; // Convolución
+    unsigned char* filaConstante; // Entrada fuera de la imagen con borde constante (intermedia o en grises)
+    TablaFila tablaSalida;   // Puntuales posteriores, aplicadas a cada fila producida
+} EtapaFusion;
+
+typedef struct {
+    const ImagenInfo* origen;
+    unsigned char* destino;
+    size_t strideDestino;
+    TablaFila tablaEntrada;  // Puntuales anteriores a la primera etapa
+    EtapaFusion etapas[MAX_OPERACIONES];
+    int numEtapas;
+    int altoFranja;
+    int ancho;
+    int alto;
+    int falloMemoria;        // Algún hilo no pudo reservar sus buffers: el destino está incompleto
+} FusionArgs;
+
+// 1 si la operación puede formar parte de un tramo fusionado. Con bordes
+// envolventes las filas de arriba dependen de las de abajo y las franjas no son locales;
+// la dirección de Sobel solo la calcula detectarBordesConcurrente.
+int esFusionable(const Operacion* op) {
+    switch (op->tipo) {
+        case OP_BRILLO:
+        case OP_PUNTUAL:
+            return 1;
+        case OP_BORDES:
+            return opcionesBorde.modo != BORDE_ENVOLVER && !opcionesSobel.rutaDireccion;
+        case OP_DESENFOQUE:
+            return op->entero1 >= 3 && op->entero1 % 2 == 1 && op->real > 0 && // El IIR no
+                   opcionesBorde.modo != BORDE_ENVOLVER;
+        default:
+            return 0;
+    }
+}
+
+// Compone la operación puntual op detrás de la tabla t
+static void agregarPuntual(TablaFila* t, const Operacion* op) {
+    unsigned char lut[256];
+    if (op->tipo == OP_BRILLO) {
+        OperacionPuntual brillo = {PUNTUAL_BRILLO, (float)op->entero1, 0, 0, 0};
+        construirLUT(&brillo, lut);
+    } else {
+        componerLUT(op->puntuales, op->numPuntuales, lut);
+    }
+    if (!t->activa) {
+        for (int i = 0; i < 256; i++) t->lut[i] = i;
+        t->activa = 1;
+    }
+    for (int i = 0; i < 256; i++) t->lut[i] = lut[t->lut[i]];
+    t->esDesplazamiento = lutEsDesplazamiento(t->lut, &t->delta);
+}
+
+static inline void aplicarTablaFila(const TablaFila* t, unsigned char* fila, int n) {
+    if (t->esDesplazamiento) {
+        if (t->delta != 0) simd.brilloFila(fila, n, t->delta);
+    } else {
+        simd.lutFila(fila, n, t->lut);
+    }
+}
+
+// Buffers de trabajo de un hilo, dimensionados para la franja más alta
+typedef struct {
+    unsigned char* entrada;              // Filas de entrada con la tabla de entrada aplicada
+    unsigned char* salidas[MAX_OPERACIONES];
+    unsigned char* intermedio;           // Pasada horizontal de la convolución
+    unsigned char* grises;               // Entrada de Sobel convertida a grises
+    const unsigned char** filasGris;
+    const void** filasKernel;            // Ventana vertical de la convolución (tam filas)
+} ScratchFusion;
+
+// Filas de salida que necesita como máximo la etapa s (franja más halos de las siguientes)
+static int filasSalidaEtapa(const FusionArgs* f, int s) {
+    int filas = f->altoFranja;
+    for (int t = s + 1; t < f->numEtapas; t++) filas += 2 * f->etapas[t].radio;
+    return filas;
+}
+
+void fusionHilo(void* args, int inicio, int fin) {
+    FusionArgs* f = (FusionArgs*)args;
+    int ancho = f->ancho, alto = f->alto, S = f->numEtapas;
+    ScratchFusion sc;
+    memset(&sc, 0, sizeof(sc));
+    
+    // Reserva única por llamada para todas las franjas [inicio, fin)
+    int ok = 1;
+    size_t maxIntermedio = 0, maxGrises = 0;
+    int maxTam = 0;
+    for (int s = 0; s < S; s++) {
+        const EtapaFusion* e = &f->etapas[s];
+        size_t filasEntrada = (size_t)filasSalidaEtapa(f, s) + 2 * e->radio;
+        if (s < S - 1) {
+            sc.salidas[s] = (unsigned char*)malloc((size_t)filasSalidaEtapa(f, s) * ancho * e->canalesSalida);
+            ok = ok && sc.salidas[s];
+        }
+        if (e->tipo == ETAPA_CONVOLUCION) {
+            size_t n = filasEntrada * ancho * e->canalesEntrada * e->kernel.bytesMuestra;
+            if (n > maxIntermedio) maxIntermedio = n;
+            if (e->kernel.tam > maxTam) maxTam = e->kernel.tam;
+        } else if (filasEntrada > maxGrises) {
+            maxGrises = filasEntrada;
+        }
+    }
+    if (f->tablaEntrada.activa) {
+        size_t filasEntrada = (size_t)filasSalidaEtapa(f, 0) + 2 * f->etapas[0].radio;
+        sc.entrada = (unsigned char*)malloc(filasEntrada * ancho * f->origen->canales);
+        ok = ok && sc.entrada;
+    }
+    if (maxIntermedio) {
+        sc.intermedio = (unsigned char*)malloc(maxIntermedio);
+        sc.filasKernel = (const void**)malloc(maxTam * sizeof(void*));
+        ok = ok && sc.intermedio && sc.filasKernel;
+    }
+    if (maxGrises) {
+        sc.grises = (unsigned char*)malloc(maxGrises * ancho);
+        sc.filasGris = (const unsigned char**)malloc(maxGrises * sizeof(unsigned char*));
+        ok = ok && sc.grises && sc.filasGris;
+    }
+    if (!ok) {
+        fprintf(stderr, "Error de memoria en la ejecución fusionada\n");
+        __atomic_store_n(&f->falloMemoria, 1, __ATOMIC_RELAXED);
+    }
+    
+    for (int franja = inicio; franja < fin && ok; franja++) {
+        // Rango de filas [a[s], b[s]) que produce cada etapa para esta franja
+        int a[MAX_OPERACIONES], b[MAX_OPERACIONES];
+        a[S - 1] = franja * f->altoFranja;
+        b[S - 1] = (a[S - 1] + f->altoFranja < alto) ? a[S - 1] + f->altoFranja : alto;
+        for (int s = S - 1; s > 0; s--) {
+            int r = f->etapas[s].radio;
+            a[s - 1] = (a[s] - r > 0) ? a[s] - r : 0;
+            b[s - 1] = (b[s] + r < alto) ? b[s] + r : alto;
+        }
+        int r0 = f->etapas[0].radio;
+        int aEntrada = (a[0] - r0 > 0) ? a[0] - r0 : 0;
+        int bEntrada = (b[0] + r0 < alto) ? b[0] + r0 : alto;
+        
+        // Tabla de entrada: se aplica a una copia de las filas de origen de la franja
+        int nOrigen = ancho * f->origen->canales;
+        if (sc.entrada) {
+            for (int y = aEntrada; y < bEntrada; y++) {
+                unsigned char* fila = sc.entrada + (size_t)(y - aEntrada) * nOrigen;
+                memcpy(fila, FILA(f->origen->pixeles, f->origen->stride, y), nOrigen);
+                aplicarTablaFila(&f->tablaEntrada, fila, nOrigen);
+            }
+        }
+        
+        for (int s = 0; s < S; s++) {
+            const EtapaFusion* e = &f->etapas[s];
+            int nEntrada = ancho * e->canalesEntrada, nSalida = ancho * e->canalesSalida;
+            int inA = (s == 0) ? aEntrada : a[s - 1];
+            int inB = (s == 0) ? bEntrada : b[s - 1];
+            
+            // Fila y de la entrada de la etapa (origen, copia con tabla o salida de la anterior)
+            #define FILA_ENTRADA(y) ((s > 0) ? sc.salidas[s - 1] + (size_t)((y) - inA) * nEntrada : \
+                                     sc.entrada ? sc.entrada + (size_t)((y) - inA) * nEntrada : \
+                                     FILA(f->origen->pixeles, f->origen->stride, (y)))
+            #define FILA_SALIDA(y) ((s == S - 1) ? FILA(f->destino, f->strideDestino, (y)) : \
+                                    sc.salidas[s] + (size_t)((y) - a[s]) * nSalida)
+            
+            if (e->tipo == ETAPA_CONVOLUCION) {
+                size_t bytesIntermedio = (size_t)nEntrada * e->kernel.bytesMuestra;
+                for (int y = inA; y < inB; y++) {
+                    convolucionFilaH(&e->kernel, FILA_ENTRADA(y), sc.intermedio + (size_t)(y - inA) * bytesIntermedio,
+                                     ancho, e->canalesEntrada);
+                }
+                for (int y = a[s]; y < b[s]; y++) {
+                    for (int k = 0; k < e->kernel.tam; k++) {
+                        int py = indiceBorde(y + k - e->radio, alto);
+                        sc.filasKernel[k] = (py < 0) ? e->filaConstante : sc.intermedio + (size_t)(py - inA) * bytesIntermedio;
+                    }
+                    convolucionFilaV(&e->kernel, sc.filasKernel, FILA_SALIDA(y), nSalida);
+                }
+            } else {
+                // Cada fila de entrada se pasa a grises una sola vez por franja
+                for (int y = inA; y < inB; y++) {
+                    if (e->canalesEntrada == 3) {
+                        unsigned char* gris = sc.grises + (size_t)(y - inA) * ancho;
+                        grisFila(FILA_ENTRADA(y), gris, ancho);
+                        sc.filasGris[y - inA] = gris;
+                    } else {
+                        sc.filasGris[y - inA] = FILA_ENTRADA(y);
+                    }
+                }
+                for (int y = a[s]; y < b[s]; y++) {
+                    int arriba = indiceBorde(y - 1, alto), abajo = indiceBorde(y + 1, alto);
+                    simd.sobelFila((arriba < 0) ? e->filaConstante : sc.filasGris[arriba - inA], sc.filasGris[y - inA],
+                                   (abajo < 0) ? e->filaConstante : sc.filasGris[abajo - inA], FILA_SALIDA(y), NULL, ancho);
+                }
+            }
+            if (e->tablaSalida.activa) {
+                for (int y = a[s]; y < b[s]; y++) aplicarTablaFila(&e->tablaSalida, FILA_SALIDA(y), nSalida);
+            }
+            #undef FILA_ENTRADA
+            #undef FILA_SALIDA
+        }
+    }
     
-    if (tamKernel % 2 == 0 || tamKernel < 3) {
-        printf("El tamaño del kernel debe ser impar y mayor o igual a 3.\n");
-        return;
+    for (int s = 0; s < S; s++) free(sc.salidas[s]);
+    free(sc.entrada);
+    free(sc.intermedio);
+    free(sc.grises);
+    free(sc.filasGris);
+    free(sc.filasKernel);
+}
+
+// Ejecuta ops[0..numOps), todas fusionables, sin imágenes intermedias
+int ejecutarTramoFusionado(ImagenInfo* info, const Operacion* ops, int numOps) {
+    if (!info->pixeles) {
+        printf("No hay imagen cargada.\n");
+        return 0;
     }
     
-    if (sigma <= 0) {
-        printf("El valor de sigma debe ser positivo.\n");
-        return;
+    FusionArgs* f = (FusionArgs*)calloc(1, sizeof(FusionArgs));
+    if (!f) return 0;
+    f->origen = info;
+    f->ancho = info->ancho;
+    f->alto = info->alto;
+    
+    // Grafo lineal: cada operación de vecindad es una etapa; las puntuales se
+    // pegan a la salida de la etapa anterior (o a la entrada del tramo)
+    int canales = info->canales, ok = 1;
+    for (int i = 0; i < numOps && ok; i++) {
+        const Operacion* op = &ops[i];
+        if (op->tipo == OP_BRILLO || op->tipo == OP_PUNTUAL) {
+            agregarPuntual(f->numEtapas ? &f->etapas[f->numEtapas - 1].tablaSalida : &f->tablaEntrada, op);
+            continue;
+        }
+        EtapaFusion* e = &f->etapas[f->numEtapas++];
+        e->canalesEntrada = canales;
+        if (op->tipo == OP_DESENFOQUE) {
+            e->tipo = ETAPA_CONVOLUCION;
+            e->radio = op->entero1 / 2;
+            ok = crearKernelConvolucion(&e->kernel, op->entero1, op->real);
+            if (ok) e->filaConstante = crearFilaIntermediaConstante(&e->kernel, info->ancho, canales, &ok);
+        } else {
+            e->tipo = ETAPA_SOBEL;
+            e->radio = 1;
+            e->filaConstante = crearFilaConstante(info->ancho, &ok);
+            canales = 1;
+        }
+        e->canalesSalida = canales;
     }
     
-    // Generar kernel Gaussiano
-    float** kernel = generarKernelGaussiano(tamKernel, sigma);
-    if (!kernel) return;
+    if (ok && f->numEtapas == 0) {
+        // Solo puntuales: una tabla compuesta en una pasada sobre la imagen
+        if (f->tablaEntrada.activa) aplicarLUTConcurrente(info, f->tablaEntrada.lut);
+    } else if (ok) {
+        // Alto de franja: que los buffers de todas las etapas quepan en TAM_FRANJA_FUSION,
+        // sin bajar de ALTO_MINIMO_FRANJA_FUSION ni del doble del halo acumulado
+        size_t bytesFila = 0;
+        int halo = 0;
+        for (int s = 0; s < f->numEtapas; s++) {
+            const EtapaFusion* e = &f->etapas[s];
+            bytesFila += (size_t)info->ancho * e->canalesSalida;
+            bytesFila += (size_t)info->ancho * e->canalesEntrada *
+                         ((e->tipo == ETAPA_CONVOLUCION) ? e->kernel.bytesMuestra : (e->canalesEntrada == 3));
+            halo += e->radio;
+        }
+        int altoFranja = (int)(TAM_FRANJA_FUSION / bytesFila);
+        if (altoFranja < ALTO_MINIMO_FRANJA_FUSION) altoFranja = ALTO_MINIMO_FRANJA_FUSION;
+        if (altoFranja < 2 * halo) altoFranja = 2 * halo;
+        if (altoFranja > info->alto) altoFranja = info->alto;
+        f->altoFranja = altoFranja;
+        
+        f->destino = crearBufferPixeles(info->ancho, info->alto, canales, &f->strideDestino);
+        ok = f->destino != NULL;
+        if (ok) {
+            int numFranjas = (info->alto + altoFranja - 1) / altoFranja;
+            ejecutarEnPool(fusionHilo, f, numFranjas);
+            ok = !f->falloMemoria;
+            if (ok) reemplazarPixeles(info, f->destino, f->strideDestino, info->ancho, info->alto, canales);
+            else devolverBuffer(f->destino, f->strideDestino * (size_t)info->alto);
+        }
+    }
     
-    // Crear imagen destino
-    unsigned char*** pixelesDestino = (unsigned char***)malloc(info->alto * sizeof(unsigned char**));
-    if (!pixelesDestino) {
-        fprintf(stderr, "Error de memoria al asignar imagen destino\n");
-        for (int i = 0; i < tamKernel; i++) free(kernel[i]);
-        free(kernel);
-        return;
+    if (ok) {
+        INFORMAR("%d operaciones fusionadas en %d etapas por franjas de %d filas con %d hilos en imagen %s.\n",
+               numOps, f->numEtapas, f->altoFranja ? f->altoFranja : info->alto, hilosPool(),
+               info->canales == 1 ? "grises" : "RGB");
+    }
+    for (int s = 0; s < f->numEtapas; s++) {
+        liberarKernelConvolucion(&f->etapas[s].kernel);
+        free(f->etapas[s].filaConstante);
+    }
+    free(f);
+    return ok;
+}
+
+// 1 si el pipeline termina generando miniaturas en lugar de una sola salida
+int terminaEnMiniaturas(const Pipeline* pipeline) {
+    return pipeline->numOps > 0 && pipeline->ops[pipeline->numOps - 1].tipo == OP_MINIATURAS;
+}
+
+// Sobel con --sobel-direccion: el núcleo devuelve la dirección y se guarda
+// aquí; si no se puede guardar, la operación falla
+static int detectarBordesGuardandoDireccion(ImagenInfo* info, const char* ruta) {
+    ImagenInfo direccion = {0, 0, 0, 0, NULL};
+    int ok = detectarBordesConcurrente(info, &direccion) && guardarImagen(&direccion, ruta);
+    liberarImagen(&direccion);
+    return ok;
+}
+
+// Ejecuta las operaciones en orden; se detiene en la primera que falla
+int ejecutarPipeline(ImagenInfo* info, const Pipeline* pipeline) {
+    int numOps = pipeline->numOps - terminaEnMiniaturas(pipeline);
+    for (int i = 0; i < numOps; i++) {
+        // Tramo de operaciones fusionables que empieza en i
+        int j = i;
+        while (fusionHabilitada && j < numOps && esFusionable(&pipeline->ops[j])) j++;
+        
+        MedicionOperacion m;
+        char nombre[256] = "";
+        int ok;
+        if (j - i >= 2) {
+            for (int k = i; k < j; k++) {
+                size_t usado = strlen(nombre);
+                snprintf(nombre + usado, sizeof(nombre) - usado, "%s%s", k > i ? "+" : "",
+                         nombreOperacion(pipeline->ops[k].tipo));
+            }
+            iniciarMedicion(&m, nombre);
+            ok = ejecutarTramoFusionado(info, &pipeline->ops[i], j - i);
+            terminarMedicion(&m, info, ok);
+            if (!ok) {
+                fprintf(stderr, "Fallaron las operaciones %d a %d del pipeline\n", i + 1, j);
+                return 0;
+            }
+            i = j - 1;
+            continue;
+        }
+        
+        iniciarMedicion(&m, nombreOperacion(pipeline->ops[i].tipo));
+        if (pipeline->ops[i].tipo == OP_BORDES && opcionesSobel.rutaDireccion) {
+            ok = detectarBordesGuardandoDireccion(info, opcionesSobel.rutaDireccion);
+        } else {
+            ok = ejecutarOperacion(info, &pipeline->ops[i]);
+        }
+        terminarMedicion(&m, info, ok);
+        if (!ok) {
+            fprintf(stderr, "Falló la operación %d del pipeline\n", i + 1);
+            return 0;
+        }
+    }
+    return 1;
+}
+
+// ---- Evaluación diferida en el menú ----
+
+// Las operaciones fusionables del menú no se ejecutan al elegirlas: se anotan
+// en un pipeline pendiente que se evalúa (fusionado) al mostrar o guardar la
+// imagen o antes de una operación que no se puede fusionar.
+
+// Ejecuta las operaciones pendientes y vacía la lista; si alguna falla lo
+// informa y devuelve 0 (la imagen queda con las anteriores a la que falló)
+int materializarPendientes(ImagenInfo* info, Pipeline* pendientes) {
+    if (pendientes->numOps == 0) return 1;
+    int ok = ejecutarPipeline(info, pendientes);
+    pendientes->numOps = 0;
+    if (!ok) printf("No se pudieron aplicar las operaciones pendientes; se cancela la acción.\n");
+    return ok;
+}
+
+void registrarPendiente(ImagenInfo* info, Pipeline* pendientes, const Operacion* op) {
+    if (pendientes->numOps == MAX_OPERACIONES && !materializarPendientes(info, pendientes)) return;
+    pendientes->ops[pendientes->numOps++] = *op;
+    printf("Operación registrada (%d pendientes); se aplicará al mostrar o guardar la imagen.\n",
+           pendientes->numOps);
+}
+
+// Guarda el resultado en salida o, si el pipeline termina en miniaturas, una por lado
+int guardarResultadoPipeline(const ImagenInfo* info, const Pipeline* pipeline, const char* salida) {
+    MedicionOperacion m;
+    int ok;
+    if (terminaEnMiniaturas(pipeline)) {
+        const Operacion* op = &pipeline->ops[pipeline->numOps - 1];
+        iniciarMedicion(&m, nombreOperacion(OP_MINIATURAS));
+        ok = generarMiniaturas(info, op->lados, op->numLados, salida);
+    } else {
+        iniciarMedicion(&m, "guardar");
+        ok = guardarImagen(info, salida);
+    }
+    terminarMedicion(&m, info, ok);
+    return ok;
+}
+
+// cargarImagen con medición
+int cargarImagenMedida(const char* ruta, ImagenInfo* info) {
+    MedicionOperacion m;
+    iniciarMedicion(&m, "cargar");
+    int ok = cargarImagen(ruta, info);
+    terminarMedicion(&m, info, ok);
+    return ok;
+}
+
+// guardarImagen con medición
+int guardarImagenMedida(const ImagenInfo* info, const char* ruta) {
+    MedicionOperacion m;
+    iniciarMedicion(&m, "guardar");
+    int ok = guardarImagen(info, ruta);
+    terminarMedicion(&m, info, ok);
+    return ok;
+}
+
+// ejecutarOperacion con medición (operaciones del menú que no se difieren)
+int ejecutarOperacionMedida(ImagenInfo* info, const Operacion* op) {
+    MedicionOperacion m;
+    iniciarMedicion(&m, nombreOperacion(op->tipo));
+    int ok = ejecutarOperacion(info, op);
+    terminarMedicion(&m, info, ok);
+    return ok;
+}
+
+// Carga la entrada, aplica el pipeline y guarda la salida; devuelve el código de salida
+int ejecutarLineaComandos(const char* entrada, const char* salida, const Pipeline* pipeline) {
+    ImagenInfo imagen = {0, 0, 0, 0, NULL};
+    int ok = cargarImagenMedida(entrada, &imagen) &&
+             ejecutarPipeline(&imagen, pipeline) &&
+             guardarResultadoPipeline(&imagen, pipeline, salida);
+    liberarImagen(&imagen);
+    return ok ? 0 : 1;
+}
+
+// ==================== MODO STREAMING ====================
+
+// Procesa imágenes que no caben en memoria sin cargarlas enteras. La entrada
+// se lee fila a fila y cada operación pide a la anterior solo las filas que
+// necesita, guardando en un anillo las de su huella vertical: las filas de la
+// pasada horizontal del kernel en el desenfoque, 3 filas en grises en Sobel,
+// 2 filas interpoladas en el escalado bilineal o las que cubre una fila
+// destino en el promedio de área. La salida se codifica a medida que se
+// completan sus filas; el PNG por franjas independientes que se comprimen en
+// el pool. La memoria es O(ancho × huella) más un lote de franjas de salida.
+// PNM, .imgn y PNG se leen por filas; los demás formatos de stb_image
+// (JPEG, BMP...) no se admiten porque habría que decodificarlos enteros.
+
+// ---- PNG por filas ----
+
+// Decodificador PNG mínimo para el modo streaming: inflate incremental sobre
+// los IDAT consecutivos con una ventana de 32 KB y desfiltrado de cada fila
+// con la anterior, de modo que la memoria es O(ancho) y no O(ancho × alto).
+// Produce lo mismo que stb_image con 1 o 3 canales: grises+alfa a grises,
+// RGBA a RGB, paleta a RGB, 16 bits al byte alto y 1/2/4 bits escalados a 0..255.
+// No admite PNG entrelazados (Adam7 necesita la imagen entera).
+
+#define BITS_RAPIDOS_HUFFMAN 9
+#define TAM_VENTANA_INFLATE 32768
+#define TAM_ENTRADA_PNG 65536
+
+typedef struct {
+    uint16_t rapido[1 << BITS_RAPIDOS_HUFFMAN]; // (longitud << 9) | símbolo; 0 si el código es más largo
+    uint16_t primerCodigo[16];
+    uint16_t primerSimbolo[16];
+    int maxCodigo[17];                           // Códigos invertidos a 16 bits por longitud
+    unsigned char longitud[288];
+    uint16_t simbolo[288];
+} HuffmanPNG;
+
+typedef struct {
+    FILE* archivo;
+    uint32_t restanteIDAT;       // Bytes sin leer del chunk IDAT actual
+    int finIDAT;                 // Ya no quedan IDAT
+    unsigned char entrada[TAM_ENTRADA_PNG];
+    size_t posEntrada, finEntrada;
+    int bytesRelleno;            // Ceros añadidos tras el final de los datos
+    // Inflate
+    uint64_t bits;
+    int numBits;
+    int ultimoBloque;
+    int tipoBloque;              // -1: falta leer la cabecera del bloque
+    uint32_t restanteAlmacenado; // Bloque sin comprimir
+    int longitudPendiente, distanciaPendiente;
+    uint64_t totalSalida;
+    unsigned char ventana[TAM_VENTANA_INFLATE];
+    HuffmanPNG literales, distancias;
+    // PNG
+    int ancho, alto, canales;    // Canales de salida: 1 o 3
+    int profundidad, tipoColor;
+    int bytesPixel;              // Para los filtros: al menos 1
+    size_t bytesFila;            // Sin el byte de filtro
+    unsigned char* fila;         // Fila actual y anterior desfiltradas
+    unsigned char* filaAnterior;
+    unsigned char paleta[256 * 3];
+} DecodificadorPNG;
+
+static const uint16_t baseLongitudInflate[29] = {
+    3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31,
+    35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258 };
+static const unsigned char extraLongitudInflate[29] = {
+    0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2, 3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0 };
+static const uint16_t baseDistanciaInflate[30] = {
+    1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193,
+    257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577 };
+static const unsigned char extraDistanciaInflate[30] = {
+    0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6, 7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13 };
+
+static uint32_t leerBE32(const unsigned char* p) {
+    return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | p[3];
+}
+
+// Siguiente byte de los datos zlib (saltando a los IDAT consecutivos); -1 al final
+static int leerByteIDAT(DecodificadorPNG* d) {
+    while (d->posEntrada == d->finEntrada) {
+        if (d->finIDAT) return -1;
+        if (d->restanteIDAT == 0) {
+            // CRC del chunk anterior y cabecera del siguiente
+            unsigned char cabecera[12];
+            if (fread(cabecera, 1, 12, d->archivo) != 12 || memcmp(cabecera + 8, "IDAT", 4) != 0) {
+                d->finIDAT = 1;
+                return -1;
+            }
+            d->restanteIDAT = leerBE32(cabecera + 4);
+            continue;
+        }
+        size_t n = d->restanteIDAT < TAM_ENTRADA_PNG ? d->restanteIDAT : TAM_ENTRADA_PNG;
+        if (fread(d->entrada, 1, n, d->archivo) != n) {
+            d->finIDAT = 1;
+            return -1;
+        }
+        d->restanteIDAT -= (uint32_t)n;
+        d->posEntrada = 0;
+        d->finEntrada = n;
+    }
+    return d->entrada[d->posEntrada++];
+}
+
+// Garantiza n bits en el acumulador; tras el final de los datos rellena con
+// ceros para poder mirar un código de Huffman por adelantado
+static int asegurarBitsPNG(DecodificadorPNG* d, int n) {
+    while (d->numBits < n) {
+        int b = leerByteIDAT(d);
+        if (b < 0) {
+            if (++d->bytesRelleno > 4) return 0;
+            b = 0;
+        }
+        d->bits |= (uint64_t)b << d->numBits;
+        d->numBits += 8;
+    }
+    return 1;
+}
+
+// n <= 16 bits, el primero el menos significativo; -1 si los datos se acaban
+static int leerBitsPNG(DecodificadorPNG* d, int n) {
+    if (!asegurarBitsPNG(d, n)) return -1;
+    int valor = (int)(d->bits & ((1u << n) - 1));
+    d->bits >>= n;
+    d->numBits -= n;
+    return valor;
+}
+
+static int invertirBits(int codigo, int bits) {
+    int r = 0;
+    for (int i = 0; i < bits; i++) {
+        r = (r << 1) | (codigo & 1);
+        codigo >>= 1;
+    }
+    return r;
+}
+
+// Códigos canónicos a partir de las longitudes; 0 si no forman un código válido
+static int construirHuffmanPNG(HuffmanPNG* h, const unsigned char* longitudes, int num) {
+    int cuenta[17] = {0};
+    int siguiente[16];
+    memset(h->rapido, 0, sizeof(h->rapido));
+    for (int i = 0; i < num; i++) cuenta[longitudes[i]]++;
+    cuenta[0] = 0;
+    int codigo = 0, k = 0;
+    for (int i = 1; i < 16; i++) {
+        if (cuenta[i] > (1 << i)) return 0;
+        siguiente[i] = codigo;
+        h->primerCodigo[i] = (uint16_t)codigo;
+        h->primerSimbolo[i] = (uint16_t)k;
+        codigo += cuenta[i];
+        if (cuenta[i] && codigo - 1 >= (1 << i)) return 0;
+        h->maxCodigo[i] = codigo << (16 - i);
+        codigo <<= 1;
+        k += cuenta[i];
+    }
+    h->maxCodigo[16] = 0x10000;
+    for (int i = 0; i < num; i++) {
+        int s = longitudes[i];
+        if (!s) continue;
+        int c = siguiente[s] - h->primerCodigo[s] + h->primerSimbolo[s];
+        h->longitud[c] = (unsigned char)s;
+        h->simbolo[c] = (uint16_t)i;
+        if (s <= BITS_RAPIDOS_HUFFMAN) {
+            for (int j = invertirBits(siguiente[s], s); j < (1 << BITS_RAPIDOS_HUFFMAN); j += 1 << s) {
+                h->rapido[j] = (uint16_t)((s << BITS_RAPIDOS_HUFFMAN) | i);
+            }
+        }
+        siguiente[s]++;
+    }
+    return 1;
+}
+
+// Siguiente símbolo; -1 si el código no existe o los datos se acaban
+static int decodificarSimboloPNG(DecodificadorPNG* d, const HuffmanPNG* h) {
+    if (!asegurarBitsPNG(d, 16)) return -1;
+    int rapido = h->rapido[d->bits & ((1 << BITS_RAPIDOS_HUFFMAN) - 1)];
+    int s;
+    int simbolo;
+    if (rapido) {
+        s = rapido >> BITS_RAPIDOS_HUFFMAN;
+        simbolo = rapido & ((1 << BITS_RAPIDOS_HUFFMAN) - 1);
+    } else {
+        int k = invertirBits((int)(d->bits & 0xffff), 16);
+        for (s = BITS_RAPIDOS_HUFFMAN + 1; k >= h->maxCodigo[s]; s++) {}
+        if (s >= 16) return -1;
+        int c = (k >> (16 - s)) - h->primerCodigo[s] + h->primerSimbolo[s];
+        if (c >= 288 || h->longitud[c] != s) return -1;
+        simbolo = h->simbolo[c];
+    }
+    d->bits >>= s;
+    d->numBits -= s;
+    return simbolo;
+}
+
+static int leerTablasDinamicasPNG(DecodificadorPNG* d) {
+    static const unsigned char orden[19] = { 16, 17, 18, 0, 8, 7, 9, 6, 10, 5, 11, 4, 12, 3, 13, 2, 14, 1, 15 };
+    int numLiterales = leerBitsPNG(d, 5) + 257;
+    int numDistancias = leerBitsPNG(d, 5) + 1;
+    int numLongitudes = leerBitsPNG(d, 4) + 4;
+    if (numLiterales < 257 || numDistancias < 1 || numLongitudes < 4) return 0;
+    unsigned char longitudesCodigo[19] = {0};
+    for (int i = 0; i < numLongitudes; i++) {
+        int v = leerBitsPNG(d, 3);
+        if (v < 0) return 0;
+        longitudesCodigo[orden[i]] = (unsigned char)v;
     }
+    HuffmanPNG codigoLongitudes;
+    if (!construirHuffmanPNG(&codigoLongitudes, longitudesCodigo, 19)) return 0;
     
-    for (int y = 0; y < info->alto; y++) {
-        pixelesDestino[y] = (unsigned char**)malloc(info->ancho * sizeof(unsigned char*));
-        if (!pixelesDestino[y]) {
-            fprintf(stderr, "Error de memoria al asignar fila %d\n", y);
-            for (int j = 0; j < y; j++) {
-                for (int x = 0; x < info->ancho; x++) {
-                    free(pixelesDestino[j][x]);
-                }
-                free(pixelesDestino[j]);
+    unsigned char longitudes[286 + 32];
+    int total = numLiterales + numDistancias;
+    int n = 0;
+    while (n < total) {
+        int c = decodificarSimboloPNG(d, &codigoLongitudes);
+        if (c < 0) return 0;
+        if (c < 16) {
+            longitudes[n++] = (unsigned char)c;
+            continue;
+        }
+        int repeticiones;
+        unsigned char valor = 0;
+        if (c == 16) {
+            if (n == 0) return 0;
+            repeticiones = leerBitsPNG(d, 2) + 3;
+            valor = longitudes[n - 1];
+        } else if (c == 17) {
+            repeticiones = leerBitsPNG(d, 3) + 3;
+        } else {
+            repeticiones = leerBitsPNG(d, 7) + 11;
+        }
+        if (repeticiones < 3 || n + repeticiones > total) return 0;
+        memset(longitudes + n, valor, (size_t)repeticiones);
+        n += repeticiones;
+    }
+    return construirHuffmanPNG(&d->literales, longitudes, numLiterales) &&
+           construirHuffmanPNG(&d->distancias, longitudes + numLiterales, numDistancias);
+}
+
+static int leerCabeceraBloquePNG(DecodificadorPNG* d) {
+    if (d->ultimoBloque) return 0; // El flujo zlib terminó antes que la imagen
+    int cabecera = leerBitsPNG(d, 3);
+    if (cabecera < 0) return 0;
+    d->ultimoBloque = cabecera & 1;
+    d->tipoBloque = cabecera >> 1;
+    if (d->tipoBloque == 0) {
+        // Sin comprimir: LEN y NLEN alineados a byte
+        leerBitsPNG(d, d->numBits & 7);
+        int longitud = leerBitsPNG(d, 16);
+        int complemento = leerBitsPNG(d, 16);
+        if (longitud < 0 || complemento < 0 || (longitud ^ 0xffff) != complemento) return 0;
+        d->restanteAlmacenado = (uint32_t)longitud;
+        if (longitud == 0) d->tipoBloque = -1;
+        return 1;
+    }
+    if (d->tipoBloque == 1) {
+        unsigned char longitudes[288];
+        memset(longitudes, 8, 144);
+        memset(longitudes + 144, 9, 112);
+        memset(longitudes + 256, 7, 24);
+        memset(longitudes + 280, 8, 8);
+        unsigned char longitudesDistancia[30];
+        memset(longitudesDistancia, 5, sizeof(longitudesDistancia));
+        return construirHuffmanPNG(&d->literales, longitudes, 288) &&
+               construirHuffmanPNG(&d->distancias, longitudesDistancia, 30);
+    }
+    if (d->tipoBloque == 2) return leerTablasDinamicasPNG(d);
+    return 0;
+}
+
+static void emitirByteInflate(DecodificadorPNG* d, unsigned char** destino, unsigned char b) {
+    d->ventana[d->totalSalida++ & (TAM_VENTANA_INFLATE - 1)] = b;
+    *(*destino)++ = b;
+}
+
+// Descomprime exactamente n bytes; una copia que no cabe se continúa en la siguiente llamada
+static int inflarBytes(DecodificadorPNG* d, unsigned char* destino, size_t n) {
+    unsigned char* fin = destino + n;
+    while (destino < fin) {
+        if (d->longitudPendiente > 0) {
+            while (d->longitudPendiente > 0 && destino < fin) {
+                unsigned char b = d->ventana[(d->totalSalida - (uint64_t)d->distanciaPendiente) & (TAM_VENTANA_INFLATE - 1)];
+                emitirByteInflate(d, &destino, b);
+                d->longitudPendiente--;
             }
-            free(pixelesDestino);
-            for (int i = 0; i < tamKernel; i++) free(kernel[i]);
-            free(kernel);
-            return;
+            continue;
         }
-        for (int x = 0; x < info->ancho; x++) {
-            pixelesDestino[y][x] = (unsigned char*)malloc(info->canales * sizeof(unsigned char));
-            if (!pixelesDestino[y][x]) {
-                fprintf(stderr, "Error de memoria al asignar píxel [%d][%d]\n", y, x);
-                for (int j = 0; j <= y; j++) {
-                    int maxX = (j == y) ? x : info->ancho;
-                    for (int i = 0; i < maxX; i++) {
-                        free(pixelesDestino[j][i]);
-                    }
-                    free(pixelesDestino[j]);
-                }
-                free(pixelesDestino);
-                for (int i = 0; i < tamKernel; i++) free(kernel[i]);
-                free(kernel);
-                return;
+        if (d->tipoBloque < 0) {
+            if (!leerCabeceraBloquePNG(d)) return 0;
+            continue;
+        }
+        if (d->tipoBloque == 0) {
+            int b = leerBitsPNG(d, 8);
+            if (b < 0 || d->numBits < 8 * d->bytesRelleno) return 0;
+            emitirByteInflate(d, &destino, (unsigned char)b);
+            if (--d->restanteAlmacenado == 0) d->tipoBloque = -1;
+            continue;
+        }
+        int s = decodificarSimboloPNG(d, &d->literales);
+        if (s < 0) return 0;
+        if (s < 256) {
+            emitirByteInflate(d, &destino, (unsigned char)s);
+        } else if (s == 256) {
+            d->tipoBloque = -1;
+        } else {
+            s -= 257;
+            if (s >= 29) return 0;
+            int longitud = baseLongitudInflate[s] + leerBitsPNG(d, extraLongitudInflate[s]);
+            int sd = decodificarSimboloPNG(d, &d->distancias);
+            if (sd < 0 || sd >= 30) return 0;
+            int distancia = baseDistanciaInflate[sd] + leerBitsPNG(d, extraDistanciaInflate[sd]);
+            if (longitud < 3 || distancia < 1 || (uint64_t)distancia > d->totalSalida) return 0;
+            d->longitudPendiente = longitud;
+            d->distanciaPendiente = distancia;
+        }
+        if (d->numBits < 8 * d->bytesRelleno) return 0; // Se consumieron bits del relleno: datos truncados
+    }
+    return 1;
+}
+
+static unsigned char paethPNG(int a, int b, int c) {
+    int p = a + b - c;
+    int pa = abs(p - a), pb = abs(p - b), pc = abs(p - c);
+    if (pa <= pb && pa <= pc) return (unsigned char)a;
+    return (unsigned char)((pb <= pc) ? b : c);
+}
+
+// Muestra i (de 1, 2, 4 u 8 bits) de una fila empaquetada
+static int muestraEmpaquetada(const unsigned char* fila, int i, int profundidad) {
+    int porByte = 8 / profundidad;
+    int desplazamiento = 8 - profundidad * (i % porByte + 1);
+    return (fila[i / porByte] >> desplazamiento) & ((1 << profundidad) - 1);
+}
+
+// Lee y desfiltra la siguiente fila y la convierte a 1 o 3 canales de 8 bits
+static int leerFilaPNG(DecodificadorPNG* d, unsigned char* destino) {
+    unsigned char filtro;
+    unsigned char* tmp = d->filaAnterior;
+    d->filaAnterior = d->fila;
+    d->fila = tmp;
+    unsigned char* f = d->fila;
+    const unsigned char* arriba = d->filaAnterior;
+    if (!inflarBytes(d, &filtro, 1) || !inflarBytes(d, f, d->bytesFila)) return 0;
+    size_t n = d->bytesFila;
+    size_t bpp = (size_t)d->bytesPixel;
+    switch (filtro) {
+        case 0:
+            break;
+        case 1:
+            for (size_t i = bpp; i < n; i++) f[i] = (unsigned char)(f[i] + f[i - bpp]);
+            break;
+        case 2:
+            for (size_t i = 0; i < n; i++) f[i] = (unsigned char)(f[i] + arriba[i]);
+            break;
+        case 3:
+            for (size_t i = 0; i < n; i++) {
+                int izquierda = (i >= bpp) ? f[i - bpp] : 0;
+                f[i] = (unsigned char)(f[i] + ((izquierda + arriba[i]) >> 1));
+            }
+            break;
+        case 4:
+            for (size_t i = 0; i < n; i++) {
+                int izquierda = (i >= bpp) ? f[i - bpp] : 0;
+                int diagonal = (i >= bpp) ? arriba[i - bpp] : 0;
+                f[i] = (unsigned char)(f[i] + paethPNG(izquierda, arriba[i], diagonal));
+            }
+            break;
+        default:
+            return 0;
+    }
+    
+    // Conversión al formato de ImagenInfo
+    int muestras = (d->tipoColor == 2) ? 3 : (d->tipoColor == 4) ? 2 : (d->tipoColor == 6) ? 4 : 1;
+    int bytesMuestra = (d->profundidad == 16) ? 2 : 1;
+    if (d->tipoColor == 3) {
+        for (int x = 0; x < d->ancho; x++) {
+            int indice = (d->profundidad == 8) ? f[x] : muestraEmpaquetada(f, x, d->profundidad);
+            memcpy(destino + (size_t)x * 3, d->paleta + indice * 3, 3);
+        }
+    } else if (d->profundidad < 8) {
+        static const unsigned char escala[5] = { 0, 0xff, 0x55, 0, 0x11 };
+        for (int x = 0; x < d->ancho; x++) {
+            destino[x] = (unsigned char)(muestraEmpaquetada(f, x, d->profundidad) * escala[d->profundidad]);
+        }
+    } else {
+        // 16 bits: el byte alto (big endian) es el primero
+        for (int x = 0; x < d->ancho; x++) {
+            const unsigned char* p = f + (size_t)x * muestras * bytesMuestra;
+            for (int c = 0; c < d->canales; c++) destino[(size_t)x * d->canales + c] = p[c * bytesMuestra];
+        }
+    }
+    return 1;
+}
+
+static void cerrarPNG(DecodificadorPNG* d) {
+    if (!d) return;
+    free(d->fila);
+    free(d->filaAnterior);
+    free(d);
+}
+
+// Lee la cabecera y los chunks hasta el primer IDAT. Devuelve -1 si el archivo
+// no es PNG, 0 si no se puede decodificar por filas y 1 si se abrió
+static int abrirPNG(FILE* archivo, const char* ruta, DecodificadorPNG** salida) {
+    static const unsigned char firma[8] = { 137, 'P', 'N', 'G', 13, 10, 26, 10 };
+    unsigned char cabecera[8 + 8 + 13] = {0};
+    if (fread(cabecera, 1, 8, archivo) != 8 || memcmp(cabecera, firma, 8) != 0) return -1;
+    size_t leidos = fread(cabecera + 8, 1, sizeof(cabecera) - 8, archivo);
+    DecodificadorPNG* d = calloc(1, sizeof(DecodificadorPNG));
+    if (!d) {
+        fprintf(stderr, "Error de memoria al abrir %s\n", ruta);
+        return 0;
+    }
+    d->archivo = archivo;
+    d->tipoBloque = -1;
+    const unsigned char* ihdr = cabecera + 16;
+    uint32_t ancho = leerBE32(ihdr), alto = leerBE32(ihdr + 4);
+    d->profundidad = ihdr[8];
+    d->tipoColor = ihdr[9];
+    int valido = leidos == sizeof(cabecera) - 8 && leerBE32(cabecera + 8) == 13 && memcmp(cabecera + 12, "IHDR", 4) == 0 &&
+                 ancho > 0 && alto > 0 && ancho <= INT32_MAX && alto <= INT32_MAX &&
+                 ihdr[10] == 0 && ihdr[11] == 0 && ihdr[12] <= 1;
+    int p = d->profundidad;
+    switch (d->tipoColor) {
+        case 0: valido = valido && (p == 1 || p == 2 || p == 4 || p == 8 || p == 16); break;
+        case 3: valido = valido && (p == 1 || p == 2 || p == 4 || p == 8); break;
+        case 2: case 4: case 6: valido = valido && (p == 8 || p == 16); break;
+        default: valido = 0;
+    }
+    if (!valido) {
+        fprintf(stderr, "PNG inválido: %s\n", ruta);
+        cerrarPNG(d);
+        return 0;
+    }
+    if (ihdr[12] == 1) {
+        fprintf(stderr, "El modo streaming no admite PNG entrelazados: %s\n", ruta);
+        cerrarPNG(d);
+        return 0;
+    }
+    d->ancho = (int)ancho;
+    d->alto = (int)alto;
+    d->canales = (d->tipoColor == 0 || d->tipoColor == 4) ? 1 : 3;
+    int muestras = (d->tipoColor == 2) ? 3 : (d->tipoColor == 4) ? 2 : (d->tipoColor == 6) ? 4 : 1;
+    size_t bitsPixel = (size_t)muestras * p;
+    d->bytesPixel = (bitsPixel < 8) ? 1 : (int)(bitsPixel / 8);
+    d->bytesFila = ((size_t)ancho * bitsPixel + 7) / 8;
+    d->fila = calloc(1, d->bytesFila);
+    d->filaAnterior = calloc(1, d->bytesFila); // La fila anterior a la primera es cero
+    if (!d->fila || !d->filaAnterior) {
+        fprintf(stderr, "Error de memoria al abrir %s\n", ruta);
+        cerrarPNG(d);
+        return 0;
+    }
+    
+    // Chunks hasta el primer IDAT (se salta el CRC de IHDR)
+    if (fseek(archivo, 4, SEEK_CUR) != 0) valido = 0;
+    while (valido) {
+        unsigned char chunk[8];
+        if (fread(chunk, 1, 8, archivo) != 8) {
+            valido = 0;
+            break;
+        }
+        uint32_t longitud = leerBE32(chunk);
+        if (memcmp(chunk + 4, "IDAT", 4) == 0) {
+            d->restanteIDAT = longitud;
+            break;
+        }
+        if (memcmp(chunk + 4, "PLTE", 4) == 0) {
+            if (longitud % 3 != 0 || longitud > sizeof(d->paleta) ||
+                fread(d->paleta, 1, longitud, archivo) != longitud || fseek(archivo, 4, SEEK_CUR) != 0) {
+                valido = 0;
             }
+        } else if (!(chunk[4] & 0x20) || longitud > INT32_MAX) {
+            valido = 0; // Chunk crítico desconocido (o IEND antes de los datos)
+        } else if (fseek(archivo, (long)longitud + 4, SEEK_CUR) != 0) {
+            valido = 0;
+        }
+    }
+    // Cabecera zlib: deflate sin diccionario
+    int cmf = valido ? leerByteIDAT(d) : -1;
+    int flg = valido ? leerByteIDAT(d) : -1;
+    if (cmf < 0 || flg < 0 || (cmf & 15) != 8 || (flg & 32) || (cmf * 256 + flg) % 31 != 0) {
+        fprintf(stderr, "PNG inválido: %s\n", ruta);
+        cerrarPNG(d);
+        return 0;
+    }
+    *salida = d;
+    return 1;
+}
+
+typedef enum {
+    FUENTE_PNM,              // fread secuencial tras la cabecera
+    FUENTE_NATIVO,           // pread por fila
+    FUENTE_PNG               // Inflate incremental
+} TipoFuente;
+
+typedef struct {
+    TipoFuente tipo;
+    FILE* archivo;
+    int fd;
+    uint64_t desplazamiento; // Nativo: primer píxel y stride del archivo
+    size_t stride;
+    DecodificadorPNG* png;
+    int ancho, alto, canales;
+    int siguiente;           // Próxima fila a leer
+} FuenteFilas;
+
+typedef enum {
+    ETAPA_FLUJO_TABLA,       // Puntuales compuestas: sin anillo
+    ETAPA_FLUJO_CONVOLUCION,
+    ETAPA_FLUJO_SOBEL,
+    ETAPA_FLUJO_BILINEAL,
+    ETAPA_FLUJO_AREA
+} TipoEtapaFlujo;
+
+typedef struct {
+    TipoEtapaFlujo tipo;
+    int anchoEntrada, altoEntrada, canalesEntrada;
+    int ancho, alto, canales;          // De la salida
+    int siguiente;                     // Próxima fila de salida
+    unsigned char* anillo;             // capacidad filas de bytesAnillo bytes
+    size_t bytesAnillo;
+    int capacidad;
+    int cargadas;                      // Filas de entrada ya pasadas al anillo
+    unsigned char* filaEntrada;        // Fila de entrada antes de transformarla
+    TablaFila tabla;
+    KernelConvolucion kernel;
+    unsigned char* filaConstante;      // Fila del anillo fuera de la imagen con borde constante
+    const void** ventana;              // Filas del anillo que entran en la pasada vertical
+    EscaladoArgs escalado;             // Tablas o ejes de área del escalado
+    int escaladoCreado;
+    float* acumulado;
+} EtapaFlujo;
+
+typedef struct {
+    FuenteFilas fuente;
+    EtapaFlujo etapas[MAX_OPERACIONES];
+    int numEtapas;
+} Flujo;
+
+typedef struct {
+    FormatoImagen formato;
+    FILE* archivo;
+    int ancho, alto, canales;
+    size_t bytesFila;
+    int escritas;
+    size_t stride;                     // Nativo: stride del archivo, relleno con ceros
+    size_t reservado;                  // Bytes de búferes de salida
+    // PNG: lote de franjas; la fila 0 es la última del lote anterior
+    unsigned char* lote;
+    int filasPorFranja;
+    int franjasPorLote;
+    int filasEnLote;
+    FranjaPNG* franjas;
+    unsigned int adler;
+} SumideroFilas;
+
+typedef struct {
+    SumideroFilas* sumidero;
+    unsigned char* base;
+    int desplazamiento;                // 1 si la fila 0 de base es la anterior al lote
+    int ultimoLote;
+    int numFranjas;
+} LotePNGArgs;
+
+// 1 si la operación se puede ejecutar fila a fila (con bordes envolventes
+// las primeras filas necesitarían las últimas)
+static int esOperacionDeFlujo(const Operacion* op) {
+    switch (op->tipo) {
+        case OP_BRILLO:
+        case OP_PUNTUAL:
+            return 1;
+        case OP_BORDES:
+            return opcionesBorde.modo != BORDE_ENVOLVER && !opcionesSobel.rutaDireccion;
+        case OP_DESENFOQUE:
+            return op->entero1 >= 3 && op->entero1 % 2 == 1 && op->real > 0 && opcionesBorde.modo != BORDE_ENVOLVER;
+        case OP_ESCALAR:
+            return op->entero1 > 0 && op->entero2 > 0;
+        default:
+            return 0;
+    }
+}
+
+static int abrirFuenteFilas(const char* ruta, FuenteFilas* f) {
+    memset(f, 0, sizeof(*f));
+    f->fd = -1;
+    
+    // Nativo: se lee con pread sin mapear el archivo
+    int fd = open(ruta, O_RDONLY);
+    if (fd < 0) {
+        fprintf(stderr, "Error al abrir la imagen: %s\n", ruta);
+        return 0;
+    }
+    CabeceraNativa c;
+    struct stat st;
+    if (pread(fd, &c, sizeof(c), 0) == (ssize_t)sizeof(c) && memcmp(c.magia, MAGIA_NATIVO, 4) == 0) {
+        if (fstat(fd, &st) != 0 || !cabeceraNativaValida(&c, (uint64_t)st.st_size)) {
+            fprintf(stderr, "Archivo nativo inválido: %s\n", ruta);
+            close(fd);
+            return 0;
         }
+        f->tipo = FUENTE_NATIVO;
+        f->fd = fd;
+        f->desplazamiento = c.desplazamiento;
+        f->stride = c.stride;
+        f->ancho = (int)c.ancho;
+        f->alto = (int)c.alto;
+        f->canales = (int)c.canales;
+        return 1;
     }
+    close(fd);
     
-    // Configurar hilos
-    const int numHilos = 2;
-    pthread_t hilos[numHilos];
-    ConvolucionArgs args[numHilos];
+    FILE* archivo = fopen(ruta, "rb");
+    if (archivo && leerCabeceraPNM(archivo, &f->ancho, &f->alto, &f->canales)) {
+        f->tipo = FUENTE_PNM;
+        f->archivo = archivo;
+        return 1;
+    }
+    int abierto = -1;
+    if (archivo && fseek(archivo, 0, SEEK_SET) == 0) abierto = abrirPNG(archivo, ruta, &f->png);
+    if (abierto > 0) {
+        f->tipo = FUENTE_PNG;
+        f->archivo = archivo;
+        f->ancho = f->png->ancho;
+        f->alto = f->png->alto;
+        f->canales = f->png->canales;
+        return 1;
+    }
+    if (archivo) fclose(archivo);
+    if (abierto == 0) return 0;
     
-    int filasPorHilo = info->alto / numHilos;
-    for (int i = 0; i < numHilos; i++) {
-        args[i].pixelesOrigen = info->pixeles;
-        args[i].pixelesDestino = pixelesDestino;
-        args[i].kernel = kernel;
-        args[i].tamKernel = tamKernel;
-        args[i].ancho = info->ancho;
-        args[i].alto = info->alto;
-        args[i].canales = info->canales;
-        args[i].inicio = i * filasPorHilo;
-        args[i].fin = (i == numHilos - 1) ? info->alto : (i + 1) * filasPorHilo;
-        pthread_create(&hilos[i], NULL, convolucionHilo, &args[i]);
+    fprintf(stderr, "El modo streaming necesita una entrada PNM, PNG o .imgn: %s\n", ruta);
+    return 0;
+}
+
+static void cerrarFuenteFilas(FuenteFilas* f) {
+    if (f->archivo) fclose(f->archivo);
+    if (f->fd >= 0) close(f->fd);
+    cerrarPNG(f->png);
+}
+
+// Lee la siguiente fila de la entrada
+static int leerFilaFuente(FuenteFilas* f, unsigned char* destino) {
+    size_t bytes = (size_t)f->ancho * f->canales;
+    int y = f->siguiente++;
+    switch (f->tipo) {
+        case FUENTE_PNM:
+            return fread(destino, 1, bytes, f->archivo) == bytes;
+        case FUENTE_NATIVO:
+            return pread(f->fd, destino, bytes, (off_t)(f->desplazamiento + (uint64_t)y * f->stride)) == (ssize_t)bytes;
+        case FUENTE_PNG:
+            return leerFilaPNG(f->png, destino);
+    }
+    return 0;
+}
+
+static int producirFilaEtapa(Flujo* fl, int s, unsigned char* destino);
+
+// Fila siguiente de la entrada de la etapa s: la fuente o la etapa anterior
+static int filaEntradaEtapa(Flujo* fl, int s, unsigned char* destino) {
+    return (s == 0) ? leerFilaFuente(&fl->fuente, destino) : producirFilaEtapa(fl, s - 1, destino);
+}
+
+static inline unsigned char* filaAnillo(const EtapaFlujo* e, int y) {
+    return e->anillo + (size_t)(y % e->capacidad) * e->bytesAnillo;
+}
+
+// Pasa al anillo las filas de entrada hasta la fila (incluida), transformadas
+static int cargarAnillo(Flujo* fl, int s, int fila) {
+    EtapaFlujo* e = &fl->etapas[s];
+    while (e->cargadas <= fila) {
+        unsigned char* ranura = filaAnillo(e, e->cargadas);
+        int directa = (e->tipo == ETAPA_FLUJO_SOBEL && e->canalesEntrada == 1);
+        if (!filaEntradaEtapa(fl, s, directa ? ranura : e->filaEntrada)) return 0;
+        switch (e->tipo) {
+            case ETAPA_FLUJO_CONVOLUCION:
+                convolucionFilaH(&e->kernel, e->filaEntrada, ranura, e->ancho, e->canales);
+                break;
+            case ETAPA_FLUJO_SOBEL:
+                if (!directa) grisFila(e->filaEntrada, ranura, e->ancho);
+                break;
+            case ETAPA_FLUJO_BILINEAL:
+                escaladoHorizontalFila(&e->escalado, e->filaEntrada, (unsigned short*)ranura);
+                break;
+            case ETAPA_FLUJO_AREA:
+                reducirFilaArea(&e->escalado, e->filaEntrada, (float*)ranura);
+                break;
+            case ETAPA_FLUJO_TABLA:
+                break;
+        }
+        e->cargadas++;
     }
+    return 1;
+}
+
+// Produce la siguiente fila de salida de la etapa s con la misma aritmética
+// que la operación sobre la imagen completa
+static int producirFilaEtapa(Flujo* fl, int s, unsigned char* destino) {
+    EtapaFlujo* e = &fl->etapas[s];
+    int y = e->siguiente++;
+    int n = e->ancho * e->canales;
+    int altoEntrada = e->altoEntrada;
     
-    // Esperar hilos
-    for (int i = 0; i < numHilos; i++) {
-        pthread_join(hilos[i], NULL);
+    switch (e->tipo) {
+        case ETAPA_FLUJO_TABLA:
+            if (!filaEntradaEtapa(fl, s, destino)) return 0;
+            aplicarTablaFila(&e->tabla, destino, n);
+            return 1;
+        case ETAPA_FLUJO_CONVOLUCION: {
+            int radio = e->kernel.tam / 2;
+            if (!cargarAnillo(fl, s, (y + radio < altoEntrada) ? y + radio : altoEntrada - 1)) return 0;
+            for (int k = 0; k < e->kernel.tam; k++) {
+                int py = indiceBorde(y + k - radio, altoEntrada);
+                e->ventana[k] = (py < 0) ? e->filaConstante : filaAnillo(e, py);
+            }
+            convolucionFilaV(&e->kernel, e->ventana, destino, n);
+            return 1;
+        }
+        case ETAPA_FLUJO_SOBEL: {
+            int arriba = indiceBorde(y - 1, altoEntrada), abajo = indiceBorde(y + 1, altoEntrada);
+            if (!cargarAnillo(fl, s, (y + 1 < altoEntrada) ? y + 1 : altoEntrada - 1)) return 0;
+            simd.sobelFila((arriba < 0) ? e->filaConstante : filaAnillo(e, arriba), filaAnillo(e, y),
+                           (abajo < 0) ? e->filaConstante : filaAnillo(e, abajo), destino, NULL, e->ancho);
+            return 1;
+        }
+        case ETAPA_FLUJO_BILINEAL: {
+            const TablasEscalado* t = &e->escalado.tablas;
+            if (!cargarAnillo(fl, s, t->fila1[y])) return 0;
+            const unsigned short* h0 = (const unsigned short*)filaAnillo(e, t->fila0[y]);
+            const unsigned short* h1 = (const unsigned short*)filaAnillo(e, t->fila1[y]);
+            unsigned int w1 = t->pesoY[y], w0 = PESO_UNO - w1;
+            for (int i = 0; i < n; i++) {
+                destino[i] = (unsigned char)((h0[i] * w0 + h1[i] * w1 + (1u << (2 * BITS_PESO - 1))) >> (2 * BITS_PESO));
+            }
+            return 1;
+        }
+        case ETAPA_FLUJO_AREA: {
+            const EjeArea* ey = &e->escalado.areaY;
+            if (!cargarAnillo(fl, s, ey->primero[y] + ey->cuenta[y] - 1)) return 0;
+            memset(e->acumulado, 0, (size_t)n * sizeof(float));
+            for (int k = 0; k < ey->cuenta[y]; k++) {
+                const float* reducida = (const float*)filaAnillo(e, ey->primero[y] + k);
+                float wy = ey->pesos[(size_t)y * ey->maxCuenta + k];
+                for (int i = 0; i < n; i++) e->acumulado[i] += wy * reducida[i];
+            }
+            for (int i = 0; i < n; i++) {
+                int v = (int)(e->acumulado[i] + 0.5f);
+                destino[i] = (v > 255) ? 255 : v;
+            }
+            return 1;
+        }
     }
+    return 0;
+}
+
+// Prepara la etapa para la operación op sobre una entrada de ancho x alto x canales;
+// devuelve los bytes reservados o 0 si no hay memoria
+static size_t crearEtapaFlujo(EtapaFlujo* e, const Operacion* op, int ancho, int alto, int canales) {
+    memset(e, 0, sizeof(*e));
+    e->anchoEntrada = e->ancho = ancho;
+    e->altoEntrada = e->alto = alto;
+    e->canalesEntrada = e->canales = canales;
+    size_t bytesEntrada = (size_t)ancho * canales;
     
-    // Reemplazar imagen original (preservando dimensiones)
-    if (info->pixeles) {
-        for (int y = 0; y < info->alto; y++) {
-            for (int x = 0; x < info->ancho; x++) {
-                free(info->pixeles[y][x]);
+    if (op->tipo == OP_DESENFOQUE) {
+        e->tipo = ETAPA_FLUJO_CONVOLUCION;
+        int ok = crearKernelConvolucion(&e->kernel, op->entero1, op->real);
+        if (ok) e->filaConstante = crearFilaIntermediaConstante(&e->kernel, ancho, canales, &ok);
+        if (ok) e->ventana = (const void**)malloc(op->entero1 * sizeof(void*));
+        if (!ok || !e->ventana) return 0;
+        e->capacidad = op->entero1;
+        e->bytesAnillo = bytesEntrada * e->kernel.bytesMuestra;
+    } else if (op->tipo == OP_BORDES) {
+        int ok = 1;
+        e->tipo = ETAPA_FLUJO_SOBEL;
+        e->canales = 1;
+        e->capacidad = 3;
+        e->bytesAnillo = (size_t)ancho;
+        e->filaConstante = crearFilaConstante(ancho, &ok);
+        if (!ok) return 0;
+    } else {
+        e->ancho = op->entero1;
+        e->alto = op->entero2;
+        EscaladoArgs* a = &e->escalado;
+        a->anchoOrigen = ancho;
+        a->altoOrigen = alto;
+        a->anchoDestino = e->ancho;
+        a->altoDestino = e->alto;
+        a->canales = canales;
+        
+        // Mismo criterio que escalarImagenConcurrente (ESCALADO_AUTO)
+        float ratioX = (float)ancho / e->ancho, ratioY = (float)alto / e->alto;
+        size_t n = (size_t)e->ancho * canales;
+        if (ratioX >= 1 && ratioY >= 1 && (ratioX > RATIO_MINIMO_AREA || ratioY > RATIO_MINIMO_AREA)) {
+            e->tipo = ETAPA_FLUJO_AREA;
+            if (!crearEjeArea(&a->areaX, ancho, e->ancho)) return 0;
+            if (!crearEjeArea(&a->areaY, alto, e->alto)) {
+                liberarEjeArea(&a->areaX);
+                return 0;
             }
-            free(info->pixeles[y]);
+            e->escaladoCreado = 1;
+            e->capacidad = a->areaY.maxCuenta;
+            e->bytesAnillo = n * sizeof(float);
+            e->acumulado = (float*)malloc(n * sizeof(float));
+            if (!e->acumulado) return 0;
+        } else {
+            e->tipo = ETAPA_FLUJO_BILINEAL;
+            if (!crearTablasEscalado(&a->tablas, ancho, alto, e->ancho, e->alto, canales)) return 0;
+            e->escaladoCreado = 1;
+            e->capacidad = 2;
+            e->bytesAnillo = n * sizeof(unsigned short);
         }
-        free(info->pixeles);
     }
-    info->pixeles = pixelesDestino;
     
-    // Liberar kernel
-    for (int i = 0; i < tamKernel; i++) {
-        free(kernel[i]);
+    e->anillo = (unsigned char*)malloc((size_t)e->capacidad * e->bytesAnillo);
+    e->filaEntrada = (unsigned char*)malloc(bytesEntrada);
+    if (!e->anillo || !e->filaEntrada) return 0;
+    size_t bytes = (size_t)e->capacidad * e->bytesAnillo + bytesEntrada;
+    if (e->acumulado) bytes += (size_t)e->ancho * e->canales * sizeof(float);
+    return bytes;
+}
+
+static void liberarEtapaFlujo(EtapaFlujo* e) {
+    if (e->escaladoCreado && e->tipo == ETAPA_FLUJO_BILINEAL) liberarTablasEscalado(&e->escalado.tablas);
+    if (e->escaladoCreado && e->tipo == ETAPA_FLUJO_AREA) {
+        liberarEjeArea(&e->escalado.areaX);
+        liberarEjeArea(&e->escalado.areaY);
+    }
+    liberarKernelConvolucion(&e->kernel);
+    free(e->filaConstante);
+    free(e->ventana);
+    free(e->anillo);
+    free(e->filaEntrada);
+    free(e->acumulado);
+}
+
+// Comprime en paralelo las franjas del lote
+void lotePNGHilo(void* args, int inicio, int fin) {
+    LotePNGArgs* l = (LotePNGArgs*)args;
+    SumideroFilas* s = l->sumidero;
+    for (int f = inicio; f < fin; f++) {
+        int y0 = l->desplazamiento + f * s->filasPorFranja;
+        int y1 = l->desplazamiento + ((f + 1) * s->filasPorFranja < s->filasEnLote ?
+                                      (f + 1) * s->filasPorFranja : s->filasEnLote);
+        codificarFranjaPNG(l->base, s->bytesFila, s->ancho, s->canales, y0, y1,
+                           s->escritas == 0 && f == 0, l->ultimoLote && f == l->numFranjas - 1,
+                           &s->franjas[f]);
+    }
+}
+
+// Codifica y escribe las franjas acumuladas; guarda la última fila para el siguiente lote
+static int vaciarLotePNG(SumideroFilas* s) {
+    LotePNGArgs args;
+    args.sumidero = s;
+    args.desplazamiento = (s->escritas > 0);
+    args.base = s->lote + (args.desplazamiento ? 0 : s->bytesFila);
+    args.numFranjas = (s->filasEnLote + s->filasPorFranja - 1) / s->filasPorFranja;
+    args.ultimoLote = (s->escritas + s->filasEnLote == s->alto);
+    ejecutarEnPoolPorBloques(lotePNGHilo, &args, args.numFranjas, 1);
+    
+    int ok = 1;
+    for (int f = 0; f < args.numFranjas; f++) {
+        FranjaPNG* franja = &s->franjas[f];
+        ok = ok && franja->datos && fwrite(franja->datos, 1, franja->tam, s->archivo) == (size_t)franja->tam;
+        s->adler = combinarAdler32(s->adler, franja->adler, franja->bytesFiltrados);
+        free(franja->datos);
+        franja->datos = NULL;
+    }
+    memcpy(s->lote, s->lote + (size_t)s->filasEnLote * s->bytesFila, s->bytesFila);
+    s->escritas += s->filasEnLote;
+    s->filasEnLote = 0;
+    return ok;
+}
+
+// Abre la salida y escribe su cabecera; devuelve 0 si falla
+static int abrirSumidero(SumideroFilas* s, const char* ruta, int ancho, int alto, int canales) {
+    memset(s, 0, sizeof(*s));
+    s->formato = formatoPorExtension(ruta);
+    s->ancho = ancho;
+    s->alto = alto;
+    s->canales = canales;
+    s->bytesFila = (size_t)ancho * canales;
+    s->archivo = fopen(ruta, "wb");
+    if (!s->archivo) return 0;
+    
+    if (s->formato == FORMATO_NATIVO) {
+        s->stride = calcularStride(ancho, canales);
+        s->reservado = s->stride;
+        s->lote = (unsigned char*)calloc(1, s->stride);
+        return s->lote && escribirCabeceraNativa(s->archivo, ancho, alto, canales, s->stride);
+    }
+    if (s->formato == FORMATO_PNM) {
+        s->reservado = s->bytesFila;
+        s->lote = (unsigned char*)malloc(s->bytesFila);
+        return s->lote && escribirCabeceraPNM(s->archivo, ancho, alto, canales);
     }
-    free(kernel);
     
-    printf("Convolución aplicada concurrentemente con %d hilos (kernel %dx%d, sigma=%.1f) en imagen %s.\n", 
-           numHilos, tamKernel, tamKernel, sigma, info->canales == 1 ? "grises" : "RGB");
+    // Las franjas tienen el mismo alto que en guardarPNG, así que el archivo es idéntico
+    s->adler = 1;
+    s->filasPorFranja = (int)(BYTES_MINIMOS_FRANJA_PNG / (s->bytesFila + 1)) + 1;
+    s->franjasPorLote = hilosPool();
+    s->reservado = ((size_t)s->filasPorFranja * s->franjasPorLote + 1) * s->bytesFila;
+    s->lote = (unsigned char*)malloc(s->reservado);
+    s->franjas = (FranjaPNG*)calloc(s->franjasPorLote, sizeof(FranjaPNG));
+    return s->lote && s->franjas && escribirCabeceraPNG(s->archivo, ancho, alto, canales);
 }
 
-// ==================== FUNCIÓN 2: ROTACIÓN ====================
-
-// Estructura para datos de hilos de rotación
-typedef struct {
-    unsigned char*** pixelesOrigen;
-    unsigned char*** pixelesDestino;
-    float cosAngulo;
-    float sinAngulo;
-    int anchoOrigen;
-    int altoOrigen;
-    int anchoDestino;
-    int altoDestino;
-    int canales;
-    int inicio;
-    int fin;
-} RotacionArgs;
+// Búfer donde se debe producir la siguiente fila de salida
+static unsigned char* filaSumidero(SumideroFilas* s) {
+    if (s->formato != FORMATO_PNG) return s->lote;
+    return s->lote + (size_t)(s->filasEnLote + 1) * s->bytesFila;
+}
 
-void* rotacionHilo(void* args) {
-    RotacionArgs* rArgs = (RotacionArgs*)args;
-    
-    int centroXOrigen = rArgs->anchoOrigen / 2;
-    int centroYOrigen = rArgs->altoOrigen / 2;
-    int centroXDestino = rArgs->anchoDestino / 2;
-    int centroYDestino = rArgs->altoDestino / 2;
-    
-    for (int y = rArgs->inicio; y < rArgs->fin; y++) {
-        for (int x = 0; x < rArgs->anchoDestino; x++) {
-            // Transformación inversa
-            int dx = x - centroXDestino;
-            int dy = y - centroYDestino;
-            
-            float xOrigen = dx * rArgs->cosAngulo + dy * rArgs->sinAngulo + centroXOrigen;
-            float yOrigen = -dx * rArgs->sinAngulo + dy * rArgs->cosAngulo + centroYOrigen;
-            
-            // Interpolación bilineal
-            int x0 = (int)xOrigen;
-            int y0 = (int)yOrigen;
-            int x1 = x0 + 1;
-            int y1 = y0 + 1;
-            
-            if (x0 >= 0 && x1 < rArgs->anchoOrigen && y0 >= 0 && y1 < rArgs->altoOrigen) {
-                float wx = xOrigen - x0;
-                float wy = yOrigen - y0;
-                
-                for (int c = 0; c < rArgs->canales; c++) {
-                    float val = (1-wx)*(1-wy)*rArgs->pixelesOrigen[y0][x0][c] +
-                               wx*(1-wy)*rArgs->pixelesOrigen[y0][x1][c] +
-                               (1-wx)*wy*rArgs->pixelesOrigen[y1][x0][c] +
-                               wx*wy*rArgs->pixelesOrigen[y1][x1][c];
-                    rArgs->pixelesDestino[y][x][c] = (unsigned char)(val + 0.5);
-                }
-            } else {
-                // Pixel fuera de rango, usar negro
-                for (int c = 0; c < rArgs->canales; c++) {
-                    rArgs->pixelesDestino[y][x][c] = 0;
-                }
-            }
+static int escribirFilaSumidero(SumideroFilas* s, const unsigned char* fila) {
+    if (s->formato == FORMATO_PNG) {
+        s->filasEnLote++;
+        if (s->filasEnLote == s->filasPorFranja * s->franjasPorLote || s->escritas + s->filasEnLote == s->alto) {
+            return vaciarLotePNG(s);
         }
+        return 1;
     }
-    return NULL;
+    s->escritas++;
+    size_t bytes = (s->formato == FORMATO_NATIVO) ? s->stride : s->bytesFila;
+    return fwrite(fila, 1, bytes, s->archivo) == bytes;
 }
 
-void rotarImagenConcurrente(ImagenInfo* info, float angulo) {
-    if (!info->pixeles) {
-        printf("No hay imagen cargada.\n");
-        return;
+static int cerrarSumidero(SumideroFilas* s, int ok) {
+    if (ok && s->formato == FORMATO_PNG) ok = escribirFinPNG(s->archivo, s->adler);
+    if (s->archivo) ok = (fclose(s->archivo) == 0) && ok;
+    free(s->lote);
+    free(s->franjas);
+    return ok;
+}
+
+// Aplica el pipeline de entrada a salida fila a fila; devuelve el código de salida
+int ejecutarFlujo(const char* entrada, const char* salida, const Pipeline* pipeline) {
+    for (int i = 0; i < pipeline->numOps; i++) {
+        if (!esOperacionDeFlujo(&pipeline->ops[i])) {
+            fprintf(stderr, "--%s no se puede ejecutar en modo streaming (solo brillo, puntual, "
+                    "desenfoque Gaussiano, bordes y escalar, sin --modo-borde envolver ni --sobel-direccion)\n",
+                    nombreOperacion(pipeline->ops[i].tipo));
+            return 1;
+        }
     }
     
-    float radianes = angulo * M_PI / 180.0;
-    float cosAngulo = cos(radianes);
-    float sinAngulo = sin(radianes);
-    
-    // Calcular nuevas dimensiones
-    int anchoDestino = (int)(fabs(info->ancho * cosAngulo) + fabs(info->alto * sinAngulo)) + 1;
-    int altoDestino = (int)(fabs(info->ancho * sinAngulo) + fabs(info->alto * cosAngulo)) + 1;
-    
-    // Crear imagen destino
-    unsigned char*** pixelesDestino = (unsigned char***)malloc(altoDestino * sizeof(unsigned char**));
-    if (!pixelesDestino) {
-        fprintf(stderr, "Error de memoria en rotación\n");
-        return;
+    Flujo* fl = (Flujo*)calloc(1, sizeof(Flujo));
+    if (!fl) return 1;
+    if (!abrirFuenteFilas(entrada, &fl->fuente)) {
+        free(fl);
+        return 1;
     }
+    MedicionOperacion m;
+    iniciarMedicion(&m, "streaming");
     
-    for (int y = 0; y < altoDestino; y++) {
-        pixelesDestino[y] = (unsigned char**)malloc(anchoDestino * sizeof(unsigned char*));
-        if (!pixelesDestino[y]) {
-            fprintf(stderr, "Error de memoria en fila %d\n", y);
-            for (int j = 0; j < y; j++) {
-                for (int x = 0; x < anchoDestino; x++) {
-                    free(pixelesDestino[j][x]);
-                }
-                free(pixelesDestino[j]);
+    // Las puntuales consecutivas se componen en una sola tabla
+    int ancho = fl->fuente.ancho, alto = fl->fuente.alto, canales = fl->fuente.canales;
+    size_t memoria = 0;
+    int ok = 1;
+    for (int i = 0; i < pipeline->numOps && ok; i++) {
+        const Operacion* op = &pipeline->ops[i];
+        if (op->tipo == OP_BRILLO || op->tipo == OP_PUNTUAL) {
+            EtapaFlujo* previa = fl->numEtapas ? &fl->etapas[fl->numEtapas - 1] : NULL;
+            if (!previa || previa->tipo != ETAPA_FLUJO_TABLA) {
+                previa = &fl->etapas[fl->numEtapas++];
+                memset(previa, 0, sizeof(*previa));
+                previa->tipo = ETAPA_FLUJO_TABLA;
+                previa->anchoEntrada = previa->ancho = ancho;
+                previa->altoEntrada = previa->alto = alto;
+                previa->canalesEntrada = previa->canales = canales;
             }
-            free(pixelesDestino);
-            return;
+            agregarPuntual(&previa->tabla, op);
+            continue;
         }
-        for (int x = 0; x < anchoDestino; x++) {
-            pixelesDestino[y][x] = (unsigned char*)malloc(info->canales * sizeof(unsigned char));
-            if (!pixelesDestino[y][x]) {
-                fprintf(stderr, "Error de memoria en píxel [%d][%d]\n", y, x);
-                for (int j = 0; j <= y; j++) {
-                    int maxX = (j == y) ? x : anchoDestino;
-                    for (int i = 0; i < maxX; i++) {
-                        free(pixelesDestino[j][i]);
-                    }
-                    free(pixelesDestino[j]);
-                }
-                free(pixelesDestino);
-                return;
-            }
+        EtapaFlujo* e = &fl->etapas[fl->numEtapas++];
+        size_t bytes = crearEtapaFlujo(e, op, ancho, alto, canales);
+        if (!bytes) {
+            fprintf(stderr, "Error de memoria al preparar el modo streaming\n");
+            ok = 0;
         }
+        memoria += bytes;
+        ancho = e->ancho;
+        alto = e->alto;
+        canales = e->canales;
     }
     
-    // Configurar hilos
-    const int numHilos = 2;
-    pthread_t hilos[numHilos];
-    RotacionArgs args[numHilos];
-    
-    int filasPorHilo = altoDestino / numHilos;
-    for (int i = 0; i < numHilos; i++) {
-        args[i].pixelesOrigen = info->pixeles;
-        args[i].pixelesDestino = pixelesDestino;
-        args[i].cosAngulo = cosAngulo;
-        args[i].sinAngulo = sinAngulo;
-        args[i].anchoOrigen = info->ancho;
-        args[i].altoOrigen = info->alto;
-        args[i].anchoDestino = anchoDestino;
-        args[i].altoDestino = altoDestino;
-        args[i].canales = info->canales;
-        args[i].inicio = i * filasPorHilo;
-        args[i].fin = (i == numHilos - 1) ? altoDestino : (i + 1) * filasPorHilo;
-        pthread_create(&hilos[i], NULL, rotacionHilo, &args[i]);
-    }
-    
-    // Esperar hilos
-    for (int i = 0; i < numHilos; i++) {
-        pthread_join(hilos[i], NULL);
+    SumideroFilas sumidero;
+    if (ok && !abrirSumidero(&sumidero, salida, ancho, alto, canales)) {
+        fprintf(stderr, "Error al abrir la salida: %s\n", salida);
+        cerrarSumidero(&sumidero, 0);
+        ok = 0;
     }
     
-    // Reemplazar imagen original
-    if (info->pixeles) {
-        for (int y = 0; y < info->alto; y++) {
-            for (int x = 0; x < info->ancho; x++) {
-                free(info->pixeles[y][x]);
-            }
-            free(info->pixeles[y]);
+    if (ok) {
+        memoria += sumidero.reservado;
+        for (int y = 0; y < alto && ok; y++) {
+            unsigned char* fila = filaSumidero(&sumidero);
+            ok = ((fl->numEtapas == 0) ? leerFilaFuente(&fl->fuente, fila)
+                                       : producirFilaEtapa(fl, fl->numEtapas - 1, fila)) &&
+                 escribirFilaSumidero(&sumidero, fila);
         }
-        free(info->pixeles);
+        ok = cerrarSumidero(&sumidero, ok);
+        if (!ok) fprintf(stderr, "Error en el modo streaming al procesar %s\n", entrada);
     }
-    info->pixeles = pixelesDestino;
-    info->ancho = anchoDestino;
-    info->alto = altoDestino;
     
-    printf("Imagen rotada concurrentemente %.1f° con %d hilos (nueva dimensión: %dx%d) en imagen %s.\n", 
-           angulo, numHilos, anchoDestino, altoDestino, info->canales == 1 ? "grises" : "RGB");
+    if (ok) {
+        INFORMAR("Streaming: %dx%d a %dx%d en %d etapas con %.1f MB de trabajo; guardado en %s\n",
+               fl->fuente.ancho, fl->fuente.alto, ancho, alto, fl->numEtapas, memoria / (1024.0 * 1024.0), salida);
+    }
+    ImagenInfo resultado = {ancho, alto, canales, 0, NULL};
+    terminarMedicion(&m, &resultado, ok);
+    for (int s = 0; s < fl->numEtapas; s++) liberarEtapaFlujo(&fl->etapas[s]);
+    cerrarFuenteFilas(&fl->fuente);
+    free(fl);
+    return ok ? 0 : 1;
 }
 
-// ==================== FUNCIÓN 3: DETECCIÓN DE BORDES ====================
+// ==================== MODO LOTE ====================
+
+// Aplica un pipeline a muchas imágenes. El pool reparte imágenes completas
+// entre los hilos; cada imagen se procesa en serie en su hilo salvo las
+// grandes (o si hay menos imágenes que hilos), que además reparten sus filas.
+
+#define UMBRAL_PARALELO_LOTE (4 * 1000 * 1000) // Píxeles a partir de los que una imagen usa el pool
 
-// Estructura para datos de hilos de detección de bordes
 typedef struct {
-    unsigned char*** pixelesOrigen;
-    unsigned char*** pixelesDestino;
-    int inicio;
-    int fin;
-    int ancho;
-    int alto;
-} BordesArgs;
+    char** entradas;
+    int numEntradas;
+    char** salidas;          // Por imagen: ruta de salida, única en el lote
+    const Pipeline* pipeline;
+    int paraleloInterno;     // Hay menos imágenes que hilos: todas reparten filas
+    int* correctas;          // Por imagen: 1 si se procesó y guardó
+    double* megapixeles;     // Por imagen: megapíxeles de entrada
+} LoteArgs;
 
-void* bordesHilo(void* args) {
-    BordesArgs* bArgs = (BordesArgs*)args;
-    
-    // Kernels Sobel
-    int sobelX[3][3] = {{-1, 0, 1}, {-2, 0, 2}, {-1, 0, 1}};
-    int sobelY[3][3] = {{-1, -2, -1}, {0, 0, 0}, {1, 2, 1}};
-    
-    for (int y = bArgs->inicio; y < bArgs->fin; y++) {
-        for (int x = 0; x < bArgs->ancho; x++) {
-            int gx = 0, gy = 0;
-            
-            for (int ky = -1; ky <= 1; ky++) {
-                for (int kx = -1; kx <= 1; kx++) {
-                    int py = y + ky;
-                    int px = x + kx;
-                    
-                    // Manejar bordes (clamp)
-                    py = (py < 0) ? 0 : (py >= bArgs->alto) ? bArgs->alto - 1 : py;
-                    px = (px < 0) ? 0 : (px >= bArgs->ancho) ? bArgs->ancho - 1 : px;
-                    
-                    // Convertir a escala de grises si es necesario
-                    int valor = bArgs->pixelesOrigen[py][px][0];
-                    if (bArgs->pixelesOrigen[py][px] != bArgs->pixelesDestino[py][px]) { // RGB
-                        valor = (bArgs->pixelesOrigen[py][px][0] + 
-                                bArgs->pixelesOrigen[py][px][1] + 
-                                bArgs->pixelesOrigen[py][px][2]) / 3;
-                    }
-                    
-                    gx += valor * sobelX[ky + 1][kx + 1];
-                    gy += valor * sobelY[ky + 1][kx + 1];
-                }
-            }
-            
-            int magnitud = (int)sqrt(gx*gx + gy*gy);
-            bArgs->pixelesDestino[y][x][0] = (magnitud > 255) ? 255 : magnitud;
-        }
+static int compararCadenas(const void* a, const void* b) {
+    return strcmp(*(char* const*)a, *(char* const*)b);
+}
+
+static int esImagenAdmitida(const char* nombre) {
+    size_t n = strlen(nombre);
+    return (n > 4 && strcasecmp(nombre + n - 4, ".png") == 0) ||
+           (formatoPorExtension(nombre) != FORMATO_PNG);
+}
+
+// Añade una copia de ruta a la lista; devuelve 0 si no hay memoria
+static int agregarEntrada(char*** lista, int* num, int* capacidad, const char* ruta) {
+    if (*num == *capacidad) {
+        int nueva = *capacidad ? *capacidad * 2 : 64;
+        char** ampliada = (char**)realloc(*lista, nueva * sizeof(char*));
+        if (!ampliada) return 0;
+        *lista = ampliada;
+        *capacidad = nueva;
     }
-    return NULL;
+    (*lista)[*num] = strdup(ruta);
+    return (*lista)[(*num)++] != NULL;
 }
 
-void detectarBordesConcurrente(ImagenInfo* info) {
-    if (!info->pixeles) {
-        printf("No hay imagen cargada.\n");
-        return;
+// Lista los PNG de un directorio (ordenados) o las rutas de un archivo de texto,
+// una por línea. Devuelve el número de entradas, o -1 si hay error.
+int listarEntradasLote(const char* ruta, char*** entradas) {
+    int num = 0, capacidad = 0, ok = 1;
+    struct stat info;
+    *entradas = NULL;
+    if (stat(ruta, &info) != 0) {
+        fprintf(stderr, "No se puede acceder a %s\n", ruta);
+        return -1;
     }
     
-    // Crear imagen destino (siempre grayscale)
-    unsigned char*** pixelesDestino = (unsigned char***)malloc(info->alto * sizeof(unsigned char**));
-    if (!pixelesDestino) {
-        fprintf(stderr, "Error de memoria en detección de bordes\n");
-        return;
+    if (S_ISDIR(info.st_mode)) {
+        DIR* dir = opendir(ruta);
+        if (!dir) {
+            fprintf(stderr, "No se puede abrir el directorio %s\n", ruta);
+            return -1;
+        }
+        struct dirent* e;
+        char completa[4096];
+        while (ok && (e = readdir(dir)) != NULL) {
+            if (!esImagenAdmitida(e->d_name)) continue;
+            snprintf(completa, sizeof(completa), "%s/%s", ruta, e->d_name);
+            ok = agregarEntrada(entradas, &num, &capacidad, completa);
+        }
+        closedir(dir);
+        if (num > 1) qsort(*entradas, num, sizeof(char*), compararCadenas);
+    } else {
+        FILE* lista = fopen(ruta, "r");
+        if (!lista) {
+            fprintf(stderr, "No se puede abrir la lista %s\n", ruta);
+            return -1;
+        }
+        char linea[4096];
+        while (ok && fgets(linea, sizeof(linea), lista)) {
+            linea[strcspn(linea, "\r\n")] = '\0';
+            if (linea[0] == '\0' || linea[0] == '#') continue;
+            ok = agregarEntrada(entradas, &num, &capacidad, linea);
+        }
+        fclose(lista);
     }
     
-    for (int y = 0; y < info->alto; y++) {
-        pixelesDestino[y] = (unsigned char**)malloc(info->ancho * sizeof(unsigned char*));
-        if (!pixelesDestino[y]) {
-            fprintf(stderr, "Error de memoria en fila %d\n", y);
-            for (int j = 0; j < y; j++) {
-                for (int x = 0; x < info->ancho; x++) {
-                    free(pixelesDestino[j][x]);
-                }
-                free(pixelesDestino[j]);
-            }
-            free(pixelesDestino);
-            return;
+    if (!ok) {
+        fprintf(stderr, "Error de memoria al listar las entradas del lote\n");
+        for (int i = 0; i < num; i++) free((*entradas)[i]);
+        free(*entradas);
+        *entradas = NULL;
+        return -1;
+    }
+    return num;
+}
+
+// Ruta de salida: directorio de salida + nombre de la entrada con extensión .png
+// (con copia >= 2, nombre-copia.png)
+static void rutaSalidaLote(const char* dirSalida, const char* entrada, int copia, char* salida, size_t tam) {
+    const char* nombre = strrchr(entrada, '/');
+    nombre = nombre ? nombre + 1 : entrada;
+    const char* punto = strrchr(nombre, '.');
+    int largo = punto ? (int)(punto - nombre) : (int)strlen(nombre);
+    if (copia < 2) snprintf(salida, tam, "%s/%.*s.png", dirSalida, largo, nombre);
+    else snprintf(salida, tam, "%s/%.*s-%d.png", dirSalida, largo, nombre, copia);
+}
+
+// Inserta ruta en la tabla hash (capacidad potencia de 2, direccionamiento
+// abierto); devuelve 0 si ya estaba
+static int insertarRutaUnica(char** tabla, size_t capacidad, char* ruta) {
+    uint64_t h = 1469598103934665603ull; // FNV-1a
+    for (const char* p = ruta; *p; p++) h = (h ^ (unsigned char)*p) * 1099511628211ull;
+    for (size_t i = h & (capacidad - 1); ; i = (i + 1) & (capacidad - 1)) {
+        if (!tabla[i]) {
+            tabla[i] = ruta;
+            return 1;
         }
-        for (int x = 0; x < info->ancho; x++) {
-            pixelesDestino[y][x] = (unsigned char*)malloc(1 * sizeof(unsigned char));
-            if (!pixelesDestino[y][x]) {
-                fprintf(stderr, "Error de memoria en píxel [%d][%d]\n", y, x);
-                for (int j = 0; j <= y; j++) {
-                    int maxX = (j == y) ? x : info->ancho;
-                    for (int i = 0; i < maxX; i++) {
-                        free(pixelesDestino[j][i]);
-                    }
-                    free(pixelesDestino[j]);
-                }
-                free(pixelesDestino);
-                return;
-            }
+        if (strcmp(tabla[i], ruta) == 0) return 0;
+    }
+}
+
+// Calcula las rutas de salida del lote. Dos entradas con el mismo nombre sin
+// extensión (de directorios distintos, a.png y a.ppm o la misma ruta repetida
+// en la lista) escribirían a la vez en el mismo archivo: la primera conserva
+// el nombre y las siguientes reciben -2, -3... Devuelve 0 si no hay memoria.
+static int asignarSalidasLote(const char* dirSalida, char** entradas, int num, char** salidas) {
+    size_t capacidad = 16;
+    while (capacidad < (size_t)num * 2) capacidad *= 2;
+    char** tabla = (char**)calloc(capacidad, sizeof(char*));
+    if (!tabla) return 0;
+    char ruta[4096];
+    int ok = 1;
+    // Primero los nombres sin sufijo, para que ninguna copia ocupe el de otra entrada
+    for (int i = 0; i < num && ok; i++) {
+        rutaSalidaLote(dirSalida, entradas[i], 0, ruta, sizeof(ruta));
+        salidas[i] = strdup(ruta);
+        ok = salidas[i] != NULL;
+        if (ok && !insertarRutaUnica(tabla, capacidad, salidas[i])) {
+            free(salidas[i]);
+            salidas[i] = NULL; // Repetida: se resuelve abajo
         }
     }
-    
-    // Configurar hilos
-    const int numHilos = 2;
-    pthread_t hilos[numHilos];
-    BordesArgs args[numHilos];
-    
-    int filasPorHilo = info->alto / numHilos;
-    for (int i = 0; i < numHilos; i++) {
-        args[i].pixelesOrigen = info->pixeles;
-        args[i].pixelesDestino = pixelesDestino;
-        args[i].inicio = i * filasPorHilo;
-        args[i].fin = (i == numHilos - 1) ? info->alto : (i + 1) * filasPorHilo;
-        args[i].ancho = info->ancho;
-        args[i].alto = info->alto;
-        pthread_create(&hilos[i], NULL, bordesHilo, &args[i]);
+    for (int i = 0; i < num && ok; i++) {
+        if (salidas[i]) continue;
+        char original[4096];
+        rutaSalidaLote(dirSalida, entradas[i], 0, original, sizeof(original));
+        for (int copia = 2; ok; copia++) {
+            rutaSalidaLote(dirSalida, entradas[i], copia, ruta, sizeof(ruta));
+            salidas[i] = strdup(ruta);
+            ok = salidas[i] != NULL;
+            if (ok && insertarRutaUnica(tabla, capacidad, salidas[i])) break;
+            free(salidas[i]);
+            salidas[i] = NULL;
+        }
+        if (ok) fprintf(stderr, "Aviso: %s también iría a %s; se guarda en %s\n", entradas[i], original, salidas[i]);
     }
-    
-    // Esperar hilos
-    for (int i = 0; i < numHilos; i++) {
-        pthread_join(hilos[i], NULL);
+    free(tabla);
+    return ok;
+}
+
+void loteHilo(void* args, int inicio, int fin) {
+    LoteArgs* lArgs = (LoteArgs*)args;
+    for (int i = inicio; i < fin; i++) {
+        ImagenInfo imagen = {0, 0, 0, 0, NULL};
+        lArgs->correctas[i] = 0;
+        lArgs->megapixeles[i] = 0;
+        if (!cargarImagenMedida(lArgs->entradas[i], &imagen)) continue;
+        
+        double pixeles = (double)imagen.ancho * imagen.alto;
+        int enSerieAnterior = ejecucionEnSerie;
+        ejecucionEnSerie = !lArgs->paraleloInterno && pixeles < UMBRAL_PARALELO_LOTE;
+        if (ejecutarPipeline(&imagen, lArgs->pipeline) &&
+            guardarResultadoPipeline(&imagen, lArgs->pipeline, lArgs->salidas[i])) {
+            lArgs->correctas[i] = 1;
+            lArgs->megapixeles[i] = pixeles / 1e6;
+        } else {
+            fprintf(stderr, "Falló la imagen %s\n", lArgs->entradas[i]);
+        }
+        ejecucionEnSerie = enSerieAnterior;
+        liberarImagen(&imagen);
+    }
+}
+
+// Procesa todas las entradas del lote; devuelve el código de salida
+int ejecutarLote(const char* rutaLote, const char* dirSalida, const Pipeline* pipeline) {
+    char** entradas;
+    int num = listarEntradasLote(rutaLote, &entradas);
+    if (num < 0) return 1;
+    if (num == 0) {
+        fprintf(stderr, "El lote %s no contiene imágenes\n", rutaLote);
+        free(entradas);
+        return 1;
+    }
+    struct stat infoSalida;
+    if (mkdir(dirSalida, 0755) != 0 && (stat(dirSalida, &infoSalida) != 0 || !S_ISDIR(infoSalida.st_mode))) {
+        fprintf(stderr, "No se puede crear el directorio de salida %s\n", dirSalida);
+        for (int i = 0; i < num; i++) free(entradas[i]);
+        free(entradas);
+        return 1;
     }
     
-    // Reemplazar imagen original (preservando dimensiones)
-    if (info->pixeles) {
-        for (int y = 0; y < info->alto; y++) {
-            for (int x = 0; x < info->ancho; x++) {
-                free(info->pixeles[y][x]);
-            }
-            free(info->pixeles[y]);
+    LoteArgs args;
+    args.entradas = entradas;
+    args.numEntradas = num;
+    args.salidas = (char**)calloc(num, sizeof(char*));
+    args.pipeline = pipeline;
+    args.paraleloInterno = num < hilosPool();
+    args.correctas = (int*)calloc(num, sizeof(int));
+    args.megapixeles = (double*)calloc(num, sizeof(double));
+    int estado = 1;
+    if (args.salidas && args.correctas && args.megapixeles &&
+        asignarSalidasLote(dirSalida, entradas, num, args.salidas)) {
+        int silencioAnterior = modoSilencioso;
+        modoSilencioso = 1;
+        double inicio = segundosMonotonicos();
+        ejecutarEnPool(loteHilo, &args, num);
+        double segundos = segundosMonotonicos() - inicio;
+        modoSilencioso = silencioAnterior;
+        
+        int correctas = 0;
+        double megapixeles = 0;
+        for (int i = 0; i < num; i++) {
+            correctas += args.correctas[i];
+            megapixeles += args.megapixeles[i];
         }
-        free(info->pixeles);
+        if (segundos <= 0) segundos = 1e-9;
+        printf("Lote: %d/%d imágenes en %.3f s con %d hilos: %.1f imágenes/s, %.2f MP/s\n",
+               correctas, num, segundos, hilosPool(), correctas / segundos, megapixeles / segundos);
+        estado = (correctas == num) ? 0 : 1;
+    } else {
+        fprintf(stderr, "Error de memoria al preparar el lote\n");
     }
-    info->pixeles = pixelesDestino;
-    info->canales = 1; // Resultado siempre grayscale
     
-    printf("Detección de bordes aplicada concurrentemente con %d hilos (operador Sobel) - resultado: grayscale.\n", numHilos);
+    free(args.correctas);
+    free(args.megapixeles);
+    for (int i = 0; i < num; i++) {
+        free(entradas[i]);
+        if (args.salidas) free(args.salidas[i]);
+    }
+    free(args.salidas);
+    free(entradas);
+    return estado;
 }
 
-// ==================== FUNCIÓN 4: ESCALADO ====================
+// ==================== BENCHMARK ====================
+
+// Mide cada operación sobre imágenes sintéticas de varios tamaños, en grises
+// y RGB, para 1, 2, 4, ... hasta N hilos. Cada medición se repite sobre una
+// copia nueva de la imagen y se resume con la mediana y el percentil 95.
+
+#define MAX_TAMANOS_BENCH 16
+#define MAX_REPETICIONES_BENCH 1000
 
-// Estructura para datos de hilos de escalado
 typedef struct {
-    unsigned char*** pixelesOrigen;
-    unsigned char*** pixelesDestino;
-    int anchoOrigen;
-    int altoOrigen;
-    int anchoDestino;
-    int altoDestino;
+    const char* nombre;
+    Operacion op;
+} CasoBench;
+
+typedef struct {
+    const char* operacion;
+    double megapixeles;
     int canales;
-    int inicio;
-    int fin;
-} EscaladoArgs;
+    int hilos;
+    double mediana;          // Segundos
+    double p95;
+    double mpPorSegundo;     // Megapíxeles de entrada / mediana
+} ResultadoBench;
 
-void* escaladoHilo(void* args) {
-    EscaladoArgs* eArgs = (EscaladoArgs*)args;
-    
-    float ratioX = (float)eArgs->anchoOrigen / eArgs->anchoDestino;
-    float ratioY = (float)eArgs->altoOrigen / eArgs->altoDestino;
-    
-    for (int y = eArgs->inicio; y < eArgs->fin; y++) {
-        for (int x = 0; x < eArgs->anchoDestino; x++) {
-            float xOrigen = x * ratioX;
-            float yOrigen = y * ratioY;
-            
-            int x0 = (int)xOrigen;
-            int y0 = (int)yOrigen;
-            int x1 = (x0 + 1 < eArgs->anchoOrigen) ? x0 + 1 : x0;
-            int y1 = (y0 + 1 < eArgs->altoOrigen) ? y0 + 1 : y0;
-            
-            float wx = xOrigen - x0;
-            float wy = yOrigen - y0;
-            
-            for (int c = 0; c < eArgs->canales; c++) {
-                float val = (1-wx)*(1-wy)*eArgs->pixelesOrigen[y0][x0][c] +
-                           wx*(1-wy)*eArgs->pixelesOrigen[y0][x1][c] +
-                           (1-wx)*wy*eArgs->pixelesOrigen[y1][x0][c] +
-                           wx*wy*eArgs->pixelesOrigen[y1][x1][c];
-                eArgs->pixelesDestino[y][x][c] = (unsigned char)(val + 0.5);
+// Genera una imagen determinista con degradados, bordes y ruido
+int crearImagenSintetica(ImagenInfo* info, int ancho, int alto, int canales) {
+    size_t stride;
+    unsigned char* pixeles = crearBufferPixeles(ancho, alto, canales, &stride);
+    if (!pixeles) return 0;
+    unsigned int semilla = 2024u;
+    for (int y = 0; y < alto; y++) {
+        unsigned char* fila = FILA(pixeles, stride, y);
+        for (int x = 0; x < ancho; x++) {
+            for (int c = 0; c < canales; c++) {
+                semilla = semilla * 1103515245u + 12345u;
+                int base = ((x * 255 / ancho) + (y * 255 / alto) * c) / (c + 1);
+                int bloque = ((x / 32 + y / 32) & 1) ? 40 : 0;
+                int v = base + bloque + (int)((semilla >> 16) & 15) - 8;
+                fila[x * canales + c] = (v < 0) ? 0 : (v > 255) ? 255 : v;
             }
         }
     }
-    return NULL;
+    reemplazarPixeles(info, pixeles, stride, ancho, alto, canales);
+    return 1;
 }
 
-void escalarImagenConcurrente(ImagenInfo* info, int nuevoAncho, int nuevoAlto) {
-    if (!info->pixeles) {
-        printf("No hay imagen cargada.\n");
-        return;
+static int compararDobles(const void* a, const void* b) {
+    double x = *(const double*)a, y = *(const double*)b;
+    return (x > y) - (x < y);
+}
+
+// Interpreta "0.25,1,4"; devuelve el número de tamaños o -1
+int parsearTamanosBench(const char* texto, double* tamanos, int max) {
+    int n = 0, usados;
+    while (*texto) {
+        if (n == max || sscanf(texto, "%lf%n", &tamanos[n], &usados) != 1 || tamanos[n] <= 0) return -1;
+        n++;
+        texto += usados;
+        if (*texto == ',') texto++;
+        else if (*texto) return -1;
     }
-    
-    if (nuevoAncho <= 0 || nuevoAlto <= 0) {
-        printf("Las dimensiones deben ser positivas.\n");
-        return;
+    return n;
+}
+
+// Mide un caso; devuelve 0 si la operación falla o no hay memoria
+static int medirCasoBench(const ImagenInfo* base, const Operacion* op, int repeticiones,
+                          double* mediana, double* p95) {
+    double tiempos[MAX_REPETICIONES_BENCH];
+    ImagenInfo trabajo = {0, 0, 0, 0, NULL};
+    int ok = 1;
+    for (int r = 0; r < repeticiones && ok; r++) {
+        ok = copiarImagen(base, &trabajo);
+        if (!ok) break;
+        double inicio = segundosMonotonicos();
+        ok = ejecutarOperacion(&trabajo, op);
+        tiempos[r] = segundosMonotonicos() - inicio;
+    }
+    liberarImagen(&trabajo);
+    if (!ok) return 0;
+    qsort(tiempos, repeticiones, sizeof(double), compararDobles);
+    *mediana = (repeticiones % 2) ? tiempos[repeticiones / 2]
+                                  : (tiempos[repeticiones / 2 - 1] + tiempos[repeticiones / 2]) / 2;
+    int rango = (int)ceil(0.95 * repeticiones); // Percentil por rango más cercano
+    *p95 = tiempos[rango - 1];
+    return 1;
+}
+
+static void escribirCSVBench(FILE* f, const ResultadoBench* r, int num) {
+    fprintf(f, "operacion,megapixeles,canales,hilos,mediana_ms,p95_ms,mp_por_s\n");
+    for (int i = 0; i < num; i++) {
+        fprintf(f, "%s,%.2f,%d,%d,%.4f,%.4f,%.2f\n", r[i].operacion, r[i].megapixeles, r[i].canales,
+                r[i].hilos, r[i].mediana * 1e3, r[i].p95 * 1e3, r[i].mpPorSegundo);
+    }
+}
+
+static void escribirJSONBench(FILE* f, const ResultadoBench* r, int num) {
+    fprintf(f, "[\n");
+    for (int i = 0; i < num; i++) {
+        fprintf(f, "  {\"operacion\": \"%s\", \"megapixeles\": %.2f, \"canales\": %d, \"hilos\": %d, "
+                   "\"mediana_ms\": %.4f, \"p95_ms\": %.4f, \"mp_por_s\": %.2f}%s\n",
+                r[i].operacion, r[i].megapixeles, r[i].canales, r[i].hilos,
+                r[i].mediana * 1e3, r[i].p95 * 1e3, r[i].mpPorSegundo, (i + 1 < num) ? "," : "");
     }
+    fprintf(f, "]\n");
+}
+
+// Ejecuta el benchmark completo; devuelve el código de salida
+int ejecutarBench(const double* tamanos, int numTamanos, int maxHilos, int repeticiones,
+                  const char* rutaCSV, const char* rutaJSON) {
+    CasoBench casos[] = {
+        {"brillo",         {.tipo = OP_BRILLO, .entero1 = 40}},
+        {"convolucion3",   {.tipo = OP_DESENFOQUE, .entero1 = 3, .real = 1.0f}},
+        {"convolucion7",   {.tipo = OP_DESENFOQUE, .entero1 = 7, .real = 2.0f}},
+        {"convolucion15",  {.tipo = OP_DESENFOQUE, .entero1 = 15, .real = 4.0f}},
+        {"recursivo_iir",  {.tipo = OP_DESENFOQUE, .entero1 = 0, .real = 8.0f}},
+        {"rotar30",        {.tipo = OP_ROTAR, .real = 30.0f}},
+        {"rotar90",        {.tipo = OP_ROTAR, .real = 90.0f}},
+        {"sobel",          {.tipo = OP_BORDES}},
+        {"escalar_x2",     {.tipo = OP_ESCALAR}},
+        {"escalar_x0.5",   {.tipo = OP_ESCALAR}},
+    };
+    int numCasos = (int)(sizeof(casos) / sizeof(casos[0]));
+    int numHilosProbados = 0;
+    for (int h = 1; h < maxHilos; h *= 2) numHilosProbados++;
+    numHilosProbados++;
     
-    // Crear imagen destino
-    unsigned char*** pixelesDestino = (unsigned char***)malloc(nuevoAlto * sizeof(unsigned char**));
-    if (!pixelesDestino) {
-        fprintf(stderr, "Error de memoria en escalado\n");
-        return;
+    int capacidad = numTamanos * 2 * numHilosProbados * numCasos;
+    ResultadoBench* resultados = (ResultadoBench*)malloc(capacidad * sizeof(ResultadoBench));
+    if (!resultados) {
+        fprintf(stderr, "Error de memoria al preparar el benchmark\n");
+        return 1;
     }
+    int num = 0, estado = 0;
+    int silencioAnterior = modoSilencioso;
+    modoSilencioso = 1;
     
-    for (int y = 0; y < nuevoAlto; y++) {
-        pixelesDestino[y] = (unsigned char**)malloc(nuevoAncho * sizeof(unsigned char*));
-        if (!pixelesDestino[y]) {
-            fprintf(stderr, "Error de memoria en fila %d\n", y);
-            for (int j = 0; j < y; j++) {
-                for (int x = 0; x < nuevoAncho; x++) {
-                    free(pixelesDestino[j][x]);
-                }
-                free(pixelesDestino[j]);
+    printf("%-14s %8s %5s %5s %12s %12s %10s\n", "operacion", "MP", "canal", "hilos", "mediana(ms)", "p95(ms)", "MP/s");
+    for (int t = 0; t < numTamanos && estado == 0; t++) {
+        // Imágenes de proporción 4:3 con el número de megapíxeles pedido
+        int ancho = (int)(sqrt(tamanos[t] * 1e6 * 4 / 3) + 0.5);
+        int alto = (int)(tamanos[t] * 1e6 / ancho + 0.5);
+        for (int canales = 1; canales <= 3 && estado == 0; canales += 2) {
+            ImagenInfo base = {0, 0, 0, 0, NULL};
+            if (!crearImagenSintetica(&base, ancho, alto, canales)) {
+                estado = 1;
+                break;
             }
-            free(pixelesDestino);
-            return;
-        }
-        for (int x = 0; x < nuevoAncho; x++) {
-            pixelesDestino[y][x] = (unsigned char*)malloc(info->canales * sizeof(unsigned char));
-            if (!pixelesDestino[y][x]) {
-                fprintf(stderr, "Error de memoria en píxel [%d][%d]\n", y, x);
-                for (int j = 0; j <= y; j++) {
-                    int maxX = (j == y) ? x : nuevoAncho;
-                    for (int i = 0; i < maxX; i++) {
-                        free(pixelesDestino[j][i]);
+            double mp = (double)ancho * alto / 1e6;
+            casos[8].op.entero1 = ancho * 2;  casos[8].op.entero2 = alto * 2;
+            casos[9].op.entero1 = ancho / 2;  casos[9].op.entero2 = alto / 2;
+            
+            for (int h = 1; estado == 0; h = (h * 2 < maxHilos) ? h * 2 : maxHilos) {
+                inicializarPool(h);
+                for (int c = 0; c < numCasos; c++) {
+                    ResultadoBench* r = &resultados[num];
+                    if (!medirCasoBench(&base, &casos[c].op, repeticiones, &r->mediana, &r->p95)) {
+                        fprintf(stderr, "Falló %s en %dx%d\n", casos[c].nombre, ancho, alto);
+                        estado = 1;
+                        break;
                     }
-                    free(pixelesDestino[j]);
+                    r->operacion = casos[c].nombre;
+                    r->megapixeles = mp;
+                    r->canales = canales;
+                    r->hilos = hilosPool();
+                    r->mpPorSegundo = mp / r->mediana;
+                    printf("%-14s %8.2f %5d %5d %12.3f %12.3f %10.1f\n", r->operacion, mp, canales,
+                           r->hilos, r->mediana * 1e3, r->p95 * 1e3, r->mpPorSegundo);
+                    num++;
                 }
-                free(pixelesDestino);
-                return;
+                if (h == maxHilos) break;
             }
+            liberarImagen(&base);
         }
     }
+    modoSilencioso = silencioAnterior;
     
-    // Configurar hilos
-    const int numHilos = 2;
-    pthread_t hilos[numHilos];
-    EscaladoArgs args[numHilos];
-    
-    int filasPorHilo = nuevoAlto / numHilos;
-    for (int i = 0; i < numHilos; i++) {
-        args[i].pixelesOrigen = info->pixeles;
-        args[i].pixelesDestino = pixelesDestino;
-        args[i].anchoOrigen = info->ancho;
-        args[i].altoOrigen = info->alto;
-        args[i].anchoDestino = nuevoAncho;
-        args[i].altoDestino = nuevoAlto;
-        args[i].canales = info->canales;
-        args[i].inicio = i * filasPorHilo;
-        args[i].fin = (i == numHilos - 1) ? nuevoAlto : (i + 1) * filasPorHilo;
-        pthread_create(&hilos[i], NULL, escaladoHilo, &args[i]);
+    FILE* f;
+    if (rutaCSV) {
+        if ((f = fopen(rutaCSV, "w")) != NULL) {
+            escribirCSVBench(f, resultados, num);
+            fclose(f);
+        } else {
+            fprintf(stderr, "No se pudo escribir %s\n", rutaCSV);
+            estado = 1;
+        }
     }
-    
-    // Esperar hilos
-    for (int i = 0; i < numHilos; i++) {
-        pthread_join(hilos[i], NULL);
+    if (rutaJSON) {
+        if ((f = fopen(rutaJSON, "w")) != NULL) {
+            escribirJSONBench(f, resultados, num);
+            fclose(f);
+        } else {
+            fprintf(stderr, "No se pudo escribir %s\n", rutaJSON);
+            estado = 1;
+        }
     }
-    
-    // Reemplazar imagen original
-    int anchoOriginal = info->ancho;
-    int altoOriginal = info->alto;
-    if (info->pixeles) {
-        for (int y = 0; y < info->alto; y++) {
-            for (int x = 0; x < info->ancho; x++) {
-                free(info->pixeles[y][x]);
+    free(resultados);
+    return estado;
+}
+
+// ==================== AUTOPRUEBA SIMD ====================
+
+// Compara cada implementación SIMD disponible con la escalar sobre datos
+// pseudoaleatorios. Devuelve el número de discrepancias encontradas.
+int autopruebaSIMD() {
+    const FuncionesFila* candidatas[2];
+    int numCandidatas = 0;
+#ifdef IMG_X86
+    candidatas[numCandidatas++] = &funcionesSSE2;
+    if (cpuSoportaAVX2()) candidatas[numCandidatas++] = &funcionesAVX2;
+#endif
+    if (numCandidatas == 0) {
+        printf("Autoprueba SIMD: sin implementaciones SIMD en esta arquitectura.\n");
+        return 0;
+    }
+
+    const int anchoMax = 203, tamMax = 31;
+    unsigned char filas[3][anchoMax * 3];
+    unsigned char esperado[anchoMax * 3], obtenido[anchoMax * 3];
+    float intermedio[tamMax][anchoMax * 3];
+    float refH[anchoMax * 3], simdH[anchoMax * 3];
+    const float* punteros[tamMax];
+    short intermedioFijo[tamMax][anchoMax * 3];
+    short refFijoH[anchoMax * 3], simdFijoH[anchoMax * 3];
+    const short* punterosFijo[tamMax];
+    unsigned char lut[256];
+    unsigned int semilla = 12345;
+    int errores = 0;
+
+    for (int i = 0; i < 3; i++)
+        for (int j = 0; j < anchoMax * 3; j++) {
+            semilla = semilla * 1103515245u + 12345u;
+            filas[i][j] = (unsigned char)(semilla >> 16);
+        }
+    for (int k = 0; k < tamMax; k++) {
+        for (int j = 0; j < anchoMax * 3; j++) {
+            semilla = semilla * 1103515245u + 12345u;
+            intermedio[k][j] = (float)((semilla >> 16) % 25600) / 100.0f;
+            intermedioFijo[k][j] = (short)((semilla >> 16) % ((255 << BITS_INTERMEDIO_FIJO) + 1));
+        }
+        punteros[k] = intermedio[k];
+        punterosFijo[k] = intermedioFijo[k];
+    }
+
+    for (int c = 0; c < numCandidatas; c++) {
+        const FuncionesFila* f = candidatas[c];
+        int fallosAntes = errores;
+        for (int ancho = 1; ancho <= anchoMax; ancho += (ancho < 40) ? 1 : 27) {
+            for (int delta = -300; delta <= 300; delta += 37) {
+                memcpy(esperado, filas[0], ancho * 3);
+                memcpy(obtenido, filas[0], ancho * 3);
+                brilloFilaEscalar(esperado, ancho * 3, delta);
+                f->brilloFila(obtenido, ancho * 3, delta);
+                errores += memcmp(esperado, obtenido, ancho * 3) != 0;
+            }
+            for (int canales = 1; canales <= 3; canales += 2) {
+                for (int tam = 3; tam <= tamMax; tam += 4) {
+                    float* kernel = generarKernelGaussiano(tam, tam / 4.0f);
+                    if (!kernel) continue;
+                    convolucionFilaHEscalar(filas[0], refH, ancho, canales, kernel, tam);
+                    f->convolucionFilaH(filas[0], simdH, ancho, canales, kernel, tam);
+                    errores += memcmp(refH, simdH, ancho * canales * sizeof(float)) != 0;
+                    convolucionFilaVEscalar(punteros, esperado, ancho * canales, kernel, tam);
+                    f->convolucionFilaV(punteros, obtenido, ancho * canales, kernel, tam);
+                    errores += memcmp(esperado, obtenido, ancho * canales) != 0;
+                    free(kernel);
+                }
+                // Punto fijo: SIMD y escalar especializado contra el bucle genérico,
+                // alternando kernels estrechos y casi planos (5, 9 y 21)
+                for (int tam = 3; tam <= tamMax; tam += (tam < 11) ? 2 : 10) {
+                    float* kernel = generarKernelGaussiano(tam, (tam % 4 == 1) ? tam * 4.0f : tam / 4.0f);
+                    if (!kernel) continue;
+                    short pesosH[tamMax], pesosV[tamMax];
+                    if (!cuantificarKernel(kernel, tam, BITS_FIJO_H, pesosH) ||
+                        !cuantificarKernel(kernel, tam, BITS_FIJO_V, pesosV)) {
+                        free(kernel);
+                        continue;
+                    }
+                    convolucionFijaHGenerica(filas[0], refFijoH, ancho, canales, pesosH, tam);
+                    f->convolucionFijaH(filas[0], simdFijoH, ancho, canales, pesosH, tam);
+                    errores += memcmp(refFijoH, simdFijoH, ancho * canales * sizeof(short)) != 0;
+                    convolucionFijaHEscalar(filas[0], simdFijoH, ancho, canales, pesosH, tam);
+                    errores += memcmp(refFijoH, simdFijoH, ancho * canales * sizeof(short)) != 0;
+                    convolucionFijaVGenerica(punterosFijo, esperado, ancho * canales, pesosV, tam);
+                    f->convolucionFijaV(punterosFijo, obtenido, ancho * canales, pesosV, tam);
+                    errores += memcmp(esperado, obtenido, ancho * canales) != 0;
+                    convolucionFijaVEscalar(punterosFijo, obtenido, ancho * canales, pesosV, tam);
+                    errores += memcmp(esperado, obtenido, ancho * canales) != 0;
+                    free(kernel);
+                }
+            }
+            for (int i = 0; i < 256; i++) {
+                semilla = semilla * 1103515245u + 12345u;
+                lut[i] = (unsigned char)(semilla >> 16);
             }
-            free(info->pixeles[y]);
+            memcpy(esperado, filas[0], ancho * 3);
+            memcpy(obtenido, filas[0], ancho * 3);
+            lutFilaEscalar(esperado, ancho * 3, lut);
+            f->lutFila(obtenido, ancho * 3, lut);
+            errores += memcmp(esperado, obtenido, ancho * 3) != 0;
+            MagnitudSobel magnitudAnterior = opcionesSobel.magnitud;
+            for (int modo = MAGNITUD_EXACTA; modo <= MAGNITUD_APROX; modo++) {
+                opcionesSobel.magnitud = (MagnitudSobel)modo;
+                unsigned char dirEsperada[anchoMax], dirObtenida[anchoMax];
+                sobelFilaEscalar(filas[0], filas[1], filas[2], esperado, dirEsperada, ancho);
+                f->sobelFila(filas[0], filas[1], filas[2], obtenido, dirObtenida, ancho);
+                errores += memcmp(esperado, obtenido, ancho) != 0;
+                errores += memcmp(dirEsperada, dirObtenida, ancho) != 0;
+                f->sobelFila(filas[0], filas[1], filas[2], obtenido, NULL, ancho);
+                errores += memcmp(esperado, obtenido, ancho) != 0;
+            }
+            opcionesSobel.magnitud = magnitudAnterior;
         }
-        free(info->pixeles);
+        printf("Autoprueba SIMD %-7s: %s\n", f->nombre, errores == fallosAntes ? "OK" : "DIFERENCIAS");
     }
-    info->pixeles = pixelesDestino;
-    info->ancho = nuevoAncho;
-    info->alto = nuevoAlto;
-    
-    printf("Imagen escalada concurrentemente con %d hilos (de %dx%d a %dx%d) en imagen %s.\n", 
-           numHilos, anchoOriginal, altoOriginal, nuevoAncho, nuevoAlto, info->canales == 1 ? "grises" : "RGB");
+    return errores;
 }
 
 // ==================== MENÚ PRINCIPAL ====================
@@ -810,18 +5920,272 @@ void mostrarMenu() {
     printf("2. Mostrar matriz de píxeles\n");
     printf("3. Guardar como PNG\n");
     printf("4. Ajustar brillo (+/- valor) concurrentemente\n");
-    printf("5. Aplicar convolución (filtro Gaussiano)\n");
+    printf("5. Aplicar convolución (filtro Gaussiano o recursivo IIR)\n");
     printf("6. Rotar imagen\n");
     printf("7. Detectar bordes (operador Sobel)\n");
     printf("8. Escalar imagen (resize)\n");
     printf("9. Salir\n");
+    printf("10. Operaciones puntuales encadenadas (brillo, contraste, gamma, invertir, umbral, niveles)\n");
     printf("Opción: ");
 }
 
-int main() {
-    ImagenInfo imagen = {0, 0, 0, NULL};
+void mostrarUso(const char* programa) {
+    printf("Uso: %s [-t N | --hilos N] [--autoprueba] [imagen.png]\n", programa);
+    printf("     %s [-t N] -i entrada.png [operaciones...] -o salida.png\n", programa);
+    printf("     %s [-t N] --streaming -i entrada.ppm [operaciones...] -o salida.png\n", programa);
+    printf("     %s [-t N] --lote DIR|LISTA [operaciones...] --dir-salida DIR\n", programa);
+    printf("     %s [-t N] --bench [--bench-tamanos L] [--bench-reps N] [--bench-csv RUTA] [--bench-json RUTA]\n", programa);
+    printf("  -t, --hilos N       Hilos del pool (por defecto: CPUs en línea o IMG_HILOS)\n");
+    printf("  --autoprueba        Compara los núcleos SIMD con los escalares y termina\n");
+    printf("  --pool-mb N         MB máximos de buffers libres guardados para reutilizar\n");
+    printf("                      (por defecto: %d o IMG_POOL_MB; 0 desactiva el pool)\n", LIMITE_POOL_BUFFERS_MB);
+    printf("  --png PRESET        Compresión de los PNG guardados: rapido, normal (por defecto) o max\n");
+    printf("  --png-nivel N       Nivel de compresión 0..%d (0 = sin comprimir; normal = %d)\n", NIVEL_PNG_LIMITE, NIVEL_PNG_NORMAL);
+    printf("  --png-filtro F      heuristico, muestreo o un filtro fijo: ninguno, sub, up, media, paeth\n");
+    printf("  --sin-fusion        Ejecuta cada operación por separado en lugar de fusionar tramos\n");
+    printf("  --modo-borde M      Píxeles fuera de la imagen en desenfoque y bordes: replicar (por\n");
+    printf("                      defecto), reflejar, envolver o constante[:V] (V = 0..255)\n");
+    printf("  --conv-entera       Desenfoque Gaussiano en punto fijo (pesos de 16 bits, ±1 respecto a float)\n");
+    printf("  --sobel-magnitud M  Magnitud de bordes: exacta (raíz, por defecto) o aprox (max + 3/8 min)\n");
+    printf("  --sobel-direccion RUTA  Guarda también la dirección del gradiente en 4 sectores\n");
+    printf("                      (0, 85, 170, 255 = 0°, 45°, 90°, 135°) para adelgazar bordes;\n");
+    printf("                      necesita un único --bordes y falla si no se puede guardar\n");
+    printf("  --estadisticas      Tras cada operación: reserva, liberación, despacho/espera del pool,\n");
+    printf("                      núcleo por hilo y desequilibrio (alias --stats)\n");
+    printf("  --estadisticas-json RUTA  Añade lo mismo a RUTA, una línea JSON por operación\n");
+    printf("  -i, --entrada RUTA  Imagen de entrada (modo no interactivo)\n");
+    printf("  -o, --salida RUTA   Salida; se guarda una vez tras todas las operaciones\n");
+    printf("                      (.imgn = nativo sin comprimir para mmap, .pgm/.ppm = PNM, otro = PNG)\n");
+    printf("  --streaming         Procesa fila a fila sin cargar la imagen entera (alias --flujo;\n");
+    printf("                      solo brillo, puntual, desenfoque Gaussiano, bordes y escalar;\n");
+    printf("                      entrada PNM, PNG no entrelazado o .imgn)\n");
+    printf("  --lote RUTA         Directorio de imágenes o archivo con una ruta por línea (modo lote)\n");
+    printf("  --dir-salida DIR    Directorio donde el modo lote guarda cada resultado\n");
+    printf("  --bench             Mide las operaciones con imágenes sintéticas para 1..N hilos y termina\n");
+    printf("  --bench-tamanos L   Megapíxeles separados por comas (por defecto: 0.25,1,4,16,100)\n");
+    printf("  --bench-reps N      Repeticiones por medición (por defecto: 5)\n");
+    printf("  --bench-csv RUTA    Guarda los resultados en CSV\n");
+    printf("  --bench-json RUTA   Guarda los resultados en JSON\n");
+    printf("Operaciones (se aplican en el orden dado):\n");
+    for (int i = 0; i < NUM_OPCIONES_OPERACION; i++) {
+        const OpcionOperacion* o = &opcionesOperacion[i];
+        printf("  %s, %s %s\n", o->opcion, o->alias, o->argumento ? o->argumento : "");
+    }
+    printf("  (--desenfoque: TAM impar de 3 a %d, o 0 para el filtro recursivo IIR)\n", MAX_TAM_KERNEL);
+    printf("  (--miniaturas va al final: guarda salida_L.png para cada lado mayor L)\n");
+}
+
+int main(int argc, char* argv[]) {
+    ImagenInfo imagen = {0, 0, 0, 0, NULL};
+    static Pipeline pendientes;
+    Operacion op;
     int opcion;
+    int autoprueba = 0;
     char ruta[256];
+    int numHilos = hilosPorDefecto();
+    const char* rutaInicial = NULL;
+    const char* rutaSalida = NULL;
+    const char* rutaLote = NULL;
+    const char* dirSalida = NULL;
+    int streaming = 0;
+    static Pipeline pipeline;
+    int bench = 0;
+    double tamanos[MAX_TAMANOS_BENCH] = {0.25, 1, 4, 16, 100};
+    int numTamanos = 5;
+    int repeticiones = 5;
+    const char* rutaCSV = NULL;
+    const char* rutaJSON = NULL;
+    
+    const char* limitePool = getenv("IMG_POOL_MB");
+    if (limitePool && atol(limitePool) >= 0) fijarLimitePoolBuffers((size_t)atol(limitePool));
+    
+    for (int i = 1; i < argc; i++) {
+        const OpcionOperacion* opcionOp = buscarOpcionOperacion(argv[i]);
+        if (opcionOp) {
+            if (pipeline.numOps == MAX_OPERACIONES) {
+                fprintf(stderr, "Demasiadas operaciones (máximo %d)\n", MAX_OPERACIONES);
+                return 1;
+            }
+            const char* valor = "";
+            if (opcionOp->argumento) {
+                if (i + 1 >= argc) {
+                    fprintf(stderr, "Falta el valor de %s (%s)\n", argv[i], opcionOp->argumento);
+                    return 1;
+                }
+                valor = argv[++i];
+            }
+            if (!parsearOperacion(opcionOp->tipo, valor, &pipeline.ops[pipeline.numOps])) {
+                fprintf(stderr, "Valor inválido para %s: %s (formato: %s)\n", argv[i - 1], valor, opcionOp->argumento);
+                return 1;
+            }
+            pipeline.numOps++;
+        } else if ((strcmp(argv[i], "-i") == 0 || strcmp(argv[i], "--entrada") == 0) && i + 1 < argc) {
+            rutaInicial = argv[++i];
+        } else if ((strcmp(argv[i], "-o") == 0 || strcmp(argv[i], "--salida") == 0) && i + 1 < argc) {
+            rutaSalida = argv[++i];
+        } else if ((strcmp(argv[i], "--lote") == 0 || strcmp(argv[i], "--batch") == 0) && i + 1 < argc) {
+            rutaLote = argv[++i];
+        } else if ((strcmp(argv[i], "--dir-salida") == 0 || strcmp(argv[i], "--output-dir") == 0) && i + 1 < argc) {
+            dirSalida = argv[++i];
+        } else if (strcmp(argv[i], "--streaming") == 0 || strcmp(argv[i], "--flujo") == 0) {
+            streaming = 1;
+        } else if (strcmp(argv[i], "--bench") == 0) {
+            bench = 1;
+        } else if (strcmp(argv[i], "--bench-tamanos") == 0 && i + 1 < argc) {
+            numTamanos = parsearTamanosBench(argv[++i], tamanos, MAX_TAMANOS_BENCH);
+            if (numTamanos <= 0) {
+                fprintf(stderr, "Lista de tamaños inválida: %s\n", argv[i]);
+                return 1;
+            }
+        } else if (strcmp(argv[i], "--bench-reps") == 0 && i + 1 < argc) {
+            repeticiones = atoi(argv[++i]);
+            if (repeticiones < 1 || repeticiones > MAX_REPETICIONES_BENCH) {
+                fprintf(stderr, "Repeticiones inválidas: %s\n", argv[i]);
+                return 1;
+            }
+        } else if (strcmp(argv[i], "--bench-csv") == 0 && i + 1 < argc) {
+            rutaCSV = argv[++i];
+        } else if (strcmp(argv[i], "--bench-json") == 0 && i + 1 < argc) {
+            rutaJSON = argv[++i];
+        } else if (strcmp(argv[i], "--pool-mb") == 0 && i + 1 < argc) {
+            char* fin;
+            long megabytes = strtol(argv[++i], &fin, 10);
+            if (*fin != '\0' || megabytes < 0) {
+                fprintf(stderr, "Límite del pool de buffers inválido: %s\n", argv[i]);
+                return 1;
+            }
+            fijarLimitePoolBuffers((size_t)megabytes);
+        } else if (strcmp(argv[i], "--sin-fusion") == 0 || strcmp(argv[i], "--no-fusion") == 0) {
+            fusionHabilitada = 0;
+        } else if ((strcmp(argv[i], "--modo-borde") == 0 || strcmp(argv[i], "--edge-mode") == 0) && i + 1 < argc) {
+            if (!fijarModoBorde(argv[++i])) {
+                fprintf(stderr, "Modo de borde inválido: %s (replicar, reflejar, envolver o constante[:V])\n", argv[i]);
+                return 1;
+            }
+        } else if (strcmp(argv[i], "--conv-entera") == 0 || strcmp(argv[i], "--fixed-conv") == 0) {
+            convolucionEntera = 1;
+        } else if ((strcmp(argv[i], "--sobel-magnitud") == 0 || strcmp(argv[i], "--sobel-magnitude") == 0) && i + 1 < argc) {
+            i++;
+            if (strcmp(argv[i], "exacta") == 0 || strcmp(argv[i], "exact") == 0) {
+                opcionesSobel.magnitud = MAGNITUD_EXACTA;
+            } else if (strcmp(argv[i], "aprox") == 0 || strcmp(argv[i], "approx") == 0) {
+                opcionesSobel.magnitud = MAGNITUD_APROX;
+            } else {
+                fprintf(stderr, "Magnitud de Sobel inválida: %s (exacta o aprox)\n", argv[i]);
+                return 1;
+            }
+        } else if ((strcmp(argv[i], "--sobel-direccion") == 0 || strcmp(argv[i], "--sobel-direction") == 0) && i + 1 < argc) {
+            opcionesSobel.rutaDireccion = argv[++i];
+        } else if (strcmp(argv[i], "--estadisticas") == 0 || strcmp(argv[i], "--stats") == 0) {
+            estadisticas.verboso = 1;
+        } else if ((strcmp(argv[i], "--estadisticas-json") == 0 || strcmp(argv[i], "--stats-json") == 0) && i + 1 < argc) {
+            if (estadisticas.json) fclose(estadisticas.json);
+            estadisticas.json = fopen(argv[++i], "a");
+            if (!estadisticas.json) {
+                fprintf(stderr, "No se puede abrir %s\n", argv[i]);
+                return 1;
+            }
+        } else if (strcmp(argv[i], "--png") == 0 && i + 1 < argc) {
+            if (!fijarPresetPNG(argv[++i])) {
+                fprintf(stderr, "Preset PNG inválido: %s (rapido, normal o max)\n", argv[i]);
+                return 1;
+            }
+        } else if (strcmp(argv[i], "--png-nivel") == 0 && i + 1 < argc) {
+            char* fin;
+            long nivel = strtol(argv[++i], &fin, 10);
+            if (*fin != '\0' || !fijarNivelPNG((int)nivel)) {
+                fprintf(stderr, "Nivel PNG inválido: %s (0..%d)\n", argv[i], NIVEL_PNG_LIMITE);
+                return 1;
+            }
+        } else if (strcmp(argv[i], "--png-filtro") == 0 && i + 1 < argc) {
+            if (!fijarFiltroPNG(argv[++i])) {
+                fprintf(stderr, "Filtro PNG inválido: %s\n", argv[i]);
+                return 1;
+            }
+        } else if ((strcmp(argv[i], "-t") == 0 || strcmp(argv[i], "--hilos") == 0) && i + 1 < argc) {
+            numHilos = atoi(argv[++i]);
+            if (numHilos < 1) {
+                fprintf(stderr, "Número de hilos inválido: %s\n", argv[i]);
+                return 1;
+            }
+        } else if (strcmp(argv[i], "--autoprueba") == 0) {
+            autoprueba = 1;
+        } else if (strcmp(argv[i], "-h") == 0 || strcmp(argv[i], "--help") == 0) {
+            mostrarUso(argv[0]);
+            return 0;
+        } else if (argv[i][0] != '-' && !rutaInicial) {
+            rutaInicial = argv[i];
+        } else {
+            mostrarUso(argv[0]);
+            return 1;
+        }
+    }
+    
+    for (int i = 0; i + 1 < pipeline.numOps; i++) {
+        if (pipeline.ops[i].tipo == OP_MINIATURAS) {
+            fprintf(stderr, "--miniaturas debe ser la última operación\n");
+            return 1;
+        }
+    }
+    
+    inicializarSIMD();
+    if (autoprueba) {
+        return autopruebaSIMD() == 0 ? 0 : 1;
+    }
+    if (bench) {
+        int estado = ejecutarBench(tamanos, numTamanos, numHilos, repeticiones, rutaCSV, rutaJSON);
+        destruirPool();
+        vaciarPoolBuffers();
+        return estado;
+    }
+    inicializarPool(numHilos);
+    
+    // Modo lote: el mismo pipeline para cada imagen de un directorio o lista
+    if (rutaLote || dirSalida) {
+        if (!rutaLote || !dirSalida || rutaInicial || rutaSalida || streaming || opcionesSobel.rutaDireccion) {
+            fprintf(stderr, "El modo lote necesita --lote y --dir-salida (sin -i, -o, --streaming ni --sobel-direccion)\n");
+            destruirPool();
+            vaciarPoolBuffers();
+            return 1;
+        }
+        int estado = ejecutarLote(rutaLote, dirSalida, &pipeline);
+        mostrarEstadisticasBuffers();
+        destruirPool();
+        vaciarPoolBuffers();
+        return estado;
+    }
+    
+    // La dirección de Sobel se guarda una vez: necesita un único --bordes en el pipeline
+    if (opcionesSobel.rutaDireccion) {
+        int numBordes = 0;
+        for (int i = 0; i < pipeline.numOps; i++) numBordes += pipeline.ops[i].tipo == OP_BORDES;
+        if (numBordes != 1) {
+            fprintf(stderr, "--sobel-direccion necesita exactamente una operación --bordes en el pipeline\n");
+            destruirPool();
+            vaciarPoolBuffers();
+            return 1;
+        }
+    }
+    
+    // Modo no interactivo: cargar, aplicar las operaciones, guardar y salir
+    if (rutaSalida || pipeline.numOps > 0 || streaming) {
+        if (!rutaInicial || !rutaSalida) {
+            fprintf(stderr, "El modo no interactivo necesita -i entrada.png y -o salida.png\n");
+            destruirPool();
+            vaciarPoolBuffers();
+            return 1;
+        }
+        int estado = streaming ? ejecutarFlujo(rutaInicial, rutaSalida, &pipeline)
+                               : ejecutarLineaComandos(rutaInicial, rutaSalida, &pipeline);
+        destruirPool();
+        vaciarPoolBuffers();
+        return estado;
+    }
+    
+    printf("Pool de hilos: %d hilos, núcleos SIMD: %s\n", hilosPool(), simd.nombre);
+    if (rutaInicial) {
+        cargarImagenMedida(rutaInicial, &imagen);
+    }
     
     while (1) {
         mostrarMenu();
@@ -835,11 +6199,13 @@ int main() {
             case 1:
                 printf("Ingresa la ruta del archivo PNG: ");
                 scanf("%255s", ruta);
+                pendientes.numOps = 0;
                 liberarImagen(&imagen);
-                cargarImagen(ruta, &imagen);
+                cargarImagenMedida(ruta, &imagen);
                 break;
                 
             case 2:
+                if (!materializarPendientes(&imagen, &pendientes)) break;
                 mostrarMatriz(&imagen);
                 break;
                 
@@ -848,9 +6214,10 @@ int main() {
                     printf("No hay imagen cargada.\n");
                     break;
                 }
-                printf("Nombre del archivo PNG de salida: ");
+                printf("Nombre del archivo de salida (.png, .imgn, .pgm/.ppm): ");
                 scanf("%255s", ruta);
-                guardarPNG(&imagen, ruta);
+                if (!materializarPendientes(&imagen, &pendientes)) break;
+                guardarImagenMedida(&imagen, ruta);
                 break;
                 
             case 4:
@@ -865,7 +6232,10 @@ int main() {
                     while (getchar() != '\n');
                     break;
                 }
-                ajustarBrilloConcurrente(&imagen, delta);
+                memset(&op, 0, sizeof(op));
+                op.tipo = OP_BRILLO;
+                op.entero1 = delta;
+                registrarPendiente(&imagen, &pendientes, &op);
                 break;
                 
             case 5:
@@ -875,19 +6245,33 @@ int main() {
                 }
                 int tamKernel;
                 float sigma;
-                printf("Tamaño del kernel (3 o 5): ");
+                printf("Tamaño del kernel (impar, ej: 3, 5, 15; 0 = recursivo IIR para sigma grande): ");
                 if (scanf("%d", &tamKernel) != 1) {
                     printf("Entrada inválida.\n");
                     while (getchar() != '\n');
                     break;
                 }
+                if (tamKernel < 0 || tamKernel > MAX_TAM_KERNEL) {
+                    printf("El tamaño del kernel debe estar entre 0 y %d.\n", MAX_TAM_KERNEL);
+                    break;
+                }
                 printf("Valor de sigma para kernel Gaussiano (ej: 1.0): ");
                 if (scanf("%f", &sigma) != 1) {
                     printf("Entrada inválida.\n");
                     while (getchar() != '\n');
                     break;
                 }
-                aplicarConvolucionConcurrente(&imagen, tamKernel, sigma);
+                memset(&op, 0, sizeof(op));
+                op.tipo = OP_DESENFOQUE;
+                op.entero1 = tamKernel;
+                op.real = sigma;
+                if (esFusionable(&op)) {
+                    registrarPendiente(&imagen, &pendientes, &op);
+                } else if (tamKernel == 0) {
+                    if (materializarPendientes(&imagen, &pendientes)) ejecutarOperacionMedida(&imagen, &op);
+                } else {
+                    ejecutarOperacionMedida(&imagen, &op); // Informa del error
+                }
                 break;
                 
             case 6:
@@ -902,7 +6286,11 @@ int main() {
                     while (getchar() != '\n');
                     break;
                 }
-                rotarImagenConcurrente(&imagen, angulo);
+                if (!materializarPendientes(&imagen, &pendientes)) break;
+                memset(&op, 0, sizeof(op));
+                op.tipo = OP_ROTAR;
+                op.real = angulo;
+                ejecutarOperacionMedida(&imagen, &op);
                 break;
                 
             case 7:
@@ -910,7 +6298,9 @@ int main() {
                     printf("No hay imagen cargada.\n");
                     break;
                 }
-                detectarBordesConcurrente(&imagen);
+                memset(&op, 0, sizeof(op));
+                op.tipo = OP_BORDES;
+                registrarPendiente(&imagen, &pendientes, &op);
                 break;
                 
             case 8:
@@ -931,14 +6321,45 @@ int main() {
                     while (getchar() != '\n');
                     break;
                 }
-                escalarImagenConcurrente(&imagen, nuevoAncho, nuevoAlto);
+                if (!materializarPendientes(&imagen, &pendientes)) break;
+                memset(&op, 0, sizeof(op));
+                op.tipo = OP_ESCALAR;
+                op.entero1 = nuevoAncho;
+                op.entero2 = nuevoAlto;
+                ejecutarOperacionMedida(&imagen, &op);
                 break;
                 
             case 9:
                 printf("¡Adiós!\n");
                 liberarImagen(&imagen);
+                mostrarEstadisticasBuffers();
+                destruirPool();
+                vaciarPoolBuffers();
                 return 0;
                 
+            case 10: {
+                if (!imagen.pixeles) {
+                    printf("No hay imagen cargada.\n");
+                    break;
+                }
+                char cadena[512];
+                printf("Cadena de operaciones (ej: brillo:20,contraste:1.3,gamma:2.2,invertir,umbral:128,niveles:10:240): ");
+                if (scanf("%511s", cadena) != 1) {
+                    printf("Entrada inválida.\n");
+                    while (getchar() != '\n');
+                    break;
+                }
+                memset(&op, 0, sizeof(op));
+                op.tipo = OP_PUNTUAL;
+                op.numPuntuales = parsearCadenaPuntual(cadena, op.puntuales, MAX_PUNTUALES);
+                if (op.numPuntuales <= 0) {
+                    printf("Cadena de operaciones inválida.\n");
+                    break;
+                }
+                registrarPendiente(&imagen, &pendientes, &op);
+                break;
+            }
+                
             default:
                 printf("Opción inválida.\n");
         }